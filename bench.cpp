@@ -0,0 +1,537 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Benchmark driver for BTreeIndex. Builds a relation with a chosen key distribution, bulk builds an index over it
+ * and runs a YCSB-style mix of inserts, point lookups and range scans. Results are printed as one JSON object.
+ *
+ * Usage: bench [--records N] [--ops N] [--dist sequential|reverse|uniform|zipfian|clustered]
+ *              [--mix load|a|b|c|e|scan] [--dups N] [--buffers N] [--seed N]
+ */
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstddef>
+#include "btree.h"
+#include "page.h"
+#include "filescan.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+const std::string relationName = "benchRel";
+
+// This is the structure for tuples in the base relation, same as in main.cpp
+
+typedef struct tuple
+{
+	int i;
+	double d;
+	char s[64];
+} RECORD;
+
+/**
+ * Benchmark parameters, set from the command line.
+ */
+struct BenchConfig
+{
+	int records;
+	int ops;
+	std::string dist;
+	std::string mix;
+	int dups;
+	int buffers;
+	unsigned int seed;
+};
+
+/**
+ * Share of each operation in a mix, in percent.
+ */
+struct OpMix
+{
+	int insert;
+	int lookup;
+	int shortScan;
+	int longScan;
+};
+
+/**
+ * Operation kinds measured by the benchmark.
+ */
+enum BenchOp
+{
+	OP_INSERT = 0,
+	OP_LOOKUP = 1,
+	OP_SHORT_SCAN = 2,
+	OP_LONG_SCAN = 3,
+	NUM_OPS = 4
+};
+
+const char *opNames[NUM_OPS] = {"insert", "lookup", "short_scan", "long_scan"};
+
+/**
+ * Number of keys covered by a short and a long range scan.
+ */
+const int SHORT_SCAN_LENGTH = 100;
+const int LONG_SCAN_LENGTH = 10000;
+
+/**
+ * Skew of the zipfian distribution, the YCSB default.
+ */
+const double ZIPF_THETA = 0.99;
+
+// -----------------------------------------------------------------------------
+// Forward declarations
+// -----------------------------------------------------------------------------
+
+bool parseArgs(int argc, char **argv, BenchConfig &config);
+bool getMix(const std::string &name, OpMix &mix);
+void generateKeys(const BenchConfig &config, std::vector<int> &keys);
+void createRelation(const std::vector<int> &keys);
+void deleteRelation();
+int scanRange(BTreeIndex *index, int lowVal, int highVal);
+double percentile(std::vector<double> &latencies, double p);
+void printOp(const char *name, std::vector<double> &latencies, bool last);
+
+// -----------------------------------------------------------------------------
+// ZipfGenerator
+// -----------------------------------------------------------------------------
+
+/**
+ * Zipfian generator over [0, n) after Gray et al., "Quickly Generating Billion-Record Synthetic Databases",
+ * as used by YCSB. Item 0 is the most popular one.
+ */
+class ZipfGenerator
+{
+public:
+	ZipfGenerator(int n, double theta) : n(n), theta(theta)
+	{
+		zetan = zeta(n, theta);
+		double zeta2 = zeta(2, theta);
+		alpha = 1.0 / (1.0 - theta);
+		eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+	}
+
+	int next()
+	{
+		double u = (double)random() / RAND_MAX;
+		double uz = u * zetan;
+		if (uz < 1.0)
+			return 0;
+		if (uz < 1.0 + std::pow(0.5, theta))
+			return 1;
+		int value = (int)(n * std::pow(eta * u - eta + 1.0, alpha));
+		return value < n ? value : n - 1;
+	}
+
+private:
+	static double zeta(int n, double theta)
+	{
+		double sum = 0;
+		for (int i = 1; i <= n; i++)
+			sum += 1.0 / std::pow((double)i, theta);
+		return sum;
+	}
+
+	int n;
+	double theta;
+	double zetan;
+	double alpha;
+	double eta;
+};
+
+// -----------------------------------------------------------------------------
+// NullBuffer
+// -----------------------------------------------------------------------------
+
+/**
+ * Stream buffer that drops everything. std::cout is pointed at it while operations are timed, so that console
+ * output of the index does not end up in the results or in the JSON.
+ */
+class NullBuffer : public std::streambuf
+{
+protected:
+	int overflow(int c) { return c; }
+};
+
+int main(int argc, char **argv)
+{
+	BenchConfig config;
+	if (!parseArgs(argc, argv, config))
+	{
+		std::cerr << "usage: bench [--records N] [--ops N] [--dist sequential|reverse|uniform|zipfian|clustered]" << std::endl;
+		std::cerr << "             [--mix load|a|b|c|e|scan] [--dups N] [--buffers N] [--seed N]" << std::endl;
+		return 1;
+	}
+	OpMix mix;
+	if (!getMix(config.mix, mix))
+	{
+		std::cerr << "unknown mix: " << config.mix << std::endl;
+		return 1;
+	}
+	srandom(config.seed);
+
+	std::vector<int> keys;
+	generateKeys(config, keys);
+	createRelation(keys);
+	int maxKey = *std::max_element(keys.begin(), keys.end());
+
+	BufMgr *bufMgr = new BufMgr(config.buffers);
+	std::string indexName;
+	NullBuffer nullBuffer;
+	std::streambuf *coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+	//------Bulk build------//
+	std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+	BTreeIndex *index = new BTreeIndex(relationName, indexName, bufMgr, offsetof(tuple, i), INTEGER);
+	double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+	IndexStats buildStats = index->stats(true);
+
+	//------Operation mix------//
+	std::vector<double> latencies[NUM_OPS];
+	ZipfGenerator zipf(config.records, ZIPF_THETA);
+	int nextInsertKey = maxKey + 1;
+	int results = 0;
+	std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+	for (int n = 0; n < config.ops; n++)
+	{
+		int dice = random() % 100;
+		int op = dice < mix.insert ? OP_INSERT
+				 : dice < mix.insert + mix.lookup ? OP_LOOKUP
+				 : dice < mix.insert + mix.lookup + mix.shortScan ? OP_SHORT_SCAN
+				 : OP_LONG_SCAN;
+		// Lookups and scans start at an existing key, popular ones first for the zipfian distribution
+		int key = (config.dist == "zipfian") ? keys[zipf.next()] : keys[random() % keys.size()];
+
+		std::chrono::steady_clock::time_point opStart = std::chrono::steady_clock::now();
+		switch (op)
+		{
+		case OP_INSERT:
+		{
+			RecordId rid;
+			rid.page_number = 0;
+			rid.slot_number = 0;
+			int newKey = nextInsertKey++;
+			index->insertEntry(&newKey, rid);
+			break;
+		}
+		case OP_LOOKUP:
+			results += scanRange(index, key, key);
+			break;
+		case OP_SHORT_SCAN:
+			results += scanRange(index, key, key + SHORT_SCAN_LENGTH - 1);
+			break;
+		default:
+			results += scanRange(index, key, key + LONG_SCAN_LENGTH - 1);
+			break;
+		}
+		latencies[op].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - opStart).count());
+	}
+	double runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+	IndexStats runStats = index->stats();
+
+	delete index;
+	std::cout.rdbuf(coutBuffer);
+
+	//------Report------//
+	std::cout << "{" << std::endl;
+	std::cout << "  \"records\": " << config.records << "," << std::endl;
+	std::cout << "  \"distribution\": \"" << config.dist << "\"," << std::endl;
+	std::cout << "  \"mix\": \"" << config.mix << "\"," << std::endl;
+	std::cout << "  \"buffers\": " << config.buffers << "," << std::endl;
+	std::cout << "  \"build\": {\"seconds\": " << buildSeconds
+			  << ", \"records_per_second\": " << (buildSeconds > 0 ? config.records / buildSeconds : 0)
+			  << ", \"pages_read\": " << buildStats.readPageCalls
+			  << ", \"buffer_misses\": " << buildStats.bufferMisses
+			  << ", \"leaf_splits\": " << buildStats.leafSplits
+			  << ", \"internal_splits\": " << buildStats.internalSplits << "}," << std::endl;
+	// Every node of a freshly created index file was allocated during the build or the run, the meta page is a single page
+	std::uint64_t allocations = buildStats.allocPageCalls + runStats.allocPageCalls;
+	std::cout << "  \"node_bytes\": " << NODE_SIZE << "," << std::endl;
+	std::cout << "  \"index_pages\": " << 1 + (allocations - 1) * BTREE_NODE_PAGES << "," << std::endl;
+	std::cout << "  \"index_bytes\": " << Page::SIZE + (allocations - 1) * NODE_SIZE << "," << std::endl;
+	std::cout << "  \"run\": {\"ops\": " << config.ops
+			  << ", \"seconds\": " << runSeconds
+			  << ", \"ops_per_second\": " << (runSeconds > 0 ? config.ops / runSeconds : 0)
+			  << ", \"results\": " << results
+			  << ", \"pages_read\": " << runStats.readPageCalls
+			  << ", \"buffer_misses\": " << runStats.bufferMisses
+			  << ", \"leaves_scanned\": " << runStats.scanLeavesVisited << "}," << std::endl;
+	std::cout << "  \"operations\": {" << std::endl;
+	for (int op = 0; op < NUM_OPS; op++)
+	{
+		printOp(opNames[op], latencies[op], op == NUM_OPS - 1);
+	}
+	std::cout << "  }" << std::endl;
+	std::cout << "}" << std::endl;
+
+	delete bufMgr;
+	try
+	{
+		File::remove(indexName);
+	}
+	catch (FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+// parseArgs
+// -----------------------------------------------------------------------------
+
+bool parseArgs(int argc, char **argv, BenchConfig &config)
+{
+	config.records = 100000;
+	config.ops = 100000;
+	config.dist = "uniform";
+	config.mix = "b";
+	config.dups = 16;
+	config.buffers = 1000;
+	config.seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (i + 1 >= argc)
+			return false;
+		std::string value = argv[++i];
+		if (arg == "--records")
+			config.records = atoi(value.c_str());
+		else if (arg == "--ops")
+			config.ops = atoi(value.c_str());
+		else if (arg == "--dist")
+			config.dist = value;
+		else if (arg == "--mix")
+			config.mix = value;
+		else if (arg == "--dups")
+			config.dups = atoi(value.c_str());
+		else if (arg == "--buffers")
+			config.buffers = atoi(value.c_str());
+		else if (arg == "--seed")
+			config.seed = atoi(value.c_str());
+		else
+			return false;
+	}
+	return config.records > 0 && config.ops >= 0 && config.dups > 0 && config.buffers > 0;
+}
+
+// -----------------------------------------------------------------------------
+// getMix
+// -----------------------------------------------------------------------------
+
+bool getMix(const std::string &name, OpMix &mix)
+{
+	//                 insert lookup short long
+	OpMix load = {0, 0, 0, 0};
+	OpMix a = {50, 50, 0, 0};
+	OpMix b = {5, 95, 0, 0};
+	OpMix c = {0, 100, 0, 0};
+	OpMix e = {5, 0, 95, 0};
+	OpMix scan = {0, 0, 50, 50};
+
+	if (name == "load")
+		mix = load;
+	else if (name == "a")
+		mix = a;
+	else if (name == "b")
+		mix = b;
+	else if (name == "c")
+		mix = c;
+	else if (name == "e")
+		mix = e;
+	else if (name == "scan")
+		mix = scan;
+	else
+		return false;
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// generateKeys
+// -----------------------------------------------------------------------------
+
+void generateKeys(const BenchConfig &config, std::vector<int> &keys)
+{
+	keys.resize(config.records);
+	for (int i = 0; i < config.records; i++)
+	{
+		keys[i] = i;
+	}
+
+	if (config.dist == "reverse")
+	{
+		std::reverse(keys.begin(), keys.end());
+	}
+	else if (config.dist == "uniform" || config.dist == "zipfian")
+	{
+		// Unique keys in random order. For zipfian only the popularity of the keys used by the mix is skewed.
+		for (int i = config.records - 1; i > 0; i--)
+		{
+			std::swap(keys[i], keys[random() % (i + 1)]);
+		}
+	}
+	else if (config.dist == "clustered")
+	{
+		// Runs of dups equal keys, the runs in random order
+		int runs = (config.records + config.dups - 1) / config.dups;
+		std::vector<int> order(runs);
+		for (int r = 0; r < runs; r++)
+		{
+			order[r] = r;
+		}
+		for (int r = runs - 1; r > 0; r--)
+		{
+			std::swap(order[r], order[random() % (r + 1)]);
+		}
+		for (int i = 0; i < config.records; i++)
+		{
+			keys[i] = order[i / config.dups];
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// createRelation
+// -----------------------------------------------------------------------------
+
+void createRelation(const std::vector<int> &keys)
+{
+	// destroy any old copies of relation file
+	try
+	{
+		File::remove(relationName);
+	}
+	catch (FileNotFoundException e)
+	{
+	}
+
+	PageFile relation(relationName, true);
+	RECORD record;
+	// initialize all of record.s to keep purify happy
+	memset(record.s, ' ', sizeof(record.s));
+	PageId new_page_number;
+	Page new_page = relation.allocatePage(new_page_number);
+
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		sprintf(record.s, "%05d string record", keys[i]);
+		record.i = keys[i];
+		record.d = (double)keys[i];
+		std::string new_data(reinterpret_cast<char *>(&record), sizeof(record));
+
+		while (1)
+		{
+			try
+			{
+				new_page.insertRecord(new_data);
+				break;
+			}
+			catch (InsufficientSpaceException e)
+			{
+				relation.writePage(new_page_number, new_page);
+				new_page = relation.allocatePage(new_page_number);
+			}
+		}
+	}
+
+	relation.writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// deleteRelation
+// -----------------------------------------------------------------------------
+
+void deleteRelation()
+{
+	try
+	{
+		File::remove(relationName);
+	}
+	catch (FileNotFoundException e)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// scanRange
+// -----------------------------------------------------------------------------
+
+int scanRange(BTreeIndex *index, int lowVal, int highVal)
+{
+	int numResults = 0;
+	try
+	{
+		index->startScan(&lowVal, GTE, &highVal, LTE);
+	}
+	catch (NoSuchKeyFoundException e)
+	{
+		return 0;
+	}
+
+	try
+	{
+		RecordId scanRid;
+		while (1)
+		{
+			index->scanNext(scanRid);
+			numResults++;
+		}
+	}
+	catch (IndexScanCompletedException e)
+	{
+	}
+	index->endScan();
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// percentile
+// -----------------------------------------------------------------------------
+
+double percentile(std::vector<double> &latencies, double p)
+{
+	if (latencies.empty())
+	{
+		return 0;
+	}
+	size_t rank = (size_t)std::ceil(p * latencies.size());
+	if (rank > 0)
+	{
+		rank--;
+	}
+	std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+	return latencies[rank];
+}
+
+// -----------------------------------------------------------------------------
+// printOp
+// -----------------------------------------------------------------------------
+
+void printOp(const char *name, std::vector<double> &latencies, bool last)
+{
+	double total = 0;
+	for (size_t i = 0; i < latencies.size(); i++)
+	{
+		total += latencies[i];
+	}
+	std::cout << "    \"" << name << "\": {\"count\": " << latencies.size()
+			  << ", \"ops_per_second\": " << (total > 0 ? latencies.size() * 1e6 / total : 0)
+			  << ", \"p50_us\": " << percentile(latencies, 0.50)
+			  << ", \"p99_us\": " << percentile(latencies, 0.99)
+			  << ", \"p999_us\": " << percentile(latencies, 0.999) << "}" << (last ? "" : ",") << std::endl;
+}
@@ -6,7 +6,10 @@
  */
 
 #include "btree.h"
+#include "btree_snapshot.h"
+#include "btree_art.h"
 #include "filescan.h"
+#include "page_iterator.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
@@ -17,12 +20,24 @@
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
-#define debugBadIndex
-// #define DEBUGINSERTENTRY
-// #define DEBUGFINDPLACEHELPER
-// #define DEBUGLEAFSPLIT
-// #define DEBUGINSERTLEAF
-// #define GETPRARENT
+#include "exceptions/badgerdb_exception.h"
+#include "btree_trace.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <exception>
+#include <queue>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#if BTREE_STATS
+#define BTREE_STAT_ADD(counter, n) (this->statCounters.counter += (n))
+#else
+#define BTREE_STAT_ADD(counter, n)
+#endif
 
 namespace badgerdb
 {
@@ -32,6 +47,271 @@ namespace badgerdb
  */
 bool rootIsLeaf = true;
 
+/**
+ * Length of the insert run after which an adaptive split leaves the new entry alone in a node.
+ */
+const int SPLIT_RUN_LENGTH = 8;
+
+/**
+ * Number of leaves a scan asks the kernel for at once. A new batch is issued when fewer than half of them are left ahead.
+ */
+const int SCAN_READ_AHEAD = 16;
+
+/**
+ * Number of sub-ranges a parallel scan cuts its range into per thread, so that threads done early have work to take over.
+ */
+const int SCAN_TASKS_PER_THREAD = 4;
+
+/**
+ * Sub-ranges of a parallel scan and the state shared by the threads working on them. Sub-range t holds the keys above
+ * separator t - 1 and up to separator t, the first and the last one are closed by the bounds of the scan.
+ */
+struct ScanTaskQueue
+{
+	int lowVal;
+	Operator lowOp;
+	int highVal;
+	Operator highOp;
+	std::vector<int> separators;
+	std::vector<std::vector<RecordId> > *partitions;
+	std::atomic<int> nextTask;
+	std::mutex failureLatch;
+	std::exception_ptr failure;
+};
+
+/**
+ * A node of BTREE_NODE_PAGES pages. Its pages stay pinned while the node is, and the buffer is copied back into
+ * them when the last pin goes, after which it is spare.
+ */
+struct NodeExtent
+{
+	char data[NODE_SIZE];
+	Page *frames[BTREE_NODE_PAGES];
+	int pins;
+	bool dirty;
+};
+
+/**
+ * Number of heap pages a thread of a parallel build claims at once.
+ */
+const int BUILD_MORSEL_PAGES = 8;
+
+/**
+ * One index entry read from the relation by a parallel build.
+ */
+struct BuildEntry
+{
+	int key;
+	RecordId rid;
+	double includeVal;
+};
+
+/**
+ * Read a column of a record in place. Records carry no alignment, so the bytes are copied into the result
+ * instead of dereferencing a cast pointer.
+ */
+static inline int recordInt(const char *record, int byteOffset)
+{
+	int value;
+	memcpy(&value, record + byteOffset, sizeof(int));
+	return value;
+}
+
+static inline double recordDouble(const char *record, int byteOffset)
+{
+	double value;
+	memcpy(&value, record + byteOffset, sizeof(double));
+	return value;
+}
+
+/**
+ * Order of the entries of a parallel build: by key, and entries with equal keys in heap order.
+ */
+static bool buildEntryLess(const BuildEntry &a, const BuildEntry &b)
+{
+	if (a.key != b.key)
+		return a.key < b.key;
+	if (a.rid.page_number != b.rid.page_number)
+		return a.rid.page_number < b.rid.page_number;
+	return a.rid.slot_number < b.rid.slot_number;
+}
+
+/**
+ * Heap pages of a parallel build and the sorted runs its threads produce, runs[i][t] for index i and thread t.
+ * nextPage is guarded by the pageLatch of the index reading the relation, each thread only touches its own runs.
+ */
+struct BuildQueue
+{
+	File *heapFile;
+	PageId nextPage;
+	std::vector<BTreeIndex *> indexes;
+	std::vector<std::vector<std::vector<BuildEntry> > > runs;
+	std::mutex failureLatch;
+	std::exception_ptr failure;
+};
+
+/**
+ * Next entry of one run while the runs of a parallel build are merged.
+ */
+struct RunHead
+{
+	BuildEntry entry;
+	int run;
+
+	bool operator<(const RunHead &other) const
+	{
+		// std::priority_queue keeps the largest element on top, the merge needs the smallest
+		return buildEntryLess(other.entry, entry);
+	}
+};
+
+/**
+ * A node written by a bulk load, as its parent needs it.
+ */
+struct BuiltNode
+{
+	PageId pageNo;
+	int maxKey;
+	int count;
+	KeyAggregate agg;
+};
+
+/**
+ * Summary of a leaf written by a bulk load.
+ */
+static BuiltNode builtLeaf(PageId pageNo, const LeafNodeInt *leaf)
+{
+	BuiltNode built = {pageNo, leaf->size ? leaf->keyArray[leaf->size - 1] : 0, leaf->size, KeyAggregate()};
+	built.agg.clear();
+#if BTREE_SUBTREE_AGGREGATES
+	for (int i = 0; i < leaf->size; i++)
+	{
+		built.agg.add(leaf->keyArray[i], leaf->includeArray[i]);
+	}
+#endif
+	return built;
+}
+
+/**
+ * Largest NOT-IN list tested key by key against every entry. Longer lists are binary searched for each entry.
+ */
+const int NOT_IN_LINEAR_KEYS = 16;
+
+/**
+ * Test a block of keys against a key predicate. Every kind of predicate is one branch-free loop over the block, which
+ * the compiler turns into vector instructions, and the parts of a compound predicate are combined a block at a time.
+ * @param predicate  the predicate
+ * @param keys       the keys
+ * @param count      number of keys, at most INTARRAYLEAFSIZE
+ * @param matches    set to 1 for every key that satisfies the predicate and to 0 for the others
+ */
+static void evaluateKeyPredicate(const KeyPredicate &predicate, const int *keys, int count, unsigned char *matches)
+{
+	switch (predicate.kind)
+	{
+	case KEY_MOD:
+	{
+		// No key has a remainder by 0, and every key has remainder 0 by -1, which INT_MIN % -1 would overflow to find
+		if (!predicate.operand)
+		{
+			memset(matches, 0, count);
+			break;
+		}
+		const int divisor = predicate.operand == -1 ? 1 : predicate.operand;
+		for (int i = 0; i < count; i++)
+		{
+			matches[i] = keys[i] % divisor == predicate.value;
+		}
+		break;
+	}
+	case KEY_MASK:
+		for (int i = 0; i < count; i++)
+		{
+			matches[i] = (keys[i] & predicate.operand) == predicate.value;
+		}
+		break;
+	case KEY_NOT_IN:
+	{
+		const std::vector<int> &values = predicate.values;
+		if (values.size() <= (size_t)NOT_IN_LINEAR_KEYS)
+		{
+			memset(matches, 1, count);
+			for (size_t v = 0; v < values.size(); v++)
+			{
+				const int excluded = values[v];
+				for (int i = 0; i < count; i++)
+				{
+					matches[i] &= keys[i] != excluded;
+				}
+			}
+		}
+		else
+		{
+			for (int i = 0; i < count; i++)
+			{
+				matches[i] = !std::binary_search(values.begin(), values.end(), keys[i]);
+			}
+		}
+		break;
+	}
+	case KEY_AND:
+	case KEY_OR:
+	{
+		const bool all = predicate.kind == KEY_AND;
+		memset(matches, all, count);
+		unsigned char childMatches[INTARRAYLEAFSIZE];
+		for (size_t c = 0; c < predicate.children.size(); c++)
+		{
+			evaluateKeyPredicate(predicate.children[c], keys, count, childMatches);
+			if (all)
+			{
+				for (int i = 0; i < count; i++)
+				{
+					matches[i] &= childMatches[i];
+				}
+			}
+			else
+			{
+				for (int i = 0; i < count; i++)
+				{
+					matches[i] |= childMatches[i];
+				}
+			}
+		}
+		break;
+	}
+	case KEY_NOT:
+		if (predicate.children.empty())
+		{
+			memset(matches, 0, count);
+			break;
+		}
+		evaluateKeyPredicate(predicate.children[0], keys, count, matches);
+		for (int i = 0; i < count; i++)
+		{
+			matches[i] ^= 1;
+		}
+		break;
+	}
+}
+
+/**
+ * Child of a non-leaf node an inclusive bound ends in: the first one whose separator is larger than the key.
+ * A split can leave copies of its separator on both sides, so the child up to a separator equal to the key can
+ * be followed by more entries with that key.
+ * @param node  the non-leaf node
+ * @param key   the bound
+ */
+static int upperChildIndex(const NonLeafNodeInt *node, int key)
+{
+	int index = 0;
+	while (index < node->size && node->keyArray[index] <= key)
+	{
+		index++;
+	}
+	return index;
+}
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::BTreeIndex -- Constructor
 // -----------------------------------------------------------------------------
@@ -40,42 +320,109 @@ BTreeIndex::BTreeIndex(const std::string &relationName,
 					   std::string &outIndexName,
 					   BufMgr *bufMgrIn,
 					   const int attrByteOffset,
-					   const Datatype attrType)
+					   const Datatype attrType,
+					   const int includeByteOffset,
+					   const Datatype includeType,
+					   const IndexOpenMode openMode,
+					   const int buildThreads)
 {
 	this->bufMgr = bufMgrIn;
+	this->file = NULL;
+	this->mappedData = NULL;
+	this->mappedSize = 0;
+	this->prefetchFd = -1;
 	//------Create the name of index file------//
 	std::ostringstream idxStr;
 	idxStr << relationName << '.' << attrByteOffset;
 	outIndexName = idxStr.str();
+	// Included values are kept as doubles, which only numbers convert to
+	if (includeByteOffset >= 0 && includeType != INTEGER && includeType != DOUBLE)
+	{
+		throw BadIndexInfoException("Included column must be INTEGER or DOUBLE");
+	}
 
 	//------Initialize some members------//
 	this->attrByteOffset = attrByteOffset;
 	this->attributeType = attrType;
 	this->leafOccupancy = INTARRAYLEAFSIZE;
 	this->nodeOccupancy = INTARRAYNONLEAFSIZE;
+	this->includeByteOffset = includeByteOffset;
+	this->includeType = includeType;
+	this->insertIncludeVal = 0;
 	this->scanExecuting = false;
+	this->readAheadMore = false;
+	this->readAheadKey = 0;
+	this->leavesReadAhead = 0;
+	this->scanFiltered = false;
+	this->scanSelectionNext = 0;
+	this->scanLastLeaf = false;
 	this->nextEntry = -1;
 	this->currentPageNum = 0;
 	this->headerPageNum = 1;
+	this->currentLSN = 0;
+	this->checkpointLSN = 0;
+	this->checkpointDirtyPages = 0;
+	this->pinnedPages = 0;
+	this->checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+	this->opsSinceCheckpoint = 0;
+	this->structureChanged = false;
+	this->splitPolicy = SPLIT_ADAPTIVE;
+	for (int slot = 0; slot < SPLIT_RUN_SLOTS; slot++)
+	{
+		this->runPages[slot] = 0;
+		this->runLengths[slot] = 0;
+	}
+	this->skewedSplit = 0;
+	this->appendLeafNum = 0;
+	this->appendLeafSize = 0;
+	this->appendLeafMaxKey = 0;
+	this->learnedMaxError = 0;
+	this->insertLeafNum = 0;
+	this->splitLeafNum = 0;
+	this->splitNewLeafNum = 0;
+	this->frontIndex = NULL;
+	this->frontFirstLeaf = 0;
+	this->statCounters.clear();
+	this->traceThreshold = 0;
+	this->traceCapacity = 0;
+	this->tracing = false;
 
-	//-----Open the index file if exist; otherwise create a new index file with the name created.-----//
-	if (File::exists(outIndexName))
+	//-----Map the index file, or open it if exist; otherwise create a new index file with the name created.-----//
+	if (openMode == OPEN_READ_ONLY_MAPPED)
+	{
+		mapIndexFile(outIndexName);
+	}
+	if (this->mappedData || File::exists(outIndexName))
 	{
-		file = new BlobFile(outIndexName, false);
 		//Read metaPage (first page) of the file
 		Page *meta;
-		headerPageNum = this->file->getFirstPageNo();
-		this->bufMgr->readPage(this->file, headerPageNum, meta);
+		if (!this->mappedData)
+		{
+			file = new BlobFile(outIndexName, false);
+			headerPageNum = this->file->getFirstPageNo();
+		}
+		this->readIndexPage(headerPageNum, meta);
 		IndexMetaInfo *metaPage = (IndexMetaInfo *)meta;
 		this->rootPageNum = metaPage->rootPageNo;
+		this->checkpointLSN = metaPage->checkpointLSN;
+		this->currentLSN = metaPage->checkpointLSN;
+
+		// Files written before the layout fields were added hold zeros in them
+		bool legacyMeta = metaPage->metaVersion == 0;
+		int fileNodeFormat = legacyMeta ? 0 : metaPage->nodeFormat;
+		int fileIncludeByteOffset = legacyMeta ? -1 : metaPage->includeByteOffset;
+		int fileNodeSize = legacyMeta ? (int)Page::SIZE : metaPage->nodeSize;
 
-		if (metaPage->attrByteOffset != attrByteOffset || metaPage->relationName != relationName || metaPage->attrType != attrType)
+		if (metaPage->attrByteOffset != attrByteOffset || metaPage->relationName != relationName || metaPage->attrType != attrType ||
+			fileNodeFormat != INDEX_NODE_FORMAT || fileIncludeByteOffset != includeByteOffset ||
+			(includeByteOffset >= 0 && metaPage->includeType != includeType) || fileNodeSize != NODE_SIZE)
 		{
 			//Unpin the meta page before throwing the exception
-			this->bufMgr->unPinPage(this->file, this->file->getFirstPageNo(), false);
+			this->unPinIndexPage(headerPageNum, false);
+			unmapIndexFile();
 			throw new badgerdb::BadIndexInfoException("MetaInfo mismatch!");
 		}
-		this->bufMgr->unPinPage(this->file, this->file->getFirstPageNo(), false);
+		this->unPinIndexPage(headerPageNum, false);
 	}
 	//------Create new index file if the index file does not exist------//
 	else
@@ -84,13 +431,16 @@ BTreeIndex::BTreeIndex(const std::string &relationName,
 		//Create metainfo Page
 		IndexMetaInfo *metaPage;
 		Page *meta;
+		// The meta page is a single page, every later page of the file belongs to a node
+		BTREE_STAT_ADD(allocPageCalls, 1);
 		this->bufMgr->allocPage(this->file, this->headerPageNum, meta);
+		this->pinnedPages++;
 		metaPage = (IndexMetaInfo *)meta;
 
 		// Create a root node. This node is intialized as a leaf node.
 		LeafNodeInt *rootNode;
 		Page *root;
-		this->bufMgr->allocPage(this->file, this->rootPageNum, root);
+		this->allocIndexPage(this->rootPageNum, root);
 		rootNode = (LeafNodeInt *)root;
 		rootNode->size = 0;
 		rootNode->rightSibPageNo = 0;
@@ -100,29 +450,53 @@ BTreeIndex::BTreeIndex(const std::string &relationName,
 		metaPage->rootPageNo = this->rootPageNum;
 		metaPage->attrByteOffset = attrByteOffset;
 		metaPage->attrType = attributeType;
+		metaPage->checkpointLSN = 0;
+		metaPage->nodeFormat = INDEX_NODE_FORMAT;
+		metaPage->includeByteOffset = includeByteOffset;
+		metaPage->includeType = includeType;
+		metaPage->nodeSize = NODE_SIZE;
+		metaPage->metaVersion = INDEX_META_VERSION;
 
 		// flush pages
-		this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
-		this->bufMgr->unPinPage(this->file, this->rootPageNum, true);
+		this->unPinIndexPage(this->headerPageNum, true);
+		this->unPinIndexPage(this->rootPageNum, true);
 
 		//Scan all tuples in the relation. Insert all tuples into the index.
-		FileScan scn(relationName, bufMgrIn);
-		try
+		OperationTimer buildTimer(this, OP_BUILD);
+		int numRecords = 0;
+		if (openMode == OPEN_CREATE_EMPTY)
 		{
-			RecordId scanRid;
-			while (1)
-			{
-				scn.scanNext(scanRid);
-				std::string recordStr = scn.getRecord();
-				const char *record = recordStr.c_str();
-				void *key = (void *)(record + this->attrByteOffset);
-				insertEntry(key, scanRid);
-			}
+			// The caller adds the entries, see buildIndexes()
+		}
+		else if (buildThreads != 1)
+		{
+			numRecords = buildParallel(relationName, buildThreads);
 		}
-		catch (const badgerdb::EndOfFileException &e)
+		else
 		{
-			std::cout << "All records has been read" << '\n';
+			FileScan scn(relationName, bufMgrIn);
+			try
+			{
+				RecordId scanRid;
+				while (1)
+				{
+					scn.scanNext(scanRid);
+					// FileScan only hands out records as strings, the key and included column are read from it
+					std::string recordStr = scn.getRecord();
+					insertRecord(recordStr.c_str(), scanRid);
+					numRecords++;
+				}
+			}
+			catch (const badgerdb::EndOfFileException &e)
+			{
+			}
 		}
+		BTREE_TRACE_INFO(TRACE_BUILD_DONE, numRecords, this->rootPageNum);
+	}
+	// Reads go through the buffer manager; this descriptor is only used to tell the kernel what they will be
+	if (!this->mappedData)
+	{
+		this->prefetchFd = open(outIndexName.c_str(), O_RDONLY);
 	}
 }
 
@@ -136,7 +510,7 @@ BTreeIndex::~BTreeIndex()
 	{
 		if (this->currentPageNum)
 		{
-			this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
+			this->unPinIndexPage(this->currentPageNum, false);
 		}
 
 		if (this->scanExecuting)
@@ -146,7 +520,16 @@ BTreeIndex::~BTreeIndex()
 
 		if (this->file)
 		{
+			// Flushing the file writes the pages dirtied since the last checkpoint, after which all inserts are on
+			// disk. The checkpoint record goes straight to the file, as no frame of it is left in the buffer pool.
 			this->bufMgr->flushFile(this->file);
+			if (this->currentLSN != this->checkpointLSN)
+			{
+				Page meta = this->file->readPage(headerPageNum);
+				IndexMetaInfo *metaPage = (IndexMetaInfo *)&meta;
+				metaPage->checkpointLSN = this->currentLSN;
+				this->file->writePage(headerPageNum, meta);
+			}
 			delete this->file;
 			this->file = NULL;
 		}
@@ -155,592 +538,3336 @@ BTreeIndex::~BTreeIndex()
 	{
 		std::cerr << e.what() << '\n';
 	}
+	if (this->prefetchFd >= 0)
+	{
+		close(this->prefetchFd);
+		this->prefetchFd = -1;
+	}
+	unmapIndexFile();
+	delete this->frontIndex;
+	this->frontIndex = NULL;
+	for (std::map<PageId, NodeExtent *>::iterator it = this->nodeExtents.begin(); it != this->nodeExtents.end(); ++it)
+	{
+		delete it->second;
+	}
+	this->nodeExtents.clear();
+	for (size_t i = 0; i < this->spareExtents.size(); i++)
+	{
+		delete this->spareExtents[i];
+	}
+	this->spareExtents.clear();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertRecord
+// -----------------------------------------------------------------------------
+const void BTreeIndex::insertRecord(const char *record, const RecordId rid)
+{
+	int key = recordInt(record, this->attrByteOffset);
+	insertEntry(&key, rid, includeValue(record));
 }
 
 // -----------------------------------------------------------------------------
 // BTreeIndex::insertEntry
 // -----------------------------------------------------------------------------
-const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
+const void BTreeIndex::insertEntry(const void *key, const RecordId rid, const double includeVal)
 {
-	std::cout << *((int *)key) << std::endl;
+	checkWritable();
+	OperationTimer timer(this, OP_INSERT_ENTRY);
+	BTREE_TRACE_DEBUG(TRACE_INSERT_ENTRY, *((int *)key), rid.page_number);
+	this->structureChanged = false;
+	this->insertIncludeVal = includeVal;
+	this->insertLeafNum = 0;
+	this->splitLeafNum = 0;
+	this->splitNewLeafNum = 0;
+	bool appended = false;
 	if (this->rootPageNum == 2)
 	{ // This means root is a leaf.
 		insertLeaf(key, rid, this->rootPageNum);
-		return;
 	}
-	// The root is a nonleafNode
-	PageId pageToInsert = FindPlaceHelper(key, this->rootPageNum);
-	insertLeaf(key, rid, pageToInsert);
+	else if (!(appended = appendToRightmostLeaf(key, rid)))
+	{
+		// The root is a nonleafNode
+		PageId pageToInsert = FindPlaceHelper(key, this->rootPageNum);
+		insertLeaf(key, rid, pageToInsert);
+	}
+#if BTREE_SUBTREE_COUNTS || BTREE_SUBTREE_AGGREGATES
+	// An append has updated the summaries on its path already. The root may have become a nonleafNode during this
+	// insert, in which case its summaries were taken before the new entry was placed and are counted again.
+	if (!appended && this->rootPageNum != 2)
+	{
+		updateSubtreeSummaries(this->rootPageNum, key, this->structureChanged);
+	}
+#endif
+	// An entry that went down the tree into the rightmost leaf without splitting it keeps the cached leaf current
+	if (!appended && this->appendLeafNum && this->insertLeafNum == this->appendLeafNum)
+	{
+		this->appendLeafSize++;
+		if (*(int *)key > this->appendLeafMaxKey)
+		{
+			this->appendLeafMaxKey = *(int *)key;
+		}
+	}
+	if (this->learnedMaxError)
+	{
+		learnedAfterInsert(*(int *)key);
+	}
+	this->currentLSN++;
+
+	// Every checkpointInterval inserts, flush the index once enough of it is dirty, so closing it has little left to write
+	if (this->checkpointDirtyPages > 0 && ++this->opsSinceCheckpoint >= this->checkpointInterval)
+	{
+		this->opsSinceCheckpoint = 0;
+		checkpoint(this->checkpointDirtyPages);
+	}
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::FindPlaceHelper
+// BTreeIndex::appendToRightmostLeaf
 // -----------------------------------------------------------------------------
-PageId BTreeIndex::FindPlaceHelper(const void *key, PageId pageNo)
+bool BTreeIndex::appendToRightmostLeaf(const void *key, const RecordId rid)
 {
+	if (!this->appendLeafNum)
+	{
+		cacheRightmostPath();
+	}
+	// Anything that does not go past the end of a leaf with room left takes the normal path
+	if (!this->appendLeafSize || this->appendLeafSize == this->leafOccupancy || *(int *)key <= this->appendLeafMaxKey)
+	{
+		return false;
+	}
 	Page *tmp;
-	this->bufMgr->readPage(this->file, pageNo, tmp);
-	NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
-	this->bufMgr->unPinPage(this->file, pageNo, false);
-	// Find the index to insert in the page, and find the corresponding child page
-	int index = getIndexNonLeaf(pageNo, key);
-	PageId nextLevelPage = curNode->pageNoArray[index];
-	// If the page is one level above the leaf
-	if (curNode->level == 1)
-		return nextLevelPage;
-	// Else, recursively find the right page to insert
-	return FindPlaceHelper(key, nextLevelPage);
+	this->readIndexPage(this->appendLeafNum, tmp);
+	LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
+	recordInsertPosition(this->appendLeafNum, leafNode->size, leafNode->size);
+	this->insertLeafNum = this->appendLeafNum;
+	leafNode->keyArray[leafNode->size] = *(int *)key;
+	leafNode->ridArray[leafNode->size] = rid;
+#if BTREE_SUBTREE_AGGREGATES
+	leafNode->includeArray[leafNode->size] = this->insertIncludeVal;
+#endif
+	leafNode->size++;
+	this->unPinIndexPage(this->appendLeafNum, true);
+	this->appendLeafSize++;
+	this->appendLeafMaxKey = *(int *)key;
+	BTREE_STAT_ADD(appendInserts, 1);
+
+#if BTREE_SUBTREE_COUNTS || BTREE_SUBTREE_AGGREGATES
+	// The new entry is below the last child of every page on the path
+	for (size_t i = 0; i < this->appendPath.size(); i++)
+	{
+		this->readIndexPage(this->appendPath[i], tmp);
+		NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+#if BTREE_SUBTREE_COUNTS
+		curNode->countArray[curNode->size]++;
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+		curNode->aggArray[curNode->size].add(*(int *)key, this->insertIncludeVal);
+#endif
+		this->unPinIndexPage(this->appendPath[i], true);
+	}
+#endif
+	return true;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::insertLeaf
+// BTreeIndex::cacheRightmostPath
 // -----------------------------------------------------------------------------
-const void BTreeIndex::insertLeaf(const void *key, RecordId rid, PageId pageNo)
+void BTreeIndex::cacheRightmostPath()
 {
+	this->appendPath.clear();
+	PageId pageNo = this->rootPageNum;
+	bool isLeaf = this->rootPageNum == 2;
+	while (!isLeaf)
+	{
+		Page *tmp;
+		this->readIndexPage(pageNo, tmp);
+		NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+		this->appendPath.push_back(pageNo);
+		PageId childNo = curNode->pageNoArray[curNode->size];
+		isLeaf = curNode->level == 1;
+		this->unPinIndexPage(pageNo, false);
+		pageNo = childNo;
+	}
 	Page *tmp;
-	this->bufMgr->readPage(this->file, pageNo, tmp);
+	this->readIndexPage(pageNo, tmp);
 	LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
-	RIDKeyPair<int> pair;
-	pair.set(rid, *((int *)key));
+	this->appendLeafSize = leafNode->size;
+	this->appendLeafMaxKey = leafNode->size ? leafNode->keyArray[leafNode->size - 1] : 0;
+	this->unPinIndexPage(pageNo, false);
+	this->appendLeafNum = pageNo;
+}
 
-	// If the leaf node is empty
-	if (!leafNode->size)
+// -----------------------------------------------------------------------------
+// BTreeIndex::forgetRightmostPath
+// -----------------------------------------------------------------------------
+void BTreeIndex::forgetRightmostPath(PageId pageNo)
+{
+	if (pageNo == this->appendLeafNum || std::find(this->appendPath.begin(), this->appendPath.end(), pageNo) != this->appendPath.end())
 	{
-		leafNode->keyArray[leafNode->size] = pair.key;
-		leafNode->ridArray[leafNode->size++] = pair.rid;
-		this->bufMgr->unPinPage(this->file, pageNo, true);
-		return;
+		this->appendLeafNum = 0;
 	}
+}
 
-	int index = getIndexLeaf(pageNo, key);
-
-	/*---Check if need to split. If so, split and insert---*/
-	if (leafNode->size == this->leafOccupancy)
+// -----------------------------------------------------------------------------
+// BTreeIndex::unPinIndexPage
+// -----------------------------------------------------------------------------
+void BTreeIndex::unPinIndexPage(PageId pageNo, bool dirty)
+{
+	// Mapped pages are never pinned
+	if (this->mappedData)
 	{
-		splitAndInsert(pageNo, key, rid);
-		this->bufMgr->unPinPage(this->file, pageNo, false);
 		return;
 	}
-	// Move every entry from i to i+1 since we are inserting at i. In this case, no need to change parent's entry
-	for (int j = leafNode->size - 1; j >= index; j--)
+	BTREE_STAT_ADD(unPinPageCalls, 1);
+	if (nodePages(pageNo) == 1)
 	{
-		leafNode->keyArray[j + 1] = leafNode->keyArray[j];
-		leafNode->ridArray[j + 1] = leafNode->ridArray[j];
+		this->bufMgr->unPinPage(this->file, pageNo, dirty);
 	}
-	//insert at index
-	leafNode->keyArray[index] = pair.key;
-	leafNode->ridArray[index] = pair.rid;
-	leafNode->size++;
-
-	//Since inserted, the page is dirty
-	try
+	else
 	{
-		this->bufMgr->unPinPage(this->file, pageNo, true);
+		std::map<PageId, NodeExtent *>::iterator found = this->nodeExtents.find(pageNo);
+		if (found == this->nodeExtents.end() || !found->second->pins)
+		{
+			throw PageNotPinnedException(this->file->filename(), pageNo, 0);
+		}
+		NodeExtent *extent = found->second;
+		extent->dirty = extent->dirty || dirty;
+		if (!--extent->pins)
+		{
+			// The frames get the node back before the buffer manager may write them out, and the buffer is then spare
+			for (int i = 0; i < BTREE_NODE_PAGES; i++)
+			{
+				if (extent->dirty)
+				{
+					memcpy((char *)extent->frames[i], extent->data + i * Page::SIZE, Page::SIZE);
+				}
+				this->bufMgr->unPinPage(this->file, pageNo + i, extent->dirty);
+			}
+			this->nodeExtents.erase(found);
+			this->spareExtents.push_back(extent);
+		}
 	}
-	catch (const badgerdb::PageNotPinnedException &e)
+	this->pinnedPages--;
+	if (dirty)
 	{
-		std::cerr << "insertLeaf: exception thrown after all insertion \t" << e.what() << '\n';
+		this->dirtyPages.insert(pageNo);
 	}
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::splitAndInsert
+// BTreeIndex::readIndexPage
 // -----------------------------------------------------------------------------
-const void BTreeIndex::splitAndInsert(PageId pageNo, const void *key, RecordId rid)
+void BTreeIndex::readIndexPage(PageId pageNo, Page *&page)
 {
-	Page *tmp;
-	this->bufMgr->readPage(this->file, pageNo, tmp);
-	LeafNodeInt *leftNode = (LeafNodeInt *)tmp;
-	RIDKeyPair<int> pair;
-	pair.key = *((int *)key);
-	pair.rid = rid;
-
-	//------Construct a new page------//
-	Page *newPage;
-	PageId newPageId;
-	this->bufMgr->allocPage(this->file, newPageId, newPage);
-	LeafNodeInt *newNode = (LeafNodeInt *)newPage;
-
-	// Update the right sibling page number
-	newNode->rightSibPageNo = leftNode->rightSibPageNo;
-	leftNode->rightSibPageNo = newPageId;
-
-	int size = leftNode->size; //Same as leaf occupancy
-	int mid = size / 2 + size % 2;
-
-	// Move the floor (size / 2) of the original page to new page
-	memcpy(&newNode->keyArray[0], &leftNode->keyArray[mid], sizeof(int) * (size - mid));
-	memcpy(&newNode->ridArray[0], &leftNode->ridArray[mid], sizeof(RecordId) * (size - mid));
-	leftNode->size = mid;
-	newNode->size = size - mid;
-
-	PageId parentPageId = getParent(pageNo, key);
-	// Edge case: Root is the leaf, and there is no parent(there is only one leaf node in the btree, and the pageNo = 2)
-	if (!parentPageId)
+	if (this->mappedData)
 	{
-		splitRoot();
-		parentPageId = this->rootPageNum;
-		Page *tmp;
-		this->bufMgr->readPage(this->file, parentPageId, tmp);
-		NonLeafNodeInt *root = (NonLeafNodeInt *)tmp;
-		// Update root
-		root->size = 1;
-		root->level = 1;
-		root->keyArray[0] = leftNode->keyArray[mid - 1];
-		root->pageNoArray[0] = pageNo;
-		root->pageNoArray[1] = newPageId;
-		this->bufMgr->unPinPage(this->file, parentPageId, true);
+		// BlobFile keeps page n at byte (n - 1) * Page::SIZE, and the pages of a node follow each other
+		if (!pageNo || (size_t)(pageNo - 1 + nodePages(pageNo)) * Page::SIZE > this->mappedSize)
+		{
+			throw BadgerDbException("Page number out of the mapped index file");
+		}
+		page = (Page *)(this->mappedData + (size_t)(pageNo - 1) * Page::SIZE);
+		BTREE_STAT_ADD(readPageCalls, 1);
+		return;
+	}
+#if BTREE_STATS
+	// The buffer manager counts its disk reads, so a miss is a readPage call that moved that count
+	const BufStats &bufStats = this->bufMgr->getBufStats();
+	int diskReads = bufStats.diskreads;
+#endif
+	if (nodePages(pageNo) == 1)
+	{
+		this->bufMgr->readPage(this->file, pageNo, page);
 	}
 	else
 	{
-		insertInternal(&leftNode->keyArray[mid - 1], parentPageId, newPageId);
+		std::map<PageId, NodeExtent *>::iterator found = this->nodeExtents.find(pageNo);
+		if (found == this->nodeExtents.end())
+		{
+			found = this->nodeExtents.insert(std::make_pair(pageNo, takeNodeExtent())).first;
+		}
+		NodeExtent *extent = found->second;
+		// A pinned node is already assembled, its pages are pinned with it
+		if (!extent->pins)
+		{
+			for (int i = 0; i < BTREE_NODE_PAGES; i++)
+			{
+				this->bufMgr->readPage(this->file, pageNo + i, extent->frames[i]);
+				memcpy(extent->data + i * Page::SIZE, (char *)extent->frames[i], Page::SIZE);
+			}
+		}
+		extent->pins++;
+		page = (Page *)extent->data;
+	}
+	this->pinnedPages++;
+#if BTREE_STATS
+	this->statCounters.readPageCalls++;
+	if (this->tracing && this->currentTrace.pagesVisited.size() < MAX_TRACE_PAGES)
+	{
+		this->currentTrace.pagesVisited.push_back(pageNo);
 	}
-	// determine on which page to insert the new key
-	if (*(int *)key >= leftNode->keyArray[mid])
+	if (bufStats.diskreads != diskReads)
 	{
-		// Then add the new key into the right (new) leaf
-		insertLeaf(key, rid, newPageId);
+		this->statCounters.bufferMisses++;
 	}
 	else
 	{
-		insertLeaf(key, rid, pageNo);
+		this->statCounters.bufferHits++;
 	}
+#endif
+}
 
-	//Unpin pages
-	try
+// -----------------------------------------------------------------------------
+// BTreeIndex::nodePages
+// -----------------------------------------------------------------------------
+int BTreeIndex::nodePages(PageId pageNo) const
+{
+	return pageNo == this->headerPageNum ? 1 : BTREE_NODE_PAGES;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::takeNodeExtent
+// -----------------------------------------------------------------------------
+NodeExtent *BTreeIndex::takeNodeExtent()
+{
+	NodeExtent *extent;
+	if (this->spareExtents.empty())
 	{
-		this->bufMgr->unPinPage(this->file, pageNo, true);
-		this->bufMgr->unPinPage(this->file, newPageId, true);
+		extent = new NodeExtent;
 	}
-	catch (const badgerdb::PageNotPinnedException &e)
+	else
 	{
-		std::cerr << "splitAndInsert: exception thrown when closing the original and new leaf node\t" << e.what() << '\n';
+		extent = this->spareExtents.back();
+		this->spareExtents.pop_back();
 	}
+	extent->pins = 0;
+	extent->dirty = false;
+	return extent;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::insertInternal
+// BTreeIndex::mapIndexFile
 // -----------------------------------------------------------------------------
-const void BTreeIndex::insertInternal(const void *key, PageId parentPageNo, PageId childPageNo)
+void BTreeIndex::mapIndexFile(const std::string &indexName)
 {
-	Page *tmp;
-	this->bufMgr->readPage(this->file, parentPageNo, tmp);
-	NonLeafNodeInt *parentNode = (NonLeafNodeInt *)tmp;
-	// Get the index to insert
-	int index = getIndexNonLeaf(parentPageNo, key);
+	int fd = open(indexName.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw FileNotFoundException(indexName);
+	}
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t)(Page::SIZE + NODE_SIZE))
+	{
+		close(fd);
+		throw FileNotFoundException(indexName);
+	}
+	void *data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		throw FileNotFoundException(indexName);
+	}
+	// Lookups touch a few pages all over the file, so read-ahead would mostly fetch pages nobody asked for.
+	// Scans ask for their leaves themselves, see readAheadLeaves().
+	madvise(data, fileStat.st_size, MADV_RANDOM);
+	this->mappedData = (char *)data;
+	this->mappedSize = fileStat.st_size;
+}
 
-	/*--- Check if need to split---*/
-	if (parentNode->size == INTARRAYNONLEAFSIZE)
+// -----------------------------------------------------------------------------
+// BTreeIndex::unmapIndexFile
+// -----------------------------------------------------------------------------
+void BTreeIndex::unmapIndexFile()
+{
+	if (this->mappedData)
 	{
-		splitAndInsertInternal(parentPageNo, key, childPageNo);
+		munmap(this->mappedData, this->mappedSize);
+		this->mappedData = NULL;
+		this->mappedSize = 0;
 	}
-	// No need to split
-	else
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::prefetchIndexPages
+// -----------------------------------------------------------------------------
+void BTreeIndex::prefetchIndexPages(std::vector<PageId> pages)
+{
+	if (!this->mappedData && this->prefetchFd < 0)
 	{
-		for (int j = parentNode->size - 1; j >= index; j--)
+		return;
+	}
+	std::sort(pages.begin(), pages.end());
+	pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+	// One request per run of consecutive pages
+	size_t i = 0;
+	while (i < pages.size())
+	{
+		size_t j = i + 1;
+		while (j < pages.size() && pages[j] == pages[j - 1] + BTREE_NODE_PAGES)
 		{
-			parentNode->keyArray[j + 1] = parentNode->keyArray[j];
-			parentNode->pageNoArray[j + 2] = parentNode->pageNoArray[j + 1];
+			j++;
 		}
-		//insert at index
-		parentNode->keyArray[index] = *(int *)key;
-		parentNode->pageNoArray[index + 1] = childPageNo;
-		parentNode->size++;
+		size_t offset = (size_t)(pages[i] - 1) * Page::SIZE;
+		size_t length = (j - i) * NODE_SIZE;
+		if (this->mappedData)
+		{
+			if (offset < this->mappedSize)
+			{
+				length = std::min(length, this->mappedSize - offset);
+				madvise(this->mappedData + offset, length, MADV_WILLNEED);
+			}
+		}
+		else
+		{
+			posix_fadvise(this->prefetchFd, (off_t)offset, (off_t)length, POSIX_FADV_WILLNEED);
+		}
+		i = j;
 	}
-	try
+	BTREE_STAT_ADD(prefetchedPages, pages.size());
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::readAheadLeaves
+// -----------------------------------------------------------------------------
+int BTreeIndex::readAheadLeaves(int key)
+{
+	// Learned routing knows the leaves in order, without reading their parents
+	int leafNum = this->learnedMaxError ? predictLeaf(key, true) : -1;
+	if (leafNum >= 0)
 	{
-		this->bufMgr->unPinPage(this->file, parentPageNo, true);
+		std::vector<PageId> leaves;
+		int numLeaves = this->learnedLeafPages.size();
+		int last = leafNum;
+		for (int j = leafNum; j < numLeaves && (int)leaves.size() < SCAN_READ_AHEAD; j++)
+		{
+			if (j > leafNum && this->learnedLeafMaxKeys[j - 1] >= this->highValInt)
+			{
+				break;
+			}
+			leaves.push_back(this->learnedLeafPages[j]);
+			last = j;
+		}
+		this->readAheadMore = last + 1 < numLeaves && this->learnedLeafMaxKeys[last] < this->highValInt;
+		this->readAheadKey = last < numLeaves ? this->learnedLeafMaxKeys[last] : 0;
+		prefetchIndexPages(leaves);
+		return leaves.size();
 	}
-	catch (const badgerdb::PageNotPinnedException &e)
+
+	// Find the level 1 node above the leaf holding key, and the largest key its subtree may hold
+	bool bounded = false;
+	int bound = 0;
+	PageId pageNo = this->rootPageNum;
+	Page *page;
+	this->readIndexPage(pageNo, page);
+	NonLeafNodeInt *node = (NonLeafNodeInt *)page;
+	int i = 0;
+	while (1)
+	{
+		i = 0;
+		while (i < node->size && node->keyArray[i] < key)
+		{
+			i++;
+		}
+		if (node->level == 1)
+		{
+			break;
+		}
+		if (i < node->size)
+		{
+			bounded = true;
+			bound = node->keyArray[i];
+		}
+		PageId childNo = node->pageNoArray[i];
+		this->unPinIndexPage(pageNo, false);
+		pageNo = childNo;
+		this->readIndexPage(pageNo, page);
+		node = (NonLeafNodeInt *)page;
+	}
+
+	// Take the leaves from i on, stopping at the first one above the range
+	std::vector<PageId> leaves;
+	bool beyondRange = false;
+	int last = i;
+	for (int j = i; j <= node->size && (int)leaves.size() < SCAN_READ_AHEAD; j++)
+	{
+		if (j > 0 && node->keyArray[j - 1] >= this->highValInt)
+		{
+			beyondRange = true;
+			break;
+		}
+		leaves.push_back(node->pageNoArray[j]);
+		last = j;
+	}
+	this->readAheadMore = !beyondRange && (last < node->size || bounded);
+	this->readAheadKey = last < node->size ? node->keyArray[last] : bound;
+	if (this->readAheadKey >= this->highValInt)
 	{
-		std::cerr << "insertInternal: exception thrown when closing the parent page \t" << e.what() << '\n';
+		this->readAheadMore = false;
 	}
+	this->unPinIndexPage(pageNo, false);
+	prefetchIndexPages(leaves);
+	return leaves.size();
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::insertAndSplitInternal
+// BTreeIndex::prefetchKeys
 // -----------------------------------------------------------------------------
-const void BTreeIndex::splitAndInsertInternal(PageId leftPageNo, const void *key, PageId pageInPair)
+const void BTreeIndex::prefetchKeys(const int *keys, int count)
 {
-	Page *tmp;
-	this->bufMgr->readPage(this->file, leftPageNo, tmp);
-	NonLeafNodeInt *leftNode = (NonLeafNodeInt *)tmp;
-	//------Construct a new page------//
-	Page *newPage;
-	PageId newPageNo;
-	this->bufMgr->allocPage(this->file, newPageNo, newPage);
-	NonLeafNodeInt *newNode = (NonLeafNodeInt *)newPage;
-	// Update level
-	newNode->level = leftNode->level;
-	// Create a pair to insert
-	PageKeyPair<int> pair;
-	pair.set(pageInPair, *((int *)key));
+	if (this->rootPageNum == 2 || count <= 0)
+	{
+		return;
+	}
+	// Sorted keys that share a node are next to each other, so every node is read once per level
+	std::vector<int> sortedKeys(keys, keys + count);
+	std::sort(sortedKeys.begin(), sortedKeys.end());
+	sortedKeys.erase(std::unique(sortedKeys.begin(), sortedKeys.end()), sortedKeys.end());
+	std::vector<PageId> nodeOf(sortedKeys.size(), this->rootPageNum);
+	bool leafLevel = false;
+	while (!leafLevel)
+	{
+		std::vector<PageId> children;
+		size_t k = 0;
+		while (k < sortedKeys.size())
+		{
+			PageId pageNo = nodeOf[k];
+			Page *page;
+			this->readIndexPage(pageNo, page);
+			NonLeafNodeInt *node = (NonLeafNodeInt *)page;
+			int i = 0;
+			for (; k < sortedKeys.size() && nodeOf[k] == pageNo; k++)
+			{
+				while (i < node->size && node->keyArray[i] < sortedKeys[k])
+				{
+					i++;
+				}
+				nodeOf[k] = node->pageNoArray[i];
+				if (children.empty() || children.back() != nodeOf[k])
+				{
+					children.push_back(nodeOf[k]);
+				}
+			}
+			leafLevel = node->level == 1;
+			this->unPinIndexPage(pageNo, false);
+		}
+		prefetchIndexPages(children);
+	}
+}
 
-	int mid = (nodeOccupancy - 1) / 2;
+// -----------------------------------------------------------------------------
+// BTreeIndex::probeSorted
+// -----------------------------------------------------------------------------
+const int BTreeIndex::probeSorted(const int *keys, const RecordId *tags, int count,
+								  std::vector<std::pair<RecordId, RecordId> > &outPairs)
+{
+	size_t firstPair = outPairs.size();
+	std::vector<RecordId> matches;
+	PageId leafNo = 0;
+	int entry = 0;
+	int k = 0;
+	BTREE_STAT_ADD(probeKeys, count);
+	while (k < count)
+	{
+		const int key = keys[k];
+		Page *page;
+		if (leafNo)
+		{
+			// Stay on the leaf of the previous key as long as the key is not past its last entry
+			this->readIndexPage(leafNo, page);
+			LeafNodeInt *leaf = (LeafNodeInt *)page;
+			if (!leaf->size || leaf->keyArray[leaf->size - 1] < key)
+			{
+				this->unPinIndexPage(leafNo, false);
+				leafNo = 0;
+			}
+		}
+		if (!leafNo)
+		{
+			// Go down to the first leaf that may hold key
+			leafNo = this->rootPageNum;
+			bool reachLeaf = leafNo == 2;
+			while (!reachLeaf)
+			{
+				this->readIndexPage(leafNo, page);
+				NonLeafNodeInt *node = (NonLeafNodeInt *)page;
+				int i = 0;
+				while (i < node->size && node->keyArray[i] < key)
+				{
+					i++;
+				}
+				PageId childNo = node->pageNoArray[i];
+				reachLeaf = node->level == 1;
+				this->unPinIndexPage(leafNo, false);
+				leafNo = childNo;
+			}
+			this->readIndexPage(leafNo, page);
+			entry = 0;
+			BTREE_STAT_ADD(probeDescents, 1);
+		}
 
-	/* Algorithm: first split the node into two nodes, then insert the keyPagePair to either node (call insertInternal).
-	 * When splitting, push up the max key of the left node. Here call insertInternal again. In this way, all chained-splits
-	 * should be handled during the recursive call between insertInternal() and insertAndSplitInternal().
-	 * Note that if we reach the root and need to split the root, call the helper method splitRoot() and manually set the 
-	 * new root to be the parent node.
-	*/
+		// Gather the entries of the key, which run on into the right siblings for long runs of duplicates
+		LeafNodeInt *leaf = (LeafNodeInt *)page;
+		while (entry < leaf->size && leaf->keyArray[entry] < key)
+		{
+			entry++;
+		}
+		matches.clear();
+		PageId runPageNo = leafNo;
+		int runEntry = entry;
+		while (1)
+		{
+			while (runEntry < leaf->size && leaf->keyArray[runEntry] == key)
+			{
+				matches.push_back(leaf->ridArray[runEntry++]);
+			}
+			PageId nextPageNo = leaf->rightSibPageNo;
+			if (runEntry < leaf->size || !nextPageNo || matches.empty())
+			{
+				break;
+			}
+			if (runPageNo != leafNo)
+			{
+				this->unPinIndexPage(runPageNo, false);
+			}
+			runPageNo = nextPageNo;
+			runEntry = 0;
+			this->readIndexPage(runPageNo, page);
+			leaf = (LeafNodeInt *)page;
+		}
+		if (runPageNo != leafNo)
+		{
+			this->unPinIndexPage(runPageNo, false);
+		}
+		this->unPinIndexPage(leafNo, false);
 
-	memcpy(&newNode->keyArray[0], &leftNode->keyArray[mid + 1], sizeof(int) * (nodeOccupancy - mid - 1));
-	memcpy(&newNode->pageNoArray[0], &leftNode->pageNoArray[mid + 1], sizeof(PageId) * (nodeOccupancy - mid));
-	leftNode->size = mid;
-	newNode->size = nodeOccupancy - mid - 1;
+		// Every repeat of the key gets the same entries
+		for (; k < count && keys[k] == key; k++)
+		{
+			for (size_t m = 0; m < matches.size(); m++)
+			{
+				outPairs.push_back(std::make_pair(tags[k], matches[m]));
+			}
+		}
+	}
+	return outPairs.size() - firstPair;
+}
 
-	PageId parentPageId = getParent(leftPageNo, key);
-	// Edge case: Check if the leftNode is the root node. If so, split the root
-	if (!parentPageId)
+// -----------------------------------------------------------------------------
+// BTreeIndex::checkWritable
+// -----------------------------------------------------------------------------
+void BTreeIndex::checkWritable() const
+{
+	if (this->mappedData)
 	{
-		splitRoot();
-		parentPageId = this->rootPageNum;
-		Page *tmp;
-		this->bufMgr->readPage(this->file, parentPageId, tmp);
-		NonLeafNodeInt *root = (NonLeafNodeInt *)tmp;
-		// Update root
-		root->size = 1;
-		root->level = 0;
-		root->keyArray[0] = leftNode->keyArray[mid];
-		root->pageNoArray[0] = leftPageNo;
-		root->pageNoArray[1] = newPageNo;
-		this->bufMgr->unPinPage(this->file, parentPageId, true);
+		throw BadgerDbException("Index is open read-only");
 	}
-	else
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::allocIndexPage
+// -----------------------------------------------------------------------------
+void BTreeIndex::allocIndexPage(PageId &pageNo, Page *&page)
+{
+	BTREE_STAT_ADD(allocPageCalls, 1);
+	this->bufMgr->allocPage(this->file, pageNo, page);
+	this->pinnedPages++;
+	if (BTREE_NODE_PAGES == 1)
 	{
-		insertInternal(&leftNode->keyArray[mid], parentPageId, newPageNo);
+		return;
+	}
+	NodeExtent *&extent = this->nodeExtents[pageNo];
+	if (!extent)
+	{
+		extent = takeNodeExtent();
 	}
+	extent->frames[0] = page;
+	for (int i = 1; i < BTREE_NODE_PAGES; i++)
+	{
+		// Nothing else allocates pages of the index file, so the pages of a node follow each other
+		PageId nextPageNo;
+		this->bufMgr->allocPage(this->file, nextPageNo, extent->frames[i]);
+		if (nextPageNo != pageNo + i)
+		{
+			throw BadgerDbException("Node pages are not consecutive");
+		}
+	}
+	for (int i = 0; i < BTREE_NODE_PAGES; i++)
+	{
+		memcpy(extent->data + i * Page::SIZE, (char *)extent->frames[i], Page::SIZE);
+	}
+	extent->pins = 1;
+	extent->dirty = false;
+	page = (Page *)extent->data;
+}
 
-	if (pair.key >= leftNode->keyArray[mid])
+// -----------------------------------------------------------------------------
+// BTreeIndex::recordInsertPosition
+// -----------------------------------------------------------------------------
+void BTreeIndex::recordInsertPosition(PageId pageNo, int index, int size)
+{
+	int slot = pageNo % SPLIT_RUN_SLOTS;
+	int run = this->runPages[slot] == pageNo ? this->runLengths[slot] : 0;
+	if (index == size)
 	{
-		insertInternal(key, newPageNo, pair.pageNo);
+		run = run > 0 ? run + 1 : 1;
+	}
+	else if (index == 0)
+	{
+		run = run < 0 ? run - 1 : -1;
 	}
 	else
 	{
-		insertInternal(key, leftPageNo, pair.pageNo);
+		run = 0;
 	}
-	try
+	this->runPages[slot] = pageNo;
+	this->runLengths[slot] = run;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertRunOf
+// -----------------------------------------------------------------------------
+int BTreeIndex::insertRunOf(PageId pageNo) const
+{
+	int slot = pageNo % SPLIT_RUN_SLOTS;
+	return this->runPages[slot] == pageNo ? this->runLengths[slot] : 0;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setSplitPolicy
+// -----------------------------------------------------------------------------
+const void BTreeIndex::setSplitPolicy(SplitPolicy policy)
+{
+	this->splitPolicy = policy;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setLearnedRouting
+// -----------------------------------------------------------------------------
+const void BTreeIndex::setLearnedRouting(int maxError)
+{
+	this->learnedMaxError = maxError > 0 ? maxError : 0;
+	this->learnedLeafPages.clear();
+	this->learnedLeafMaxKeys.clear();
+	this->learnedSegments.clear();
+	if (this->learnedMaxError)
+	{
+		buildLearnedRouting();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::buildLearnedRouting
+// -----------------------------------------------------------------------------
+void BTreeIndex::buildLearnedRouting()
+{
+	this->learnedLeafPages.clear();
+	this->learnedLeafMaxKeys.clear();
+	this->learnedSegments.clear();
+
+	// Go down the leftmost path, then follow the leaf chain
+	Page *tmp;
+	PageId pageNo = this->rootPageNum;
+	bool isLeaf = (this->rootPageNum == 2);
+	while (!isLeaf)
+	{
+		this->readIndexPage(pageNo, tmp);
+		NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+		PageId childPageNo = curNode->pageNoArray[0];
+		isLeaf = (curNode->level == 1);
+		this->unPinIndexPage(pageNo, false);
+		pageNo = childPageNo;
+	}
+	while (pageNo != 0)
+	{
+		this->readIndexPage(pageNo, tmp);
+		LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
+		// An empty leaf can only be the root, and no key is routed past it
+		this->learnedLeafPages.push_back(pageNo);
+		this->learnedLeafMaxKeys.push_back(leafNode->size ? leafNode->keyArray[leafNode->size - 1] : INT_MAX);
+		PageId nextPageNo = leafNode->rightSibPageNo;
+		this->unPinIndexPage(pageNo, false);
+		pageNo = nextPageNo;
+	}
+	fitLeafSegments(0, this->learnedLeafPages.size(), this->learnedSegments);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::fitLeafSegments
+// -----------------------------------------------------------------------------
+void BTreeIndex::fitLeafSegments(int first, int end, std::vector<LeafSegment> &segments)
+{
+	const std::vector<int> &maxKeys = this->learnedLeafMaxKeys;
+	int leafNum = first;
+	while (leafNum < end)
+	{
+		LeafSegment segment;
+		segment.firstKey = maxKeys[leafNum];
+		segment.firstLeaf = leafNum;
+		segment.drift = 0;
+		// Narrow the range of slopes that keep every leaf so far within the error, until it is empty
+		double lowSlope = 0;
+		double highSlope = -1;
+		int next = leafNum + 1;
+		for (; next < end; next++)
+		{
+			double keys = (double)maxKeys[next] - segment.firstKey;
+			double leaves = next - leafNum;
+			if (keys == 0)
+			{
+				if (leaves > this->learnedMaxError)
+					break;
+				continue;
+			}
+			double low = (leaves - this->learnedMaxError) / keys;
+			double high = (leaves + this->learnedMaxError) / keys;
+			if (highSlope >= 0 && (low > highSlope || high < lowSlope))
+				break;
+			lowSlope = std::max(lowSlope, low);
+			highSlope = highSlope < 0 ? high : std::min(highSlope, high);
+		}
+		segment.slope = highSlope < 0 ? 0 : (lowSlope + highSlope) / 2;
+		segments.push_back(segment);
+		leafNum = next;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::refitLeafSegment
+// -----------------------------------------------------------------------------
+void BTreeIndex::refitLeafSegment(int segment)
+{
+	int first = this->learnedSegments[segment].firstLeaf;
+	int end = segment + 1 < (int)this->learnedSegments.size() ? this->learnedSegments[segment + 1].firstLeaf
+															  : (int)this->learnedLeafPages.size();
+	std::vector<LeafSegment> fitted;
+	fitLeafSegments(first, end, fitted);
+	this->learnedSegments.erase(this->learnedSegments.begin() + segment);
+	this->learnedSegments.insert(this->learnedSegments.begin() + segment, fitted.begin(), fitted.end());
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::predictLeaf
+// -----------------------------------------------------------------------------
+int BTreeIndex::predictLeaf(int key, bool inclusive)
+{
+	const std::vector<int> &maxKeys = this->learnedLeafMaxKeys;
+	int numLeaves = maxKeys.size();
+	int numSegments = this->learnedSegments.size();
+	if (!numSegments)
+	{
+		return -1;
+	}
+	// The answer lies after the first leaf of the last model that starts before the key, up to the first leaf of the next
+	int low = 0;
+	int high = numSegments;
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		int firstKey = this->learnedSegments[mid].firstKey;
+		if (inclusive ? firstKey < key : firstKey <= key)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	int segmentNum = low > 0 ? low - 1 : 0;
+	const LeafSegment &segment = this->learnedSegments[segmentNum];
+	int end = segmentNum + 1 < numSegments ? this->learnedSegments[segmentNum + 1].firstLeaf : numLeaves;
+	double predicted = segment.firstLeaf + segment.slope * ((double)key - segment.firstKey);
+	predicted = std::min(std::max(predicted, (double)segment.firstLeaf), (double)end);
+
+	// Search the window around the prediction, after checking that it holds the answer
+	int error = this->learnedMaxError + segment.drift + 1;
+	int first = std::max(0, (int)predicted - error);
+	int last = std::min(numLeaves, (int)predicted + error + 1);
+	if ((first > 0 && (inclusive ? maxKeys[first - 1] >= key : maxKeys[first - 1] > key)) ||
+		(last < numLeaves && (inclusive ? maxKeys[last] < key : maxKeys[last] <= key)))
+	{
+		BTREE_STAT_ADD(learnedFallbacks, 1);
+		refitLeafSegment(segmentNum);
+		return -1;
+	}
+	while (first < last)
+	{
+		int mid = (first + last) / 2;
+		if (inclusive ? maxKeys[mid] < key : maxKeys[mid] <= key)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+	BTREE_STAT_ADD(learnedLookups, 1);
+	return first;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::learnedAfterInsert
+// -----------------------------------------------------------------------------
+void BTreeIndex::learnedAfterInsert(int key)
+{
+	std::vector<PageId> &leafPages = this->learnedLeafPages;
+	std::vector<int> &maxKeys = this->learnedLeafMaxKeys;
+	int numLeaves = leafPages.size();
+	// The key went past the end of the leaf before the first one that reaches it, or into one of the leaves from there
+	// on that end with the key, or into the first leaf with larger keys
+	PageId targetNum = this->splitLeafNum ? this->splitLeafNum : this->insertLeafNum;
+	int leafNum = std::lower_bound(maxKeys.begin(), maxKeys.end(), key) - maxKeys.begin();
+	leafNum = leafNum > 0 ? leafNum - 1 : 0;
+	while (leafNum < numLeaves && leafPages[leafNum] != targetNum && (maxKeys[leafNum] <= key || (leafNum > 0 && maxKeys[leafNum - 1] < key)))
+	{
+		leafNum++;
+	}
+	if (leafNum == numLeaves || leafPages[leafNum] != targetNum)
+	{
+		buildLearnedRouting();
+		return;
+	}
+
+	int segmentNum = 0;
+	while (segmentNum + 1 < (int)this->learnedSegments.size() && this->learnedSegments[segmentNum + 1].firstLeaf <= leafNum)
+	{
+		segmentNum++;
+	}
+	LeafSegment &segment = this->learnedSegments[segmentNum];
+	if (this->splitNewLeafNum)
+	{
+		// The new leaf follows the split one, and every later leaf moves one position to the right
+		Page *tmp;
+		this->readIndexPage(this->splitLeafNum, tmp);
+		LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
+		maxKeys[leafNum] = leafNode->keyArray[leafNode->size - 1];
+		this->unPinIndexPage(this->splitLeafNum, false);
+		this->readIndexPage(this->splitNewLeafNum, tmp);
+		leafNode = (LeafNodeInt *)tmp;
+		maxKeys.insert(maxKeys.begin() + leafNum + 1, leafNode->keyArray[leafNode->size - 1]);
+		this->unPinIndexPage(this->splitNewLeafNum, false);
+		leafPages.insert(leafPages.begin() + leafNum + 1, this->splitNewLeafNum);
+		for (size_t i = segmentNum + 1; i < this->learnedSegments.size(); i++)
+		{
+			this->learnedSegments[i].firstLeaf++;
+		}
+		segment.drift++;
+	}
+	else if (key > maxKeys[leafNum])
+	{
+		// A larger key moves the leaf to the right in the model
+		maxKeys[leafNum] = key;
+		double predicted = segment.firstLeaf + segment.slope * ((double)key - segment.firstKey);
+		int error = (int)(predicted - leafNum) - this->learnedMaxError;
+		if (error > segment.drift)
+		{
+			segment.drift = error;
+		}
+	}
+	if (segment.drift > this->learnedMaxError)
+	{
+		refitLeafSegment(segmentNum);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setFrontIndex
+// -----------------------------------------------------------------------------
+const void BTreeIndex::setFrontIndex(bool enable)
+{
+	delete this->frontIndex;
+	this->frontIndex = NULL;
+	this->frontFirstLeaf = 0;
+	if (enable)
+	{
+		this->frontIndex = new AdaptiveRadixTree();
+		if (this->rootPageNum == 2)
+		{
+			this->frontFirstLeaf = this->rootPageNum;
+		}
+		else
+		{
+			buildFrontIndex(this->rootPageNum, false, 0);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::buildFrontIndex
+// -----------------------------------------------------------------------------
+void BTreeIndex::buildFrontIndex(PageId pageNo, bool hasFence, int fence)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+	int size = curNode->size;
+	bool childrenAreLeaves = (curNode->level == 1);
+	std::vector<int> keys(curNode->keyArray, curNode->keyArray + size);
+	std::vector<PageId> children(curNode->pageNoArray, curNode->pageNoArray + size + 1);
+	this->unPinIndexPage(pageNo, false);
+
+	// Child i holds the keys above separator i - 1, the first child those above the separator left of this node
+	for (int i = 0; i <= size; i++)
+	{
+		bool childHasFence = (i > 0 || hasFence);
+		int childFence = i > 0 ? keys[i - 1] : fence;
+		if (!childrenAreLeaves)
+		{
+			buildFrontIndex(children[i], childHasFence, childFence);
+		}
+		else if (childHasFence)
+		{
+			this->frontIndex->insert(childFence, children[i], false);
+		}
+		else
+		{
+			this->frontFirstLeaf = children[i];
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::freeIndexPage
+// -----------------------------------------------------------------------------
+void BTreeIndex::freeIndexPage(PageId pageNo)
+{
+	for (int i = 0; i < nodePages(pageNo); i++)
+	{
+		this->bufMgr->disposePage(this->file, pageNo + i);
+	}
+	std::map<PageId, NodeExtent *>::iterator found = this->nodeExtents.find(pageNo);
+	if (found != this->nodeExtents.end())
+	{
+		this->spareExtents.push_back(found->second);
+		this->nodeExtents.erase(found);
+	}
+	this->dirtyPages.erase(pageNo);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::stats
+// -----------------------------------------------------------------------------
+IndexStats BTreeIndex::stats(bool reset)
+{
+	IndexStats snapshot = this->statCounters;
+	if (reset)
+	{
+		this->statCounters.clear();
+	}
+	return snapshot;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::checkpoint
+// -----------------------------------------------------------------------------
+const bool BTreeIndex::checkpoint(int maxPages)
+{
+	if (this->dirtyPages.empty() || (int)this->dirtyPages.size() < maxPages)
+	{
+		return false;
+	}
+	// The buffer manager refuses to flush a file with pinned pages, so a step taken while a caller holds a node
+	// waits for the next one
+	if (this->pinnedPages)
+	{
+		return false;
+	}
+	// Flushing writes every dirty page of the index once and leaves it clean. The pages leave the buffer pool with
+	// it, and are read back by the operations that need them next.
+	this->bufMgr->flushFile(this->file);
+	this->dirtyPages.clear();
+	writeCheckpointRecord(this->currentLSN);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::writeCheckpointRecord
+// -----------------------------------------------------------------------------
+void BTreeIndex::writeCheckpointRecord(std::uint64_t lsn)
+{
+	Page *tmp;
+	this->readIndexPage(this->headerPageNum, tmp);
+	IndexMetaInfo *metaPage = (IndexMetaInfo *)tmp;
+	metaPage->checkpointLSN = lsn;
+	// The frame now matches what is written, so it does not need to be marked dirty
+	this->file->writePage(this->headerPageNum, *tmp);
+	this->unPinIndexPage(this->headerPageNum, false);
+	this->checkpointLSN = lsn;
+	BTREE_TRACE_INFO(TRACE_CHECKPOINT, lsn, this->rootPageNum);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setCheckpointRate
+// -----------------------------------------------------------------------------
+const void BTreeIndex::setCheckpointRate(int dirtyPages, int interval)
+{
+	this->checkpointDirtyPages = dirtyPages;
+	this->checkpointInterval = interval > 0 ? interval : 1;
+	this->opsSinceCheckpoint = 0;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::OperationTimer
+// -----------------------------------------------------------------------------
+BTreeIndex::OperationTimer::OperationTimer(BTreeIndex *index, IndexOperation op)
+{
+#if BTREE_STATS
+	this->index = index;
+	this->op = op;
+	// The build calls insertEntry for every record, so only the inserts are traced
+	this->traced = index->traceCapacity > 0 && op != OP_BUILD && !index->tracing;
+	if (this->traced)
+	{
+		index->tracing = true;
+		index->currentTrace.op = op;
+		index->currentTrace.pagesVisited.clear();
+		// Counter values at the start, turned into differences when the operation ends
+		index->currentTrace.leafSplits = index->statCounters.leafSplits;
+		index->currentTrace.internalSplits = index->statCounters.internalSplits;
+		index->currentTrace.bufferMisses = index->statCounters.bufferMisses;
+	}
+	this->start = std::chrono::steady_clock::now();
+#else
+	(void)index;
+	(void)op;
+#endif
+}
+
+BTreeIndex::OperationTimer::~OperationTimer()
+{
+#if BTREE_STATS
+	std::uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start).count();
+	index->latencies[op].record(nanos);
+	if (!this->traced)
+	{
+		return;
+	}
+	index->tracing = false;
+	if (nanos < index->traceThreshold)
+	{
+		return;
+	}
+	OperationTrace &trace = index->currentTrace;
+	trace.nanos = nanos;
+	trace.leafSplits = index->statCounters.leafSplits - trace.leafSplits;
+	trace.internalSplits = index->statCounters.internalSplits - trace.internalSplits;
+	trace.bufferMisses = index->statCounters.bufferMisses - trace.bufferMisses;
+	index->slowTraces.push_back(trace);
+	while ((int)index->slowTraces.size() > index->traceCapacity)
+	{
+		index->slowTraces.pop_front();
+	}
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::resetLatencyHistograms
+// -----------------------------------------------------------------------------
+const void BTreeIndex::resetLatencyHistograms()
+{
+	for (int op = 0; op < NUM_INDEX_OPERATIONS; op++)
+	{
+		this->latencies[op].clear();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setSlowOperationTrace
+// -----------------------------------------------------------------------------
+const void BTreeIndex::setSlowOperationTrace(std::uint64_t thresholdNanos, int capacity)
+{
+	this->traceThreshold = thresholdNanos;
+	this->traceCapacity = capacity > 0 ? capacity : 0;
+	while ((int)this->slowTraces.size() > this->traceCapacity)
+	{
+		this->slowTraces.pop_front();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// LatencyHistogram::clear
+// -----------------------------------------------------------------------------
+void LatencyHistogram::clear()
+{
+	memset(this->buckets, 0, sizeof(this->buckets));
+	this->total = 0;
+	this->maxValue = 0;
+}
+
+// -----------------------------------------------------------------------------
+// LatencyHistogram::bucketOf
+// -----------------------------------------------------------------------------
+int LatencyHistogram::bucketOf(std::uint64_t nanos)
+{
+	// Values below LATENCY_SUB_BUCKETS have a bucket each
+	if (nanos < (std::uint64_t)LATENCY_SUB_BUCKETS)
+	{
+		return (int)nanos;
+	}
+	// Above that, magnitude m holds [LATENCY_SUB_BUCKETS << m, LATENCY_SUB_BUCKETS << (m + 1)) in LATENCY_SUB_BUCKETS steps of 2^m
+	int magnitude = 0;
+	while ((nanos >> magnitude) >= (std::uint64_t)(2 * LATENCY_SUB_BUCKETS))
+	{
+		magnitude++;
+	}
+	if (magnitude >= LATENCY_MAGNITUDES)
+	{
+		return LATENCY_SUB_BUCKETS * (LATENCY_MAGNITUDES + 1) - 1;
+	}
+	int subBucket = (int)(nanos >> magnitude) - LATENCY_SUB_BUCKETS;
+	return LATENCY_SUB_BUCKETS * (magnitude + 1) + subBucket;
+}
+
+// -----------------------------------------------------------------------------
+// LatencyHistogram::bucketEnd
+// -----------------------------------------------------------------------------
+std::uint64_t LatencyHistogram::bucketEnd(int bucket)
+{
+	if (bucket < LATENCY_SUB_BUCKETS)
+	{
+		return bucket;
+	}
+	int magnitude = bucket / LATENCY_SUB_BUCKETS - 1;
+	int subBucket = bucket % LATENCY_SUB_BUCKETS;
+	return ((std::uint64_t)(LATENCY_SUB_BUCKETS + subBucket + 1) << magnitude) - 1;
+}
+
+// -----------------------------------------------------------------------------
+// LatencyHistogram::record
+// -----------------------------------------------------------------------------
+void LatencyHistogram::record(std::uint64_t nanos)
+{
+	this->buckets[bucketOf(nanos)]++;
+	this->total++;
+	if (nanos > this->maxValue)
+	{
+		this->maxValue = nanos;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// LatencyHistogram::percentile
+// -----------------------------------------------------------------------------
+std::uint64_t LatencyHistogram::percentile(double fraction) const
+{
+	if (!this->total)
+	{
+		return 0;
+	}
+	std::uint64_t rank = (std::uint64_t)(fraction * this->total + 0.5);
+	if (rank < 1)
+	{
+		rank = 1;
+	}
+	std::uint64_t seen = 0;
+	for (int bucket = 0; bucket < LATENCY_SUB_BUCKETS * (LATENCY_MAGNITUDES + 1); bucket++)
+	{
+		seen += this->buckets[bucket];
+		if (seen >= rank)
+		{
+			std::uint64_t end = bucketEnd(bucket);
+			return end < this->maxValue ? end : this->maxValue;
+		}
+	}
+	return this->maxValue;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::FindPlaceHelper
+// -----------------------------------------------------------------------------
+PageId BTreeIndex::FindPlaceHelper(const void *key, PageId pageNo)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+	// Find the index to insert in the page, and find the corresponding child page
+	int index = getIndexNonLeaf(pageNo, key);
+	PageId nextLevelPage = curNode->pageNoArray[index];
+	bool aboveLeaf = curNode->level == 1;
+	this->unPinIndexPage(pageNo, false);
+	// If the page is one level above the leaf
+	if (aboveLeaf)
+		return nextLevelPage;
+	// Else, recursively find the right page to insert
+	return FindPlaceHelper(key, nextLevelPage);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertLeaf
+// -----------------------------------------------------------------------------
+const void BTreeIndex::insertLeaf(const void *key, RecordId rid, PageId pageNo)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
+	RIDKeyPair<int> pair;
+	pair.set(rid, *((int *)key));
+
+	// If the leaf node is empty
+	if (!leafNode->size)
+	{
+		this->insertLeafNum = pageNo;
+		leafNode->keyArray[leafNode->size] = pair.key;
+#if BTREE_SUBTREE_AGGREGATES
+		leafNode->includeArray[leafNode->size] = this->insertIncludeVal;
+#endif
+		leafNode->ridArray[leafNode->size++] = pair.rid;
+		this->unPinIndexPage(pageNo, true);
+		return;
+	}
+
+	int index = getIndexLeaf(pageNo, key);
+	recordInsertPosition(pageNo, index, leafNode->size);
+
+	/*---Check if need to split. If so, split and insert---*/
+	if (leafNode->size == this->leafOccupancy)
+	{
+		splitAndInsert(pageNo, key, rid);
+		this->unPinIndexPage(pageNo, false);
+		return;
+	}
+	this->insertLeafNum = pageNo;
+	// Move every entry from i to i+1 since we are inserting at i. In this case, no need to change parent's entry
+	for (int j = leafNode->size - 1; j >= index; j--)
+	{
+		leafNode->keyArray[j + 1] = leafNode->keyArray[j];
+		leafNode->ridArray[j + 1] = leafNode->ridArray[j];
+#if BTREE_SUBTREE_AGGREGATES
+		leafNode->includeArray[j + 1] = leafNode->includeArray[j];
+#endif
+	}
+	//insert at index
+	leafNode->keyArray[index] = pair.key;
+	leafNode->ridArray[index] = pair.rid;
+#if BTREE_SUBTREE_AGGREGATES
+	leafNode->includeArray[index] = this->insertIncludeVal;
+#endif
+	leafNode->size++;
+
+	//Since inserted, the page is dirty
+	try
+	{
+		this->unPinIndexPage(pageNo, true);
+	}
+	catch (const badgerdb::PageNotPinnedException &e)
+	{
+		BTREE_TRACE_ERROR(TRACE_UNPIN_FAILED, pageNo, 0);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::splitAndInsert
+// -----------------------------------------------------------------------------
+const void BTreeIndex::splitAndInsert(PageId pageNo, const void *key, RecordId rid)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	LeafNodeInt *leftNode = (LeafNodeInt *)tmp;
+	RIDKeyPair<int> pair;
+	pair.key = *((int *)key);
+	pair.rid = rid;
+
+	//------Construct a new page------//
+	Page *newPage;
+	PageId newPageId;
+	this->allocIndexPage(newPageId, newPage);
+	LeafNodeInt *newNode = (LeafNodeInt *)newPage;
+
+	// Update the right sibling page number
+	newNode->rightSibPageNo = leftNode->rightSibPageNo;
+	leftNode->rightSibPageNo = newPageId;
+
+	int size = leftNode->size; //Same as leaf occupancy
+	int mid = size / 2 + size % 2;
+
+	// During an insert run the new entry starts a node of its own, so that the full page stays full
+	int run = insertRunOf(pageNo);
+	if (this->splitPolicy == SPLIT_ADAPTIVE && run >= SPLIT_RUN_LENGTH && getIndexLeaf(pageNo, key) == size)
+	{
+		mid = size;
+		this->skewedSplit = 1;
+	}
+	else if (this->splitPolicy == SPLIT_ADAPTIVE && run <= -SPLIT_RUN_LENGTH && getIndexLeaf(pageNo, key) == 0)
+	{
+		mid = 0;
+		this->skewedSplit = -1;
+	}
+	// The largest key left in the original page separates it from the new page. If nothing is left, the new entry will be.
+	int separator = mid ? leftNode->keyArray[mid - 1] : pair.key;
+
+	// Move the entries from mid on (the floor of size / 2 for an even split) of the original page to new page
+	memcpy(&newNode->keyArray[0], &leftNode->keyArray[mid], sizeof(int) * (size - mid));
+	memcpy(&newNode->ridArray[0], &leftNode->ridArray[mid], sizeof(RecordId) * (size - mid));
+#if BTREE_SUBTREE_AGGREGATES
+	memcpy(&newNode->includeArray[0], &leftNode->includeArray[mid], sizeof(double) * (size - mid));
+#endif
+	leftNode->size = mid;
+	newNode->size = size - mid;
+	this->structureChanged = true;
+	forgetRightmostPath(pageNo);
+	this->splitLeafNum = pageNo;
+	this->splitNewLeafNum = newPageId;
+	// A separator already there belongs to a leaf further left, which is where a scan for it has to start
+	if (this->frontIndex)
+	{
+		this->frontIndex->insert(separator, newPageId, false);
+	}
+	BTREE_STAT_ADD(leafSplits, 1);
+	BTREE_STAT_ADD(skewedSplits, this->skewedSplit != 0);
+	BTREE_TRACE_DEBUG(TRACE_LEAF_SPLIT, pageNo, newPageId);
+
+	PageId parentPageId = getParent(pageNo, key);
+	// Edge case: Root is the leaf, and there is no parent(there is only one leaf node in the btree, and the pageNo = 2)
+	if (!parentPageId)
+	{
+		splitRoot();
+		parentPageId = this->rootPageNum;
+		Page *tmp;
+		this->readIndexPage(parentPageId, tmp);
+		NonLeafNodeInt *root = (NonLeafNodeInt *)tmp;
+		// Update root
+		root->size = 1;
+		root->level = 1;
+		root->keyArray[0] = separator;
+		root->pageNoArray[0] = pageNo;
+		root->pageNoArray[1] = newPageId;
+#if BTREE_SUBTREE_COUNTS
+		root->countArray[0] = leftNode->size;
+		root->countArray[1] = newNode->size;
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+		root->aggArray[0] = subtreeAggregate(pageNo, true);
+		root->aggArray[1] = subtreeAggregate(newPageId, true);
+#endif
+		this->unPinIndexPage(parentPageId, true);
+	}
+	else
+	{
+		insertInternal(&separator, parentPageId, newPageId);
+	}
+	this->skewedSplit = 0;
+	// determine on which page to insert the new key. Keys up to the separator belong to the original page.
+	if (pair.key > separator)
+	{
+		// Then add the new key into the right (new) leaf. An ascending run goes on in the new leaf.
+		if (mid == size)
+		{
+			this->runPages[newPageId % SPLIT_RUN_SLOTS] = newPageId;
+			this->runLengths[newPageId % SPLIT_RUN_SLOTS] = run;
+		}
+		insertLeaf(key, rid, newPageId);
+	}
+	else
+	{
+		insertLeaf(key, rid, pageNo);
+	}
+
+	//Unpin pages
+	try
+	{
+		this->unPinIndexPage(pageNo, true);
+		this->unPinIndexPage(newPageId, true);
+	}
+	catch (const badgerdb::PageNotPinnedException &e)
+	{
+		BTREE_TRACE_ERROR(TRACE_UNPIN_FAILED, pageNo, newPageId);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertInternal
+// -----------------------------------------------------------------------------
+const void BTreeIndex::insertInternal(const void *key, PageId parentPageNo, PageId childPageNo)
+{
+	Page *tmp;
+	this->readIndexPage(parentPageNo, tmp);
+	NonLeafNodeInt *parentNode = (NonLeafNodeInt *)tmp;
+	// Get the index to insert
+	int index = getIndexNonLeaf(parentPageNo, key);
+
+	/*--- Check if need to split---*/
+	if (parentNode->size == INTARRAYNONLEAFSIZE)
+	{
+		splitAndInsertInternal(parentPageNo, key, childPageNo);
+	}
+	// No need to split
+	else
+	{
+		for (int j = parentNode->size - 1; j >= index; j--)
+		{
+			parentNode->keyArray[j + 1] = parentNode->keyArray[j];
+			parentNode->pageNoArray[j + 2] = parentNode->pageNoArray[j + 1];
+#if BTREE_SUBTREE_COUNTS
+			parentNode->countArray[j + 2] = parentNode->countArray[j + 1];
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+			parentNode->aggArray[j + 2] = parentNode->aggArray[j + 1];
+#endif
+		}
+		//insert at index
+		parentNode->keyArray[index] = *(int *)key;
+		parentNode->pageNoArray[index + 1] = childPageNo;
+		parentNode->size++;
+		// The child at index has just been split into itself and childPageNo
+#if BTREE_SUBTREE_COUNTS
+		parentNode->countArray[index] = subtreeCount(parentNode->pageNoArray[index], parentNode->level == 1);
+		parentNode->countArray[index + 1] = subtreeCount(childPageNo, parentNode->level == 1);
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+		parentNode->aggArray[index] = subtreeAggregate(parentNode->pageNoArray[index], parentNode->level == 1);
+		parentNode->aggArray[index + 1] = subtreeAggregate(childPageNo, parentNode->level == 1);
+#endif
+	}
+	try
+	{
+		this->unPinIndexPage(parentPageNo, true);
+	}
+	catch (const badgerdb::PageNotPinnedException &e)
+	{
+		BTREE_TRACE_ERROR(TRACE_UNPIN_FAILED, parentPageNo, 0);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertAndSplitInternal
+// -----------------------------------------------------------------------------
+const void BTreeIndex::splitAndInsertInternal(PageId leftPageNo, const void *key, PageId pageInPair)
+{
+	Page *tmp;
+	this->readIndexPage(leftPageNo, tmp);
+	NonLeafNodeInt *leftNode = (NonLeafNodeInt *)tmp;
+	//------Construct a new page------//
+	Page *newPage;
+	PageId newPageNo;
+	this->allocIndexPage(newPageNo, newPage);
+	NonLeafNodeInt *newNode = (NonLeafNodeInt *)newPage;
+	// Update level
+	newNode->level = leftNode->level;
+	// Create a pair to insert
+	PageKeyPair<int> pair;
+	pair.set(pageInPair, *((int *)key));
+
+	int mid = (nodeOccupancy - 1) / 2;
+	// A split caused by a skewed leaf split puts the new child alone next to the end the run is growing at
+	if (this->skewedSplit > 0 && getIndexNonLeaf(leftPageNo, key) == nodeOccupancy)
+	{
+		mid = nodeOccupancy - 1;
+	}
+	else if (this->skewedSplit < 0 && *(int *)key < leftNode->keyArray[0])
+	{
+		mid = 0;
+	}
+
+	/* Algorithm: first split the node into two nodes, then insert the keyPagePair to either node (call insertInternal).
+	 * When splitting, push up the max key of the left node. Here call insertInternal again. In this way, all chained-splits
+	 * should be handled during the recursive call between insertInternal() and insertAndSplitInternal().
+	 * Note that if we reach the root and need to split the root, call the helper method splitRoot() and manually set the 
+	 * new root to be the parent node.
+	*/
+
+	memcpy(&newNode->keyArray[0], &leftNode->keyArray[mid + 1], sizeof(int) * (nodeOccupancy - mid - 1));
+	memcpy(&newNode->pageNoArray[0], &leftNode->pageNoArray[mid + 1], sizeof(PageId) * (nodeOccupancy - mid));
+#if BTREE_SUBTREE_COUNTS
+	memcpy(&newNode->countArray[0], &leftNode->countArray[mid + 1], sizeof(int) * (nodeOccupancy - mid));
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+	memcpy(&newNode->aggArray[0], &leftNode->aggArray[mid + 1], sizeof(KeyAggregate) * (nodeOccupancy - mid));
+#endif
+	leftNode->size = mid;
+	newNode->size = nodeOccupancy - mid - 1;
+	this->structureChanged = true;
+	forgetRightmostPath(leftPageNo);
+	BTREE_STAT_ADD(internalSplits, 1);
+	BTREE_STAT_ADD(skewedSplits, mid != (nodeOccupancy - 1) / 2);
+	BTREE_TRACE_DEBUG(TRACE_INTERNAL_SPLIT, leftPageNo, newPageNo);
+
+	PageId parentPageId = getParent(leftPageNo, key);
+	// Edge case: Check if the leftNode is the root node. If so, split the root
+	if (!parentPageId)
+	{
+		splitRoot();
+		parentPageId = this->rootPageNum;
+		Page *tmp;
+		this->readIndexPage(parentPageId, tmp);
+		NonLeafNodeInt *root = (NonLeafNodeInt *)tmp;
+		// Update root
+		root->size = 1;
+		root->level = 0;
+		root->keyArray[0] = leftNode->keyArray[mid];
+		root->pageNoArray[0] = leftPageNo;
+		root->pageNoArray[1] = newPageNo;
+#if BTREE_SUBTREE_COUNTS
+		root->countArray[0] = subtreeCount(leftPageNo, false);
+		root->countArray[1] = subtreeCount(newPageNo, false);
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+		root->aggArray[0] = subtreeAggregate(leftPageNo, false);
+		root->aggArray[1] = subtreeAggregate(newPageNo, false);
+#endif
+		this->unPinIndexPage(parentPageId, true);
+	}
+	else
+	{
+		insertInternal(&leftNode->keyArray[mid], parentPageId, newPageNo);
+	}
+
+	if (pair.key >= leftNode->keyArray[mid])
+	{
+		insertInternal(key, newPageNo, pair.pageNo);
+	}
+	else
+	{
+		insertInternal(key, leftPageNo, pair.pageNo);
+	}
+	try
+	{
+		this->unPinIndexPage(leftPageNo, true);
+		this->unPinIndexPage(newPageNo, true);
+	}
+	catch (const badgerdb::PageNotPinnedException &e)
+	{
+		BTREE_TRACE_ERROR(TRACE_UNPIN_FAILED, leftPageNo, newPageNo);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::splitRoot
+// -----------------------------------------------------------------------------
+const void BTreeIndex::splitRoot()
+{
+	// First check if the root is a leaf. This is relevant to level assignment.
+	bool rootIsLeaf = 0;
+	if (this->rootPageNum == 2)
+	{
+		rootIsLeaf = 1;
+	}
+	Page *newRoot;
+	PageId newRootId;
+	this->allocIndexPage(newRootId, newRoot);
+	NonLeafNodeInt *newRootNode = (NonLeafNodeInt *)newRoot;
+	BTREE_TRACE_INFO(TRACE_ROOT_CHANGE, newRootId, this->rootPageNum);
+	this->rootPageNum = newRootId;
+	BTREE_STAT_ADD(rootChanges, 1);
+	// If before split the root is a leaf, then now the root is 1 level above the leaf so assign 1. Otherwise assign 0.
+	newRootNode->level = rootIsLeaf ? 1 : 0;
+	newRootNode->size = 0;
+	this->unPinIndexPage(newRootId, true);
+
+	Page *tmp;
+	this->readIndexPage(headerPageNum, tmp);
+	IndexMetaInfo *metaPage = (IndexMetaInfo *)tmp;
+	metaPage->rootPageNo = newRootId;
+	this->unPinIndexPage(headerPageNum, true);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::getParent
+// -----------------------------------------------------------------------------
+PageId BTreeIndex::getParent(PageId childPageNo, const void *key)
+{
+	// This means there's no parent for the given node
+	if (childPageNo == rootPageNum)
+	{
+		return 0;
+	}
+	PageId parentNo = rootPageNum; // Parent starts from the root
+	while (1)
+	{
+		Page *tmp;
+		this->readIndexPage(parentNo, tmp);
+		NonLeafNodeInt *parentCurNode = (NonLeafNodeInt *)tmp;
+		PageId childCurNo = parentCurNode->pageNoArray[getIndexNonLeaf(parentNo, key)];
+		this->unPinIndexPage(parentNo, false);
+
+		if (childCurNo == childPageNo)
+		{
+			return parentNo;
+		}
+		parentNo = childCurNo;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::getIndexNonLeaf
+// -----------------------------------------------------------------------------
+int BTreeIndex::getIndexNonLeaf(PageId pageNo, const void *key)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+	// Find out the index, the last one if no key reaches the given one. The node stays pinned until it is found.
+	int index = 0;
+	while (index < curNode->size && curNode->keyArray[index] < *((int *)key))
+	{
+		index++;
+	}
+	BTREE_STAT_ADD(nonLeafComparisons, index < curNode->size ? index + 1 : index);
+	try
+	{
+		this->unPinIndexPage(pageNo, false);
+	}
+	catch (const badgerdb::PageNotPinnedException &e)
+	{
+		BTREE_TRACE_ERROR(TRACE_UNPIN_FAILED, pageNo, 0);
+	}
+	return index;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::getIndexLeaf
+// -----------------------------------------------------------------------------
+int BTreeIndex::getIndexLeaf(PageId pageNo, const void *key)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	LeafNodeInt *curNode = (LeafNodeInt *)tmp;
+	// Find out the index, the last one if no key reaches the given one. The node stays pinned until it is found.
+	int index = 0;
+	while (index < curNode->size && curNode->keyArray[index] < *((int *)key))
+	{
+		index++;
+	}
+	BTREE_STAT_ADD(leafComparisons, index < curNode->size ? index + 1 : index);
+	try
+	{
+		this->unPinIndexPage(pageNo, false);
+	}
+	catch (const badgerdb::PageNotPinnedException &e)
+	{
+		BTREE_TRACE_ERROR(TRACE_UNPIN_FAILED, pageNo, 0);
+	}
+	return index;
+}
+
+#if BTREE_SUBTREE_COUNTS
+// -----------------------------------------------------------------------------
+// BTreeIndex::subtreeCount
+// -----------------------------------------------------------------------------
+int BTreeIndex::subtreeCount(PageId pageNo, bool isLeaf)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	int count = 0;
+	if (isLeaf)
+	{
+		count = ((LeafNodeInt *)tmp)->size;
+	}
+	else
+	{
+		NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+		for (int i = 0; i <= curNode->size; i++)
+		{
+			count += curNode->countArray[i];
+		}
+	}
+	this->unPinIndexPage(pageNo, false);
+	return count;
+}
+#endif
+
+#if BTREE_SUBTREE_AGGREGATES
+// -----------------------------------------------------------------------------
+// BTreeIndex::subtreeAggregate
+// -----------------------------------------------------------------------------
+KeyAggregate BTreeIndex::subtreeAggregate(PageId pageNo, bool isLeaf)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	KeyAggregate agg;
+	agg.clear();
+	if (isLeaf)
+	{
+		LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
+		for (int i = 0; i < leafNode->size; i++)
+		{
+			agg.add(leafNode->keyArray[i], leafNode->includeArray[i]);
+		}
+	}
+	else
+	{
+		NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+		for (int i = 0; i <= curNode->size; i++)
+		{
+			agg.combine(curNode->aggArray[i]);
+		}
+	}
+	this->unPinIndexPage(pageNo, false);
+	return agg;
+}
+#endif
+
+#if BTREE_SUBTREE_COUNTS || BTREE_SUBTREE_AGGREGATES
+// -----------------------------------------------------------------------------
+// BTreeIndex::updateSubtreeSummaries
+// -----------------------------------------------------------------------------
+void BTreeIndex::updateSubtreeSummaries(PageId pageNo, const void *key, bool recount)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+	int index = getIndexNonLeaf(pageNo, key);
+	PageId childPageNo = curNode->pageNoArray[index];
+	bool childIsLeaf = (curNode->level == 1);
+
+	if (!childIsLeaf)
+	{
+		updateSubtreeSummaries(childPageNo, key, recount);
+	}
+	if (!recount)
+	{
+#if BTREE_SUBTREE_COUNTS
+		curNode->countArray[index]++;
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+		curNode->aggArray[index].add(*(int *)key, this->insertIncludeVal);
+#endif
+	}
+	else
+	{
+		// A split on the path may have moved entries between this child and its new sibling, so recount from below
+#if BTREE_SUBTREE_COUNTS
+		curNode->countArray[index] = subtreeCount(childPageNo, childIsLeaf);
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+		curNode->aggArray[index] = subtreeAggregate(childPageNo, childIsLeaf);
+#endif
+	}
+	this->unPinIndexPage(pageNo, true);
+}
+#endif
+
+#if BTREE_SUBTREE_COUNTS
+// -----------------------------------------------------------------------------
+// BTreeIndex::rankOf
+// -----------------------------------------------------------------------------
+int BTreeIndex::rankOf(int key, bool inclusive)
+{
+	int rank = 0;
+	PageId pageNo = this->rootPageNum;
+	bool isLeaf = (this->rootPageNum == 2);
+	while (!isLeaf)
+	{
+		Page *tmp;
+		this->readIndexPage(pageNo, tmp);
+		NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+		int index = inclusive ? upperChildIndex(curNode, key) : getIndexNonLeaf(pageNo, &key);
+		// Every entry in the children left of index is smaller than key, or equal to it if inclusive
+		for (int i = 0; i < index; i++)
+		{
+			rank += curNode->countArray[i];
+		}
+		isLeaf = (curNode->level == 1);
+		PageId childPageNo = curNode->pageNoArray[index];
+		this->unPinIndexPage(pageNo, false);
+		pageNo = childPageNo;
+	}
+
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
+	for (int i = 0; i < leafNode->size; i++)
+	{
+		if (leafNode->keyArray[i] > key || (!inclusive && leafNode->keyArray[i] == key))
+		{
+			break;
+		}
+		rank++;
+	}
+	this->unPinIndexPage(pageNo, false);
+	return rank;
+}
+#else
+// -----------------------------------------------------------------------------
+// BTreeIndex::countLeafRange
+// -----------------------------------------------------------------------------
+int BTreeIndex::countLeafRange(int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	// The first leaf that can hold the low bound, or a copy of it left of a separator equal to it
+	PageId pageNo = this->rootPageNum == 2 ? this->rootPageNum : FindPlaceHelper(&lowVal, this->rootPageNum);
+	int count = 0;
+	while (pageNo)
+	{
+		Page *tmp;
+		this->readIndexPage(pageNo, tmp);
+		LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
+		for (int i = 0; i < leafNode->size; i++)
+		{
+			int key = leafNode->keyArray[i];
+			if (lowOp == GT ? key <= lowVal : key < lowVal)
+			{
+				continue;
+			}
+			if (highOp == LT ? key >= highVal : key > highVal)
+			{
+				this->unPinIndexPage(pageNo, false);
+				return count;
+			}
+			count++;
+		}
+		PageId nextPageNo = leafNode->rightSibPageNo;
+		this->unPinIndexPage(pageNo, false);
+		pageNo = nextPageNo;
+	}
+	return count;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::countRange
+// -----------------------------------------------------------------------------
+const int BTreeIndex::countRange(const void *lowValParm,
+								 const Operator lowOpParm,
+								 const void *highValParm,
+								 const Operator highOpParm)
+{
+	if ((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE))
+	{
+		throw BadOpcodesException();
+	}
+	if (*(int *)lowValParm > *(int *)highValParm)
+	{
+		throw BadScanrangeException();
+	}
+
+#if BTREE_SUBTREE_COUNTS
+	// Entries up to the high bound minus entries below the low bound
+	int count = rankOf(*(int *)highValParm, highOpParm == LTE) - rankOf(*(int *)lowValParm, lowOpParm == GT);
+	return count > 0 ? count : 0;
+#else
+	return countLeafRange(*(int *)lowValParm, lowOpParm, *(int *)highValParm, highOpParm);
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::keyAtRank
+// -----------------------------------------------------------------------------
+const void BTreeIndex::keyAtRank(const int rank, void *outKey, RecordId &outRid)
+{
+	if (rank < 0)
+	{
+		throw NoSuchKeyFoundException();
+	}
+	int remaining = rank;
+	PageId pageNo = this->rootPageNum;
+	bool isLeaf = (this->rootPageNum == 2);
+	while (!isLeaf)
+	{
+		Page *tmp;
+		this->readIndexPage(pageNo, tmp);
+		NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+		int index = 0;
+#if BTREE_SUBTREE_COUNTS
+		// Skip whole children until the one that holds the entry
+		for (; index < curNode->size; index++)
+		{
+			if (remaining < curNode->countArray[index])
+			{
+				break;
+			}
+			remaining -= curNode->countArray[index];
+		}
+#endif
+		isLeaf = (curNode->level == 1);
+		PageId childPageNo = curNode->pageNoArray[index];
+		this->unPinIndexPage(pageNo, false);
+		pageNo = childPageNo;
+	}
+
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
+#if !BTREE_SUBTREE_COUNTS
+	// Without subtree counts the path above led to the leftmost leaf, and whole leaves are skipped from there
+	while (remaining >= leafNode->size && leafNode->rightSibPageNo)
+	{
+		remaining -= leafNode->size;
+		PageId nextPageNo = leafNode->rightSibPageNo;
+		this->unPinIndexPage(pageNo, false);
+		pageNo = nextPageNo;
+		this->readIndexPage(pageNo, tmp);
+		leafNode = (LeafNodeInt *)tmp;
+	}
+#endif
+	if (remaining >= leafNode->size)
+	{
+		this->unPinIndexPage(pageNo, false);
+		throw NoSuchKeyFoundException();
+	}
+	*(int *)outKey = leafNode->keyArray[remaining];
+	outRid = leafNode->ridArray[remaining];
+	this->unPinIndexPage(pageNo, false);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::includeValue
+// -----------------------------------------------------------------------------
+double BTreeIndex::includeValue(const char *record)
+{
+	if (this->includeByteOffset < 0)
+	{
+		return 0;
+	}
+	if (this->includeType == INTEGER)
+	{
+		return recordInt(record, this->includeByteOffset);
+	}
+	return recordDouble(record, this->includeByteOffset);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::aggregateSubtree
+// -----------------------------------------------------------------------------
+void BTreeIndex::aggregateSubtree(PageId pageNo, bool isLeaf, bool checkLow, bool checkHigh,
+								  int lowVal, Operator lowOp, int highVal, Operator highOp, KeyAggregate &agg)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	if (isLeaf)
+	{
+		LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
+		for (int i = 0; i < leafNode->size; i++)
+		{
+			int key = leafNode->keyArray[i];
+			if (checkLow && (lowOp == GT ? key <= lowVal : key < lowVal))
+			{
+				continue;
+			}
+			if (checkHigh && (highOp == LT ? key >= highVal : key > highVal))
+			{
+				break;
+			}
+#if BTREE_SUBTREE_AGGREGATES
+			agg.add(key, leafNode->includeArray[i]);
+#else
+			agg.add(key, 0);
+#endif
+		}
+		this->unPinIndexPage(pageNo, false);
+		return;
+	}
+
+	// Only the children holding a bound can be partly in the range, every child between them is fully covered.
+	// Copies of a key equal to a separator can be on both sides of it, so inclusive bounds go past it.
+	NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+	int first = 0;
+	if (checkLow)
+	{
+		first = lowOp == GT ? upperChildIndex(curNode, lowVal) : getIndexNonLeaf(pageNo, &lowVal);
+	}
+	int last = curNode->size;
+	if (checkHigh)
+	{
+		last = highOp == LTE ? upperChildIndex(curNode, highVal) : getIndexNonLeaf(pageNo, &highVal);
+	}
+	for (int i = first; i <= last; i++)
+	{
+		bool lowBoundary = checkLow && i == first;
+		bool highBoundary = checkHigh && i == last;
+#if BTREE_SUBTREE_AGGREGATES
+		if (!lowBoundary && !highBoundary)
+		{
+			agg.combine(curNode->aggArray[i]);
+			continue;
+		}
+#endif
+		aggregateSubtree(curNode->pageNoArray[i], curNode->level == 1, lowBoundary, highBoundary,
+						 lowVal, lowOp, highVal, highOp, agg);
+	}
+	this->unPinIndexPage(pageNo, false);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::aggregateRange
+// -----------------------------------------------------------------------------
+const void BTreeIndex::aggregateRange(const void *lowValParm,
+									  const Operator lowOpParm,
+									  const void *highValParm,
+									  const Operator highOpParm,
+									  KeyAggregate &outAgg)
+{
+	if ((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE))
+	{
+		throw BadOpcodesException();
+	}
+	if (*(int *)lowValParm > *(int *)highValParm)
+	{
+		throw BadScanrangeException();
+	}
+
+	outAgg.clear();
+	aggregateSubtree(this->rootPageNum, this->rootPageNum == 2, true, true,
+					 *(int *)lowValParm, lowOpParm, *(int *)highValParm, highOpParm, outAgg);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::analyze
+// -----------------------------------------------------------------------------
+IndexStructure BTreeIndex::analyze()
+{
+	IndexStructure structure;
+	structure.height = 0;
+	structure.sequentialLinks = 0;
+	structure.forwardLinks = 0;
+	structure.backwardLinks = 0;
+	structure.linkDistance = 0;
+
+	// Walk the tree level by level, collecting the pages of the next level from the non-leaf nodes of this one
+	std::vector<PageId> levelPages(1, this->rootPageNum);
+	bool isLeafLevel = this->rootPageNum == 2;
+	while (true)
+	{
+		LevelStructure level;
+		memset(&level, 0, sizeof(LevelStructure));
+		int slots = isLeafLevel ? this->leafOccupancy : this->nodeOccupancy;
+		std::vector<PageId> childPages;
+		bool childrenAreLeaves = false;
+		for (size_t i = 0; i < levelPages.size(); i++)
+		{
+			Page *tmp;
+			this->readIndexPage(levelPages[i], tmp);
+			int size;
+			if (isLeafLevel)
+			{
+				size = ((LeafNodeInt *)tmp)->size;
+			}
+			else
+			{
+				NonLeafNodeInt *node = (NonLeafNodeInt *)tmp;
+				size = node->size;
+				childrenAreLeaves = node->level == 1;
+				childPages.insert(childPages.end(), &node->pageNoArray[0], &node->pageNoArray[node->size + 1]);
+			}
+			this->unPinIndexPage(levelPages[i], false);
+
+			int bucket = size * FILL_HISTOGRAM_BUCKETS / slots;
+			level.fillHistogram[bucket < FILL_HISTOGRAM_BUCKETS ? bucket : FILL_HISTOGRAM_BUCKETS - 1]++;
+			level.nodes++;
+			level.keys += size;
+			level.capacity += slots;
+		}
+		structure.levels.push_back(level);
+		structure.height++;
+		if (isLeafLevel)
+		{
+			break;
+		}
+		levelPages.swap(childPages);
+		isLeafLevel = childrenAreLeaves;
+	}
+
+	// The leaves were collected in key order, so consecutive ones are linked by their right sibling pointers
+	for (size_t i = 0; i + 1 < levelPages.size(); i++)
+	{
+		long long distance = (long long)levelPages[i + 1] - (long long)levelPages[i];
+		if (distance == 1)
+		{
+			structure.sequentialLinks++;
+		}
+		else if (distance > 1)
+		{
+			structure.forwardLinks++;
+		}
+		else
+		{
+			structure.backwardLinks++;
+		}
+		structure.linkDistance += distance < 0 ? -distance : distance;
+	}
+	return structure;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::compact
+// -----------------------------------------------------------------------------
+const int BTreeIndex::compact(double maxFill)
+{
+	checkWritable();
+	if (this->scanExecuting)
+	{
+		this->endScan();
+	}
+	this->appendLeafNum = 0;
+	// A root that is a leaf has no neighbours
+	if (this->rootPageNum == 2)
+	{
+		return 0;
+	}
+	if (maxFill > 1)
+	{
+		maxFill = 1;
+	}
+	int maxLeafKeys = (int)(maxFill * this->leafOccupancy);
+	int maxNonLeafKeys = (int)(maxFill * this->nodeOccupancy);
+	int freed = compactChildren(this->rootPageNum, maxLeafKeys > 0 ? maxLeafKeys : 1, maxNonLeafKeys > 0 ? maxNonLeafKeys : 1);
+
+	// Drop roots that were left with a single child, as long as that child is not a leaf
+	while (true)
+	{
+		Page *tmp;
+		this->readIndexPage(this->rootPageNum, tmp);
+		NonLeafNodeInt *root = (NonLeafNodeInt *)tmp;
+		if (root->size || root->level == 1)
+		{
+			this->unPinIndexPage(this->rootPageNum, false);
+			break;
+		}
+		PageId oldRootNo = this->rootPageNum;
+		PageId newRootNo = root->pageNoArray[0];
+		this->unPinIndexPage(oldRootNo, false);
+		BTREE_TRACE_INFO(TRACE_ROOT_CHANGE, newRootNo, oldRootNo);
+		this->rootPageNum = newRootNo;
+		BTREE_STAT_ADD(rootChanges, 1);
+
+		this->readIndexPage(headerPageNum, tmp);
+		IndexMetaInfo *metaPage = (IndexMetaInfo *)tmp;
+		metaPage->rootPageNo = newRootNo;
+		this->unPinIndexPage(headerPageNum, true);
+		freeIndexPage(oldRootNo);
+		freed++;
+	}
+	// Merges removed leaves, so the models are fitted again
+	if (this->learnedMaxError)
+	{
+		buildLearnedRouting();
+	}
+	if (this->frontIndex)
+	{
+		setFrontIndex(true);
+	}
+	return freed;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::compactChildren
+// -----------------------------------------------------------------------------
+int BTreeIndex::compactChildren(PageId pageNo, int maxLeafKeys, int maxNonLeafKeys)
+{
+	Page *tmp;
+	this->readIndexPage(pageNo, tmp);
+	NonLeafNodeInt *node = (NonLeafNodeInt *)tmp;
+	bool childrenAreLeaves = node->level == 1;
+	int freed = 0;
+
+	// Children are merged bottom up, so that a non-leaf child only holds the pages left after its own children merged
+	if (!childrenAreLeaves)
+	{
+		for (int i = 0; i <= node->size; i++)
+		{
+			freed += compactChildren(node->pageNoArray[i], maxLeafKeys, maxNonLeafKeys);
+		}
+	}
+
+	// Pack the entries of every pair of neighbours into the left one up to the limit. A right neighbour that is
+	// emptied this way is removed, otherwise the key separating the two is moved to the new boundary.
+	bool changed = false;
+	int i = 0;
+	while (i < node->size)
+	{
+		PageId leftNo = node->pageNoArray[i];
+		PageId rightNo = node->pageNoArray[i + 1];
+		Page *leftPage;
+		Page *rightPage;
+		this->readIndexPage(leftNo, leftPage);
+		this->readIndexPage(rightNo, rightPage);
+		int moved = 0;
+		bool emptied = false;
+		if (childrenAreLeaves)
+		{
+			LeafNodeInt *left = (LeafNodeInt *)leftPage;
+			LeafNodeInt *right = (LeafNodeInt *)rightPage;
+			moved = std::min(maxLeafKeys - left->size, right->size);
+			if (moved > 0)
+			{
+				memcpy(&left->keyArray[left->size], &right->keyArray[0], sizeof(int) * moved);
+				memcpy(&left->ridArray[left->size], &right->ridArray[0], sizeof(RecordId) * moved);
+				memmove(&right->keyArray[0], &right->keyArray[moved], sizeof(int) * (right->size - moved));
+				memmove(&right->ridArray[0], &right->ridArray[moved], sizeof(RecordId) * (right->size - moved));
+#if BTREE_SUBTREE_AGGREGATES
+				memcpy(&left->includeArray[left->size], &right->includeArray[0], sizeof(double) * moved);
+				memmove(&right->includeArray[0], &right->includeArray[moved], sizeof(double) * (right->size - moved));
+#endif
+				left->size += moved;
+				right->size -= moved;
+				emptied = right->size == 0;
+				if (emptied)
+				{
+					left->rightSibPageNo = right->rightSibPageNo;
+				}
+				else
+				{
+					node->keyArray[i] = left->keyArray[left->size - 1];
+				}
+			}
+		}
+		else
+		{
+			NonLeafNodeInt *left = (NonLeafNodeInt *)leftPage;
+			NonLeafNodeInt *right = (NonLeafNodeInt *)rightPage;
+			// Every child moved takes one key slot: the separator of this node comes down in front of the first one,
+			// and the key after the last one moved goes up to become the new separator
+			moved = std::min(maxNonLeafKeys - left->size, right->size + 1);
+			if (moved > 0)
+			{
+				emptied = moved == right->size + 1;
+				left->keyArray[left->size] = node->keyArray[i];
+				memcpy(&left->keyArray[left->size + 1], &right->keyArray[0], sizeof(int) * (moved - 1));
+				memcpy(&left->pageNoArray[left->size + 1], &right->pageNoArray[0], sizeof(PageId) * moved);
+#if BTREE_SUBTREE_COUNTS
+				memcpy(&left->countArray[left->size + 1], &right->countArray[0], sizeof(int) * moved);
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+				memcpy(&left->aggArray[left->size + 1], &right->aggArray[0], sizeof(KeyAggregate) * moved);
+#endif
+				left->size += moved;
+				if (!emptied)
+				{
+					node->keyArray[i] = right->keyArray[moved - 1];
+					memmove(&right->keyArray[0], &right->keyArray[moved], sizeof(int) * (right->size - moved));
+					memmove(&right->pageNoArray[0], &right->pageNoArray[moved], sizeof(PageId) * (right->size + 1 - moved));
+#if BTREE_SUBTREE_COUNTS
+					memmove(&right->countArray[0], &right->countArray[moved], sizeof(int) * (right->size + 1 - moved));
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+					memmove(&right->aggArray[0], &right->aggArray[moved], sizeof(KeyAggregate) * (right->size + 1 - moved));
+#endif
+					right->size -= moved;
+				}
+			}
+		}
+		this->unPinIndexPage(leftNo, moved > 0);
+		this->unPinIndexPage(rightNo, moved > 0 && !emptied);
+		if (moved <= 0)
+		{
+			i++;
+			continue;
+		}
+		changed = true;
+		if (emptied)
+		{
+			removeMergedChild(node, i);
+			freeIndexPage(rightNo);
+			freed++;
+			BTREE_STAT_ADD(nodeMerges, 1);
+			BTREE_TRACE_DEBUG(TRACE_NODE_MERGE, leftNo, rightNo);
+			continue;
+		}
+		// Part of the right neighbour moved, so both summaries are recomputed from the children
+#if BTREE_SUBTREE_COUNTS
+		node->countArray[i] = subtreeCount(leftNo, childrenAreLeaves);
+		node->countArray[i + 1] = subtreeCount(rightNo, childrenAreLeaves);
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+		node->aggArray[i] = subtreeAggregate(leftNo, childrenAreLeaves);
+		node->aggArray[i + 1] = subtreeAggregate(rightNo, childrenAreLeaves);
+#endif
+		i++;
+	}
+	this->unPinIndexPage(pageNo, changed);
+	return freed;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::removeMergedChild
+// -----------------------------------------------------------------------------
+void BTreeIndex::removeMergedChild(NonLeafNodeInt *node, int index)
+{
+#if BTREE_SUBTREE_COUNTS
+	node->countArray[index] += node->countArray[index + 1];
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+	node->aggArray[index].combine(node->aggArray[index + 1]);
+#endif
+	// The merged child now reaches up to the key that bounded the removed one
+	for (int j = index; j < node->size - 1; j++)
+	{
+		node->keyArray[j] = node->keyArray[j + 1];
+		node->pageNoArray[j + 1] = node->pageNoArray[j + 2];
+#if BTREE_SUBTREE_COUNTS
+		node->countArray[j + 1] = node->countArray[j + 2];
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+		node->aggArray[j + 1] = node->aggArray[j + 2];
+#endif
+	}
+	node->size--;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::exportSnapshot
+// -----------------------------------------------------------------------------
+const int BTreeIndex::exportSnapshot(const std::string &snapshotName, const bool compress)
+{
+	Page *tmp;
+	this->readIndexPage(headerPageNum, tmp);
+	std::string relationName(((IndexMetaInfo *)tmp)->relationName);
+	this->unPinIndexPage(headerPageNum, false);
+
+	// Go down the leftmost path to the first leaf
+	PageId pageNo = this->rootPageNum;
+	bool isLeaf = (this->rootPageNum == 2);
+	while (!isLeaf)
+	{
+		this->readIndexPage(pageNo, tmp);
+		NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
+		PageId childPageNo = curNode->pageNoArray[0];
+		isLeaf = (curNode->level == 1);
+		this->unPinIndexPage(pageNo, false);
+		pageNo = childPageNo;
+	}
+
+	// The leaf chain gives the entries in key order, the writer packs them into full leaves
+	SnapshotWriter writer(snapshotName, this->bufMgr, relationName, this->attrByteOffset, this->attributeType, compress);
+	int numEntries = 0;
+	while (pageNo != 0)
+	{
+		this->readIndexPage(pageNo, tmp);
+		LeafNodeInt *leafNode = (LeafNodeInt *)tmp;
+		for (int i = 0; i < leafNode->size; i++)
+		{
+			writer.append(leafNode->keyArray[i], leafNode->ridArray[i]);
+		}
+		numEntries += leafNode->size;
+		PageId nextPageNo = leafNode->rightSibPageNo;
+		this->unPinIndexPage(pageNo, false);
+		pageNo = nextPageNo;
+	}
+	writer.finish();
+	return numEntries;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::startScan
+// -----------------------------------------------------------------------------
+const void BTreeIndex::startScan(const void *lowValParm,
+								 const Operator lowOpParm,
+								 const void *highValParm,
+								 const Operator highOpParm,
+								 const KeyPredicate *filter)
+{
+	OperationTimer timer(this, OP_START_SCAN);
+
+	// TODO: If another scan is already executing, that needs to be ended here.
+	if (scanExecuting)
+	// if (scanExecuting || currentPageData != NULL)
+	{
+		currentPageData = NULL;
+	}
+	if ((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE))
+	{
+		throw BadOpcodesException();
+	}
+
+	if (*(int *)lowValParm > *(int *)highValParm)
+	{
+		throw BadScanrangeException();
+	}
+
+	// set vars for scan
+	lowValInt = *(int *)lowValParm;
+	highValInt = *(int *)highValParm;
+	lowOp = lowOpParm;
+	highOp = highOpParm;
+	nextEntry = 0;
+	scanExecuting = true;
+	readAheadMore = false;
+	leavesReadAhead = 0;
+	scanFiltered = filter != NULL;
+	scanFilter = filter ? *filter : KeyPredicate();
+	scanSelection.clear();
+	scanSelectionNext = 0;
+	scanLastLeaf = false;
+	BTREE_STAT_ADD(scans, 1);
+#if BTREE_STATS
+	this->statCounters.lastScanLeavesVisited = 0;
+#endif
+	BTREE_TRACE_DEBUG(TRACE_START_SCAN, lowValInt, highValInt);
+	// A learned prediction goes straight to the leaf, and to the slot inside it, without reading the non-leaf nodes
+	int leafNum = (this->learnedMaxError && this->rootPageNum != 2) ? predictLeaf(lowValInt, lowOp == GTE) : -1;
+	// The front index gives the leaf a descent would reach: the one right of the last separator below the low bound,
+	// or up to it for GT
+	PageId frontLeafNum = 0;
+	if (leafNum < 0 && this->frontIndex && this->rootPageNum != 2)
+	{
+		if (!this->frontIndex->floor(lowValInt, lowOp == GT, frontLeafNum))
+		{
+			frontLeafNum = this->frontFirstLeaf;
+		}
+		BTREE_STAT_ADD(frontIndexLookups, 1);
+	}
+	// read the root, it stays pinned until the descent moves past it
+	Page *root = NULL;
+	if (leafNum < 0 && !frontLeafNum)
+	{
+		this->readIndexPage(rootPageNum, root);
+	}
+	// if root is a leaf, directly check whether the root's keys are in the range
+
+	if (this->rootPageNum == 2)
+	{
+		LeafNodeInt *rootNode = (LeafNodeInt *)root;
+
+		bool outOfRange = ((highOpParm == LT) && (rootNode->keyArray[0] >= *(int *)highValParm)) ||
+						  ((highOpParm == LTE) && (rootNode->keyArray[0] > *(int *)highValParm)) ||
+						  ((lowOpParm == GT) && (rootNode->keyArray[rootNode->size - 1] < *(int *)lowValParm)) ||
+						  ((lowOpParm == GTE) && (rootNode->keyArray[rootNode->size - 1] <= *(int *)lowValParm));
+		this->unPinIndexPage(rootPageNum, false);
+		if (outOfRange)
+		{
+			throw NoSuchKeyFoundException();
+		}
+		// this->bufMgr->readPage(this->file, rootPageNum, root);
+	}
+	else // traver from root if it is a noneleaf
+	{
+		bool reachLeaf = false;
+		NonLeafNodeInt *rootNode = (NonLeafNodeInt *)root;
+		Page *currPage = root;
+		PageId currPageNum = rootPageNum;
+		NonLeafNodeInt *currNode = rootNode;
+
+		if (leafNum >= 0)
+		{
+			int numLeaves = this->learnedLeafPages.size();
+			currentPageNum = this->learnedLeafPages[leafNum < numLeaves ? leafNum : numLeaves - 1];
+			this->readIndexPage(currentPageNum, this->currentPageData);
+			LeafNodeInt *leafNode = (LeafNodeInt *)this->currentPageData;
+			int slot = leafNode->size;
+			if (leafNum < numLeaves && leafNode->size > 0)
+			{
+				int first = leafNode->keyArray[0];
+				int last = leafNode->keyArray[leafNode->size - 1];
+				slot = 0;
+				if (lowValInt > first && last > first)
+				{
+					// The differences are taken in double, in int they overflow for keys far apart
+					slot = (int)(((double)lowValInt - first) / ((double)last - first) * (leafNode->size - 1));
+					slot = std::min(slot, leafNode->size - 1);
+				}
+				// Walk from the predicted slot to the first entry in range
+				while (slot > 0 && (lowOp == GT ? leafNode->keyArray[slot - 1] > lowValInt : leafNode->keyArray[slot - 1] >= lowValInt))
+				{
+					slot--;
+				}
+				while (slot < leafNode->size && (lowOp == GT ? leafNode->keyArray[slot] <= lowValInt : leafNode->keyArray[slot] < lowValInt))
+				{
+					slot++;
+				}
+			}
+			nextEntry = slot;
+			this->unPinIndexPage(currentPageNum, false);
+			reachLeaf = true;
+		}
+		else if (frontLeafNum)
+		{
+			currentPageNum = frontLeafNum;
+			this->readIndexPage(currentPageNum, this->currentPageData);
+			this->unPinIndexPage(currentPageNum, false);
+			reachLeaf = true;
+		}
+
+		// find the leaf node of contains lower bound
+		while (!reachLeaf)
+		{
+			// The last child holds everything above the last key, so it is taken if no key reaches the low bound
+			for (int i = 0; i <= currNode->size; i++)
+			{
+				// ">" lowVal
+				if (lowOpParm == GT && (i == currNode->size || currNode->keyArray[i] > *(int *)lowValParm))
+				{
+					if (currNode->level == 1) // next level is leaf node
+					{
+						// assign the correct leaf page to be the first leaf page contain the lower bound
+						this->readIndexPage(currNode->pageNoArray[i], this->currentPageData);
+						currentPageNum = currNode->pageNoArray[i];
+						this->unPinIndexPage(currNode->pageNoArray[i], false);
+						this->unPinIndexPage(currPageNum, false);
+						reachLeaf = true;
+						break;
+					}
+					// traverse to child if i th key is greater than the low bound, the parent is unpinned once the
+					// child is pinned
+					PageId childPageNum = currNode->pageNoArray[i];
+					this->readIndexPage(childPageNum, currPage);
+					this->unPinIndexPage(currPageNum, false);
+					currPageNum = childPageNum;
+					currNode = (NonLeafNodeInt *)currPage;
+					break;
+				} // ">=" lowVal
+				else if (lowOpParm == GTE && (i == currNode->size || currNode->keyArray[i] >= *(int *)lowValParm))
+				{
+					if (currNode->level == 1)
+					{
+						this->readIndexPage(currNode->pageNoArray[i], this->currentPageData);
+						currentPageNum = currNode->pageNoArray[i];
+						this->unPinIndexPage(currNode->pageNoArray[i], false);
+						this->unPinIndexPage(currPageNum, false);
+						reachLeaf = true;
+						break;
+					}
+					// traverse to child if i th key is greater or equal than the low bound
+					PageId childPageNum = currNode->pageNoArray[i];
+					this->readIndexPage(childPageNum, currPage);
+					this->unPinIndexPage(currPageNum, false);
+					currPageNum = childPageNum;
+					currNode = (NonLeafNodeInt *)currPage;
+					break;
+				}
+			}
+		}
+		if (this->currentPageData == NULL)
+		{
+			// scanExecuting = false;
+			throw NoSuchKeyFoundException();
+		}
+		// The first batch starts with the leaf just found
+		if (lowOp == GTE || lowValInt < INT_MAX)
+		{
+			leavesReadAhead = readAheadLeaves(lowOp == GT ? lowValInt + 1 : lowValInt) - 1;
+		}
+	}
+	BTREE_STAT_ADD(scanLeavesVisited, 1);
+	BTREE_STAT_ADD(lastScanLeavesVisited, 1);
+}
+
+const bool BTreeIndex::inRange(int value)
+{
+	if (lowOp == GT && highOp == LT && value > lowValInt && value < highValInt)
+		return true;
+	if (lowOp == GT && highOp == LTE && value > lowValInt && value <= highValInt)
+		return true;
+	if (lowOp == GTE && highOp == LT && value >= lowValInt && value < highValInt)
+		return true;
+	if (lowOp == GTE && highOp == LTE && value >= lowValInt && value <= highValInt)
+		return true;
+	return false;
+}
+// -----------------------------------------------------------------------------
+// BTreeIndex::nextScanSelection
+// -----------------------------------------------------------------------------
+bool BTreeIndex::nextScanSelection()
+{
+	while (this->scanSelectionNext >= this->scanSelection.size())
+	{
+		Page *page;
+		this->readIndexPage(currentPageNum, page);
+		currentPageData = page;
+		LeafNodeInt *currNode = (LeafNodeInt *)page;
+
+		// if the first key of currNode > the high bound, stop scanning
+		if ((highOp == LT && currNode->keyArray[0] >= highValInt) || (highOp == LTE && currNode->keyArray[0] > highValInt))
+		{
+			this->unPinIndexPage(currentPageNum, false);
+			return false;
+		}
+		if (nextEntry < currNode->size)
+		{
+			// Test the rest of the leaf at once: the range and the filter each give a 0/1 mask of the entries, and the
+			// entries left in the combined mask are gathered into the selection without a branch per entry
+			const int first = nextEntry;
+			const int count = currNode->size - first;
+			const int *keys = currNode->keyArray + first;
+			const int low = lowValInt;
+			const int high = highValInt;
+			const bool lowInclusive = lowOp == GTE;
+			const bool highInclusive = highOp == LTE;
+			unsigned char matches[INTARRAYLEAFSIZE];
+			for (int i = 0; i < count; i++)
+			{
+				matches[i] = (lowInclusive ? keys[i] >= low : keys[i] > low) & (highInclusive ? keys[i] <= high : keys[i] < high);
+			}
+			int inRangeCount = 0;
+			if (scanFiltered)
+			{
+				unsigned char filterMatches[INTARRAYLEAFSIZE];
+				evaluateKeyPredicate(scanFilter, keys, count, filterMatches);
+				for (int i = 0; i < count; i++)
+				{
+					inRangeCount += matches[i];
+					matches[i] &= filterMatches[i];
+				}
+			}
+			scanSelection.resize(count);
+			int selected = 0;
+			for (int i = 0; i < count; i++)
+			{
+				scanSelection[selected] = first + i;
+				selected += matches[i];
+			}
+			scanSelection.resize(selected);
+			scanSelectionNext = 0;
+			if (scanFiltered)
+			{
+				BTREE_STAT_ADD(scanEntriesFiltered, inRangeCount - selected);
+			}
+			// Keys are sorted, so a last key above the range means no later leaf has anything for the scan
+			int lastKey = currNode->keyArray[currNode->size - 1];
+			scanLastLeaf = highInclusive ? lastKey > high : lastKey >= high;
+			nextEntry = currNode->size;
+			this->unPinIndexPage(currentPageNum, false);
+			continue;
+		}
+		// move to the right sibling if the current page is entirely scannned
+		PageId nextPageNo = currNode->rightSibPageNo;
+		this->unPinIndexPage(currentPageNum, false);
+		if (scanLastLeaf || nextPageNo == 0)
+		{
+			return false;
+		}
+		currentPageNum = nextPageNo;
+		nextEntry = 0;
+		if (leavesReadAhead > 0)
+		{
+			leavesReadAhead--;
+		}
+		if (readAheadMore && leavesReadAhead < SCAN_READ_AHEAD / 2)
+		{
+			leavesReadAhead += readAheadLeaves(readAheadKey + 1);
+		}
+		BTREE_STAT_ADD(scanLeavesVisited, 1);
+		BTREE_STAT_ADD(lastScanLeavesVisited, 1);
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNext
+// -----------------------------------------------------------------------------
+const void BTreeIndex::scanNext(RecordId &outRid)
+{
+	OperationTimer timer(this, OP_SCAN_NEXT);
+	if (scanExecuting == false || currentPageData == NULL)
+	{
+		throw ScanNotInitializedException();
+	}
+	if (!nextScanSelection())
+	{
+		throw IndexScanCompletedException();
+	}
+	Page *page;
+	this->readIndexPage(currentPageNum, page);
+	outRid = ((LeafNodeInt *)page)->ridArray[scanSelection[scanSelectionNext++]];
+	this->unPinIndexPage(currentPageNum, false);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNextBatch
+// -----------------------------------------------------------------------------
+const int BTreeIndex::scanNextBatch(RecordId *outRids, int maxRids)
+{
+	OperationTimer timer(this, OP_SCAN_NEXT);
+	if (scanExecuting == false || currentPageData == NULL)
+	{
+		throw ScanNotInitializedException();
+	}
+	int found = 0;
+	while (found < maxRids && nextScanSelection())
+	{
+		Page *page;
+		this->readIndexPage(currentPageNum, page);
+		const LeafNodeInt *leaf = (LeafNodeInt *)page;
+		while (found < maxRids && scanSelectionNext < scanSelection.size())
+		{
+			outRids[found++] = leaf->ridArray[scanSelection[scanSelectionNext++]];
+		}
+		this->unPinIndexPage(currentPageNum, false);
+	}
+	if (!found)
+	{
+		throw IndexScanCompletedException();
+	}
+	return found;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::endScan
+// -----------------------------------------------------------------------------
+//
+const void BTreeIndex::endScan()
+{
+	// TODO: criteria for not initialized scan
+	if (scanExecuting == false)
+	{
+		throw ScanNotInitializedException();
+	}
+	// reset vars for scan
+	currentPageData = NULL;
+	currentPageNum = 0;
+	scanExecuting = false;
+	nextEntry = -1;
+	scanFiltered = false;
+	scanSelection.clear();
+	scanSelectionNext = 0;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::parallelScan
+// -----------------------------------------------------------------------------
+const void BTreeIndex::parallelScan(const void *lowValParm,
+									const Operator lowOpParm,
+									const void *highValParm,
+									const Operator highOpParm,
+									int threads,
+									std::vector<std::vector<RecordId> > &partitions)
+{
+	if ((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE))
+	{
+		throw BadOpcodesException();
+	}
+	if (*(int *)lowValParm > *(int *)highValParm)
+	{
+		throw BadScanrangeException();
+	}
+	if (threads <= 0)
+	{
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	BTREE_STAT_ADD(scans, 1);
+
+	ScanTaskQueue queue;
+	queue.lowVal = *(int *)lowValParm;
+	queue.lowOp = lowOpParm;
+	queue.highVal = *(int *)highValParm;
+	queue.highOp = highOpParm;
+	queue.partitions = &partitions;
+	queue.nextTask = 0;
+	partitions.clear();
+	if (queue.lowOp == GT && queue.lowVal == INT_MAX)
+	{
+		return;
+	}
+	if (threads > 1)
+	{
+		int lowKey = queue.lowOp == GT ? queue.lowVal + 1 : queue.lowVal;
+		scanSeparators(lowKey, queue.highVal, threads * SCAN_TASKS_PER_THREAD, queue.separators);
+	}
+	int tasks = queue.separators.size() + 1;
+	partitions.resize(tasks);
+
+	// This thread works on the sub-ranges too
+	std::vector<std::thread> workers;
+	for (int t = 1; t < std::min(threads, tasks); t++)
+	{
+		workers.push_back(std::thread(&BTreeIndex::runScanTasks, this, &queue));
+	}
+	runScanTasks(&queue);
+	for (size_t t = 0; t < workers.size(); t++)
+	{
+		workers[t].join();
+	}
+	if (queue.failure)
+	{
+		std::rethrow_exception(queue.failure);
+	}
+}
+
+const void BTreeIndex::parallelScan(const void *lowValParm,
+									const Operator lowOpParm,
+									const void *highValParm,
+									const Operator highOpParm,
+									int threads,
+									std::vector<RecordId> &outRids)
+{
+	std::vector<std::vector<RecordId> > partitions;
+	parallelScan(lowValParm, lowOpParm, highValParm, highOpParm, threads, partitions);
+	size_t total = 0;
+	for (size_t t = 0; t < partitions.size(); t++)
 	{
-		this->bufMgr->unPinPage(this->file, leftPageNo, true);
-		this->bufMgr->unPinPage(this->file, newPageNo, true);
+		total += partitions[t].size();
 	}
-	catch (const badgerdb::PageNotPinnedException &e)
+	outRids.clear();
+	outRids.reserve(total);
+	for (size_t t = 0; t < partitions.size(); t++)
 	{
-		std::cerr << "splitAndInsertInternal: exception thrown when closing the original and new pages\t" << e.what() << '\n';
+		outRids.insert(outRids.end(), partitions[t].begin(), partitions[t].end());
 	}
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::splitRoot
+// BTreeIndex::scanSeparators
 // -----------------------------------------------------------------------------
-const void BTreeIndex::splitRoot()
+void BTreeIndex::scanSeparators(int lowKey, int highKey, int wanted, std::vector<int> &separators)
 {
-	// First check if the root is a leaf. This is relevant to level assignment.
-	bool rootIsLeaf = 0;
+	separators.clear();
 	if (this->rootPageNum == 2)
 	{
-		rootIsLeaf = 1;
+		return;
+	}
+	// Go down one level while the nodes covering the range have too few keys inside it
+	std::vector<PageId> nodes(1, this->rootPageNum);
+	while (1)
+	{
+		std::vector<PageId> children;
+		separators.clear();
+		bool lastLevel = false;
+		for (size_t n = 0; n < nodes.size(); n++)
+		{
+			Page *page;
+			this->readIndexPage(nodes[n], page);
+			NonLeafNodeInt *node = (NonLeafNodeInt *)page;
+			// child i holds the keys above keyArray[i - 1] and up to keyArray[i]
+			for (int i = 0; i <= node->size; i++)
+			{
+				if (i < node->size && node->keyArray[i] < lowKey)
+				{
+					continue;
+				}
+				if (i > 0 && node->keyArray[i - 1] >= highKey)
+				{
+					break;
+				}
+				children.push_back(node->pageNoArray[i]);
+				if (i < node->size && node->keyArray[i] < highKey)
+				{
+					separators.push_back(node->keyArray[i]);
+				}
+			}
+			lastLevel = node->level == 1;
+			this->unPinIndexPage(nodes[n], false);
+		}
+		if (lastLevel || (int)separators.size() >= wanted - 1)
+		{
+			break;
+		}
+		nodes.swap(children);
+	}
+	if ((int)separators.size() > wanted - 1)
+	{
+		std::vector<int> thinned;
+		for (int t = 1; t < wanted; t++)
+		{
+			thinned.push_back(separators[(size_t)t * separators.size() / wanted]);
+		}
+		separators.swap(thinned);
 	}
-	Page *newRoot;
-	PageId newRootId;
-	this->bufMgr->allocPage(this->file, newRootId, newRoot);
-	NonLeafNodeInt *newRootNode = (NonLeafNodeInt *)newRoot;
-	this->rootPageNum = newRootId;
-	// If before split the root is a leaf, then now the root is 1 level above the leaf so assign 1. Otherwise assign 0.
-	newRootNode->level = rootIsLeaf ? 1 : 0;
-	newRootNode->size = 0;
-	this->bufMgr->unPinPage(this->file, newRootId, true);
-
-	Page *tmp;
-	bufMgr->readPage(file, headerPageNum, tmp);
-	IndexMetaInfo *metaPage = (IndexMetaInfo *)tmp;
-	metaPage->rootPageNo = newRootId;
-	bufMgr->unPinPage(file, headerPageNum, true);
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::getParent
+// BTreeIndex::runScanTasks
 // -----------------------------------------------------------------------------
-PageId BTreeIndex::getParent(PageId childPageNo, const void *key)
+void BTreeIndex::runScanTasks(ScanTaskQueue *queue)
 {
-	if (*((int *)key) == 1023)
-	{
-		std::cout << "a" << std::endl;
-	}
-	// This means there's no parent for the given node
-	if (childPageNo == rootPageNum)
-	{
-		return 0;
-	}
-	PageId parentNo = rootPageNum; // Parent starts from the root
+	int tasks = queue->separators.size() + 1;
 	while (1)
 	{
-		Page *tmp;
-		this->bufMgr->readPage(this->file, parentNo, tmp);
-		NonLeafNodeInt *parentCurNode = (NonLeafNodeInt *)tmp;
-		this->bufMgr->unPinPage(this->file, parentNo, tmp);
-		PageId childCurNo = parentCurNode->pageNoArray[getIndexNonLeaf(parentNo, key)];
-
-		if (childCurNo == childPageNo)
+		int t = queue->nextTask.fetch_add(1);
+		if (t >= tasks)
 		{
-			return parentNo;
+			return;
+		}
+		int lowVal = t == 0 ? queue->lowVal : queue->separators[t - 1];
+		Operator lowOp = t == 0 ? queue->lowOp : GT;
+		int highVal = t == tasks - 1 ? queue->highVal : queue->separators[t];
+		Operator highOp = t == tasks - 1 ? queue->highOp : LTE;
+		try
+		{
+			scanPartition(lowVal, lowOp, highVal, highOp, (*queue->partitions)[t]);
+		}
+		catch (...)
+		{
+			// Keep the first failure and stop handing out sub-ranges
+			std::lock_guard<std::mutex> latch(queue->failureLatch);
+			if (!queue->failure)
+			{
+				queue->failure = std::current_exception();
+			}
+			queue->nextTask = tasks;
 		}
-		parentNo = childCurNo;
 	}
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::getIndexNonLeaf
+// BTreeIndex::scanPartition
 // -----------------------------------------------------------------------------
-int BTreeIndex::getIndexNonLeaf(PageId pageNo, const void *key)
+void BTreeIndex::scanPartition(int lowVal, Operator lowOp, int highVal, Operator highOp, std::vector<RecordId> &rids)
 {
-	Page *tmp;
-	this->bufMgr->readPage(this->file, pageNo, tmp);
-	NonLeafNodeInt *curNode = (NonLeafNodeInt *)tmp;
-	try
+	if (lowOp == GT && lowVal == INT_MAX)
 	{
-		this->bufMgr->unPinPage(this->file, pageNo, false);
+		return;
 	}
-	catch (const badgerdb::PageNotPinnedException &e)
+	int lowKey = lowOp == GT ? lowVal + 1 : lowVal;
+	PageId pageNo = this->rootPageNum;
 	{
-		std::cerr << "getIndexNonLeaf: exception thrown after computing the index\t" << e.what() << '\n';
+		// Go down to the first leaf that may hold lowKey
+		std::lock_guard<std::mutex> latch(this->pageLatch);
+		bool reachLeaf = pageNo == 2;
+		while (!reachLeaf)
+		{
+			Page *page;
+			this->readIndexPage(pageNo, page);
+			NonLeafNodeInt *node = (NonLeafNodeInt *)page;
+			int i = 0;
+			while (i < node->size && node->keyArray[i] < lowKey)
+			{
+				i++;
+			}
+			PageId childNo = node->pageNoArray[i];
+			reachLeaf = node->level == 1;
+			this->unPinIndexPage(pageNo, false);
+			pageNo = childNo;
+		}
 	}
 
-	// Check if the node is empty
-	if (!curNode->size)
-	{
-		return 0;
-	}
-	// Find out the index
-	for (int i = 0; i < curNode->size; i++)
+	// Pages of a mapped index stay valid after the latch is released, other pages are copied before they are unpinned
+	LeafNodeInt leafCopy;
+	while (pageNo)
 	{
-		if (curNode->keyArray[i] >= *((int *)key))
+		const LeafNodeInt *leaf;
+		{
+			std::lock_guard<std::mutex> latch(this->pageLatch);
+			Page *page;
+			this->readIndexPage(pageNo, page);
+			if (this->mappedData)
+			{
+				leaf = (LeafNodeInt *)page;
+			}
+			else
+			{
+				memcpy(&leafCopy, page, sizeof(LeafNodeInt));
+				leaf = &leafCopy;
+			}
+			this->unPinIndexPage(pageNo, false);
+			BTREE_STAT_ADD(scanLeavesVisited, 1);
+		}
+		for (int i = 0; i < leaf->size; i++)
 		{
-			return i;
+			int key = leaf->keyArray[i];
+			if ((highOp == LT && key >= highVal) || (highOp == LTE && key > highVal))
+			{
+				return;
+			}
+			if ((lowOp == GT && key > lowVal) || (lowOp == GTE && key >= lowVal))
+			{
+				rids.push_back(leaf->ridArray[i]);
+			}
 		}
+		pageNo = leaf->rightSibPageNo;
 	}
+}
 
-	//Return the last index
-	return curNode->size;
+// -----------------------------------------------------------------------------
+// BTreeIndex::buildParallel
+// -----------------------------------------------------------------------------
+int BTreeIndex::buildParallel(const std::string &relationName, int threads)
+{
+	BuildQueue queue;
+	queue.indexes.push_back(this);
+	scanRelation(relationName, threads, &queue);
+	int numRecords = bulkLoad(&queue, 0);
+	this->currentLSN += numRecords;
+	return numRecords;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::getIndexLeaf
+// BTreeIndex::buildIndexes
 // -----------------------------------------------------------------------------
-int BTreeIndex::getIndexLeaf(PageId pageNo, const void *key)
+const void BTreeIndex::buildIndexes(const std::string &relationName,
+									BufMgr *bufMgr,
+									const std::vector<IndexSpec> &specs,
+									std::vector<BTreeIndex *> &indexes,
+									std::vector<std::string> &indexNames,
+									const int buildThreads)
 {
-	Page *tmp;
-	this->bufMgr->readPage(this->file, pageNo, tmp);
-	LeafNodeInt *curNode = (LeafNodeInt *)tmp;
-	// Check if the node is empty
+	indexes.clear();
+	indexNames.assign(specs.size(), std::string());
+	BuildQueue queue;
 	try
 	{
-		this->bufMgr->unPinPage(this->file, pageNo, false);
-	}
-	catch (const badgerdb::PageNotPinnedException &e)
-	{
-		std::cerr << "getIndexLeaf: Exception thrown after computing the index\t" << e.what() << '\n';
-	}
-
-	if (!curNode->size)
-	{
-		return 0;
+		for (size_t i = 0; i < specs.size(); i++)
+		{
+			indexes.push_back(new BTreeIndex(relationName, indexNames[i], bufMgr, specs[i].attrByteOffset, specs[i].attrType,
+											 specs[i].includeByteOffset, specs[i].includeType, OPEN_CREATE_EMPTY));
+			if (indexes[i]->isEmpty())
+			{
+				queue.indexes.push_back(indexes[i]);
+			}
+		}
+		if (queue.indexes.empty())
+		{
+			return;
+		}
+		queue.indexes[0]->scanRelation(relationName, buildThreads, &queue);
+		for (size_t i = 0; i < queue.indexes.size(); i++)
+		{
+			BTreeIndex *index = queue.indexes[i];
+			int numRecords = index->bulkLoad(&queue, i);
+			index->currentLSN += numRecords;
+			BTREE_TRACE_INFO(TRACE_BUILD_DONE, numRecords, index->rootPageNum);
+		}
 	}
-	// Find out the index
-	for (int i = 0; i < curNode->size; i++)
+	catch (...)
 	{
-		if (curNode->keyArray[i] >= *((int *)key))
+		for (size_t i = 0; i < indexes.size(); i++)
 		{
-			// this->bufMgr->unPinPage(this->file, pageNo, false);
-			return i;
+			delete indexes[i];
 		}
+		indexes.clear();
+		throw;
 	}
-	//Return the last index
-	return curNode->size;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::startScan
+// BTreeIndex::isEmpty
 // -----------------------------------------------------------------------------
-const void BTreeIndex::startScan(const void *lowValParm,
-								 const Operator lowOpParm,
-								 const void *highValParm,
-								 const Operator highOpParm)
+bool BTreeIndex::isEmpty()
 {
-
-	// TODO: If another scan is already executing, that needs to be ended here.
-	if (scanExecuting)
-	// if (scanExecuting || currentPageData != NULL)
+	if (this->rootPageNum != 2)
 	{
-		currentPageData = NULL;
+		return false;
 	}
-	if ((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE))
+	Page *root;
+	this->readIndexPage(this->rootPageNum, root);
+	bool empty = ((LeafNodeInt *)root)->size == 0;
+	this->unPinIndexPage(this->rootPageNum, false);
+	return empty;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanRelation
+// -----------------------------------------------------------------------------
+void BTreeIndex::scanRelation(const std::string &relationName, int threads, BuildQueue *queue)
+{
+	if (threads <= 0)
 	{
-		throw BadOpcodesException();
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
 	}
+	PageFile heapFile(relationName, false);
+	queue->heapFile = &heapFile;
+	queue->nextPage = heapFile.getFirstPageNo();
+	queue->runs.assign(queue->indexes.size(), std::vector<std::vector<BuildEntry> >(threads));
 
-	if (*(int *)lowValParm > *(int *)highValParm)
+	// This thread reads its share of the relation too
+	std::vector<std::thread> workers;
+	for (int t = 1; t < threads; t++)
 	{
-		throw BadScanrangeException();
+		workers.push_back(std::thread(&BTreeIndex::runBuildMorsels, this, queue, t));
 	}
-
-	// set vars for scan
-	lowValInt = *(int *)lowValParm;
-	highValInt = *(int *)highValParm;
-	lowOp = lowOpParm;
-	highOp = highOpParm;
-	nextEntry = 0;
-	scanExecuting = true;
-	std::cout << "root num:" << rootPageNum << std::endl;
-	// read and unpin the root
-	Page *root;
-	this->bufMgr->readPage(this->file, rootPageNum, root);
-	this->bufMgr->unPinPage(this->file, rootPageNum, false);
-	// if root is a leaf, directly check whether the root's keys are in the range
-
-	if (this->rootPageNum == 2)
+	runBuildMorsels(queue, 0);
+	for (size_t t = 0; t < workers.size(); t++)
 	{
-		LeafNodeInt *rootNode = (LeafNodeInt *)root;
-
-		if (((highOpParm == LT) && (rootNode->keyArray[0] >= *(int *)highValParm)) ||
-			((highOpParm == LTE) && (rootNode->keyArray[0] > *(int *)highValParm)) ||
-			((lowOpParm == GT) && (rootNode->keyArray[rootNode->size - 1] < *(int *)lowValParm)) ||
-			((lowOpParm == GTE) && (rootNode->keyArray[rootNode->size - 1] <= *(int *)lowValParm)))
-		{
-			throw NoSuchKeyFoundException();
-		}
-		// this->bufMgr->readPage(this->file, rootPageNum, root);
+		workers[t].join();
 	}
-	else // traver from root if it is a noneleaf
+	// Release the frames of the heap file before it is closed
+	this->bufMgr->flushFile(&heapFile);
+	queue->heapFile = NULL;
+	if (queue->failure)
 	{
-		bool reachLeaf = false;
-		NonLeafNodeInt *rootNode = (NonLeafNodeInt *)root;
-		Page *currPage = root;
-		NonLeafNodeInt *currNode = rootNode;
+		std::rethrow_exception(queue->failure);
+	}
+}
 
-		// find the leaf node of contains lower bound
-		while (!reachLeaf)
+// -----------------------------------------------------------------------------
+// BTreeIndex::runBuildMorsels
+// -----------------------------------------------------------------------------
+void BTreeIndex::runBuildMorsels(BuildQueue *queue, int worker)
+{
+	std::vector<std::pair<PageId, Page *> > morsel;
+	try
+	{
+		while (1)
 		{
-			for (int i = 0; i < currNode->keyArray[rootNode->size - 1]; i++)
+			// Only claiming and releasing pages is serialized, the records are read in parallel
 			{
-				// ">" lowVal
-				if (lowOpParm == GT && currNode->keyArray[i] > *(int *)lowValParm)
+				std::lock_guard<std::mutex> latch(this->pageLatch);
+				while (queue->nextPage != 0 && (int)morsel.size() < BUILD_MORSEL_PAGES)
 				{
-					if (currNode->level == 1) // next level is leaf node
-					{
-						// assign the correct leaf page to be the first leaf page contain the lower bound
-						this->bufMgr->readPage(this->file, currNode->pageNoArray[i], this->currentPageData);
-						currentPageNum = currNode->pageNoArray[i];
-						this->bufMgr->unPinPage(this->file, currNode->pageNoArray[i], false);
-						reachLeaf = true;
-						break;
-					}
-					// traverse to child if i th key is greater than the low bound
-					this->bufMgr->readPage(this->file, currNode->pageNoArray[i], currPage);
-					this->bufMgr->unPinPage(this->file, currNode->pageNoArray[i], false);
-					currNode = (NonLeafNodeInt *)currPage;
-					break;
-				} // ">=" lowVal
-				else if (lowOpParm == GTE && currNode->keyArray[i] >= *(int *)lowValParm)
+					Page *page;
+					this->bufMgr->readPage(queue->heapFile, queue->nextPage, page);
+					morsel.push_back(std::make_pair(queue->nextPage, page));
+					queue->nextPage = page->next_page_number();
+				}
+			}
+			if (morsel.empty())
+			{
+				break;
+			}
+			for (size_t m = 0; m < morsel.size(); m++)
+			{
+				for (PageIterator record = morsel[m].second->begin(); record != morsel[m].second->end(); ++record)
 				{
-					if (currNode->level == 1)
+					// The page only hands out records as strings, every index reads its columns from the same one
+					std::string recordStr = *record;
+					RecordId rid = record.getCurrentRecord();
+					for (size_t i = 0; i < queue->indexes.size(); i++)
 					{
-						this->bufMgr->readPage(this->file, currNode->pageNoArray[i], this->currentPageData);
-						currentPageNum = currNode->pageNoArray[i];
-						this->bufMgr->unPinPage(this->file, currNode->pageNoArray[i], false);
-						reachLeaf = true;
-						break;
+						BTreeIndex *index = queue->indexes[i];
+						BuildEntry entry;
+						entry.key = recordInt(recordStr.c_str(), index->attrByteOffset);
+						entry.rid = rid;
+						entry.includeVal = index->includeValue(recordStr.c_str());
+						queue->runs[i][worker].push_back(entry);
 					}
-					// traverse to child if i th key is greater or equal than the low bound
-					this->bufMgr->readPage(this->file, currNode->pageNoArray[i], currPage);
-					this->bufMgr->unPinPage(this->file, currNode->pageNoArray[i], false);
-					currNode = (NonLeafNodeInt *)currPage;
-					break;
+				}
+			}
+			{
+				std::lock_guard<std::mutex> latch(this->pageLatch);
+				while (!morsel.empty())
+				{
+					this->bufMgr->unPinPage(queue->heapFile, morsel.back().first, false);
+					morsel.pop_back();
 				}
 			}
 		}
-		if (this->currentPageData == NULL)
+		for (size_t i = 0; i < queue->indexes.size(); i++)
 		{
-			// scanExecuting = false;
-			throw NoSuchKeyFoundException();
+			std::sort(queue->runs[i][worker].begin(), queue->runs[i][worker].end(), buildEntryLess);
+		}
+	}
+	catch (...)
+	{
+		// Stop the other threads, release this thread's pages and keep the first failure
+		{
+			std::lock_guard<std::mutex> latch(this->pageLatch);
+			queue->nextPage = 0;
+			for (size_t m = 0; m < morsel.size(); m++)
+			{
+				this->bufMgr->unPinPage(queue->heapFile, morsel[m].first, false);
+			}
+		}
+		std::lock_guard<std::mutex> latch(queue->failureLatch);
+		if (!queue->failure)
+		{
+			queue->failure = std::current_exception();
 		}
 	}
 }
 
-const bool BTreeIndex::inRange(int value)
-{
-	if (lowOp == GT && highOp == LT && value > lowValInt && value < highValInt)
-		return true;
-	if (lowOp == GT && highOp == LTE && value > lowValInt && value <= highValInt)
-		return true;
-	if (lowOp == GTE && highOp == LT && value >= lowValInt && value < highValInt)
-		return true;
-	if (lowOp == GTE && highOp == LTE && value >= lowValInt && value <= highValInt)
-		return true;
-	return false;
-}
 // -----------------------------------------------------------------------------
-// BTreeIndex::scanNext
+// BTreeIndex::bulkLoad
 // -----------------------------------------------------------------------------
-const void BTreeIndex::scanNext(RecordId &outRid)
+int BTreeIndex::bulkLoad(BuildQueue *queue, int index)
 {
-	if (scanExecuting == false || currentPageData == NULL)
+	std::vector<std::vector<BuildEntry> > &runs = queue->runs[index];
+	int numRecords = 0;
+	for (size_t r = 0; r < runs.size(); r++)
 	{
-		throw ScanNotInitializedException();
+		numRecords += runs[r].size();
 	}
-
-	while (1)
+	std::vector<size_t> nextInRun(runs.size(), 0);
+	std::priority_queue<RunHead> heads;
+	for (size_t r = 0; r < runs.size(); r++)
 	{
-		this->bufMgr->readPage(this->file, currentPageNum, currentPageData);
-		this->bufMgr->unPinPage(this->file, currentPageNum, false);
-		LeafNodeInt *currNode = (LeafNodeInt *)currentPageData;
+		if (!runs[r].empty())
+		{
+			RunHead head = {runs[r][0], (int)r};
+			heads.push(head);
+		}
+	}
 
-		// if the first key of currNode > the high bound, stop scanning
-		if ((lowOp == GT && currNode->keyArray[0] >= highValInt) || (lowOp == GTE && currNode->keyArray[0] > highValInt))
+	// Fill the leaves from left to right. The empty root leaf becomes the first one.
+	std::vector<BuiltNode> level;
+	PageId leafNo = 2;
+	Page *page;
+	this->readIndexPage(leafNo, page);
+	LeafNodeInt *leaf = (LeafNodeInt *)page;
+	while (!heads.empty())
+	{
+		RunHead head = heads.top();
+		heads.pop();
+		std::vector<BuildEntry> &run = runs[head.run];
+		if (++nextInRun[head.run] < run.size())
+		{
+			RunHead next = {run[nextInRun[head.run]], head.run};
+			heads.push(next);
+		}
+		else
 		{
-			throw IndexScanCompletedException();
+			std::vector<BuildEntry>().swap(run);
 		}
-		while (nextEntry < currNode->size) // keep scanning the current node until reach the last entry
+
+		if (leaf->size == this->leafOccupancy)
 		{
-			// fetch the record id if the entry match the scan
-			if (inRange(currNode->keyArray[nextEntry]))
+			// Keys equal to a separator belong to its left child, so a run of keys equal to the next one moves to the
+			// new leaf, unless it fills the whole leaf
+			int keep = leaf->size;
+			while (keep > 0 && leaf->keyArray[keep - 1] == head.entry.key)
 			{
-				outRid = currNode->ridArray[nextEntry];
-				nextEntry++;
-				return;
+				keep--;
+			}
+			if (keep == 0)
+			{
+				keep = leaf->size;
 			}
-			else  // go to next entry of current node
+			PageId newLeafNo;
+			this->allocIndexPage(newLeafNo, page);
+			LeafNodeInt *newLeaf = (LeafNodeInt *)page;
+			newLeaf->size = leaf->size - keep;
+			newLeaf->rightSibPageNo = 0;
+			for (int i = keep; i < leaf->size; i++)
 			{
-				nextEntry++;
+				newLeaf->keyArray[i - keep] = leaf->keyArray[i];
+				newLeaf->ridArray[i - keep] = leaf->ridArray[i];
+#if BTREE_SUBTREE_AGGREGATES
+				newLeaf->includeArray[i - keep] = leaf->includeArray[i];
+#endif
 			}
+			leaf->size = keep;
+			leaf->rightSibPageNo = newLeafNo;
+			level.push_back(builtLeaf(leafNo, leaf));
+			this->unPinIndexPage(leafNo, true);
+			leafNo = newLeafNo;
+			leaf = newLeaf;
 		}
-		// move to the right sibling if the current page is entirely scannned
-		if (currNode->rightSibPageNo == 0) //read the last leaf node
+		leaf->keyArray[leaf->size] = head.entry.key;
+		leaf->ridArray[leaf->size] = head.entry.rid;
+#if BTREE_SUBTREE_AGGREGATES
+		leaf->includeArray[leaf->size] = head.entry.includeVal;
+#endif
+		leaf->size++;
+	}
+	level.push_back(builtLeaf(leafNo, leaf));
+	this->unPinIndexPage(leafNo, true);
+
+	// Add non-leaf levels until a single node is left. The children of a level are spread evenly over its nodes,
+	// so that no node ends up with a single child.
+	bool childrenAreLeaves = true;
+	while (level.size() > 1)
+	{
+		std::vector<BuiltNode> parents;
+		size_t maxChildren = this->nodeOccupancy + 1;
+		size_t nodes = (level.size() + maxChildren - 1) / maxChildren;
+		size_t first = 0;
+		for (size_t n = 0; n < nodes; n++)
 		{
-			throw IndexScanCompletedException();
+			size_t last = (n + 1) * level.size() / nodes;
+			PageId nodeNo;
+			this->allocIndexPage(nodeNo, page);
+			NonLeafNodeInt *node = (NonLeafNodeInt *)page;
+			node->level = childrenAreLeaves ? 1 : 0;
+			node->size = last - first - 1;
+			BuiltNode parent = {nodeNo, 0, 0, KeyAggregate()};
+			parent.agg.clear();
+			for (size_t c = first; c < last; c++)
+			{
+				// keys up to keyArray[i] go to child i
+				node->pageNoArray[c - first] = level[c].pageNo;
+				if (c + 1 < last)
+				{
+					node->keyArray[c - first] = level[c].maxKey;
+				}
+#if BTREE_SUBTREE_COUNTS
+				node->countArray[c - first] = level[c].count;
+#endif
+#if BTREE_SUBTREE_AGGREGATES
+				node->aggArray[c - first] = level[c].agg;
+#endif
+				parent.maxKey = level[c].maxKey;
+				parent.count += level[c].count;
+				parent.agg.combine(level[c].agg);
+			}
+			this->unPinIndexPage(nodeNo, true);
+			parents.push_back(parent);
+			first = last;
 		}
-		currentPageNum = currNode->rightSibPageNo;
-		nextEntry = 0;
+		level.swap(parents);
+		childrenAreLeaves = false;
 	}
-} // namespace badgerdb
 
-// -----------------------------------------------------------------------------
-// BTreeIndex::endScan
-// -----------------------------------------------------------------------------
-//
-const void BTreeIndex::endScan()
-{
-	// TODO: criteria for not initialized scan
-	if (scanExecuting == false)
+	if (level[0].pageNo != this->rootPageNum)
 	{
-		throw ScanNotInitializedException();
+		BTREE_TRACE_INFO(TRACE_ROOT_CHANGE, level[0].pageNo, this->rootPageNum);
+		BTREE_STAT_ADD(rootChanges, 1);
+		this->rootPageNum = level[0].pageNo;
+		Page *meta;
+		this->readIndexPage(headerPageNum, meta);
+		((IndexMetaInfo *)meta)->rootPageNo = this->rootPageNum;
+		this->unPinIndexPage(headerPageNum, true);
 	}
-	// reset vars for scan
-	currentPageData = NULL;
-	currentPageNum = 0;
-	scanExecuting = false;
-	nextEntry = -1;
+	return numRecords;
 }
 
 } // namespace badgerdb
@@ -11,6 +11,14 @@
 #include <string>
 #include "string.h"
 #include <sstream>
+#include <set>
+#include <map>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <mutex>
 
 #include "types.h"
 #include "page.h"
@@ -41,18 +49,267 @@ enum Operator
 	GT		/* Greater Than */
 };
 
+/**
+ * @brief Split policies. Passed to BTreeIndex::setSplitPolicy() method.
+ */
+enum SplitPolicy
+{
+	SPLIT_EVEN,			/* Always split a full node in half */
+	SPLIT_ADAPTIVE	/* Split at the insert position during ascending or descending insert runs, in half otherwise */
+};
+
+/**
+ * @brief Ways of opening an index. Passed to the BTreeIndex constructor.
+ */
+enum IndexOpenMode
+{
+	OPEN_READ_WRITE,				/* Through the buffer manager. An index that does not exist yet is built */
+	OPEN_READ_ONLY_MAPPED,	/* Mapped into memory and read in place, bypassing the buffer manager. The index must exist */
+	OPEN_CREATE_EMPTY				/* Like OPEN_READ_WRITE, but an index that does not exist yet is created empty */
+};
+
+/**
+ * @brief One index to build with BTreeIndex::buildIndexes(). The fields are the matching constructor parameters.
+ */
+struct IndexSpec
+{
+	int attrByteOffset;
+	Datatype attrType;
+	int includeByteOffset;
+	Datatype includeType;
+};
+
+/**
+ * @brief Kinds of KeyPredicate nodes.
+ */
+enum KeyPredicateKind
+{
+	KEY_MOD,		/* key % operand == value, with the sign rules of the C++ % operator */
+	KEY_MASK,		/* (key & operand) == value */
+	KEY_NOT_IN,	/* key is none of values */
+	KEY_AND,		/* every child holds */
+	KEY_OR,			/* some child holds */
+	KEY_NOT			/* the only child does not hold */
+};
+
+/**
+ * @brief Predicate over the keys of an index, in addition to the range of a scan. Passed to BTreeIndex::startScan().
+ * A predicate is a small expression tree built with the functions below, for instance
+ * KeyPredicate::both(KeyPredicate::mod(7, 0), KeyPredicate::notIn(excluded)).
+ */
+struct KeyPredicate
+{
+	KeyPredicateKind kind;
+	int operand;
+	int value;
+
+  /**
+   * Keys of KEY_NOT_IN, sorted.
+   */
+	std::vector<int> values;
+
+  /**
+   * Operands of KEY_AND, KEY_OR and KEY_NOT.
+   */
+	std::vector<KeyPredicate> children;
+
+	static KeyPredicate mod( int divisor, int remainder )
+	{
+		KeyPredicate predicate( KEY_MOD );
+		predicate.operand = divisor;
+		predicate.value = remainder;
+		return predicate;
+	}
+
+	static KeyPredicate mask( int bits, int masked )
+	{
+		KeyPredicate predicate( KEY_MASK );
+		predicate.operand = bits;
+		predicate.value = masked;
+		return predicate;
+	}
+
+	static KeyPredicate notIn( const std::vector<int>& keys )
+	{
+		KeyPredicate predicate( KEY_NOT_IN );
+		predicate.values = keys;
+		std::sort( predicate.values.begin(), predicate.values.end() );
+		return predicate;
+	}
+
+	static KeyPredicate both( const KeyPredicate& left, const KeyPredicate& right )
+	{
+		KeyPredicate predicate( KEY_AND );
+		predicate.children.push_back( left );
+		predicate.children.push_back( right );
+		return predicate;
+	}
+
+	static KeyPredicate either( const KeyPredicate& left, const KeyPredicate& right )
+	{
+		KeyPredicate predicate( KEY_OR );
+		predicate.children.push_back( left );
+		predicate.children.push_back( right );
+		return predicate;
+	}
+
+	static KeyPredicate negate( const KeyPredicate& child )
+	{
+		KeyPredicate predicate( KEY_NOT );
+		predicate.children.push_back( child );
+		return predicate;
+	}
+
+	explicit KeyPredicate( KeyPredicateKind kindIn = KEY_AND ) : kind( kindIn ), operand( 0 ), value( 0 ) {}
+};
+
+/**
+ * @brief Number of leaves whose insert run is tracked at the same time, see BTreeIndex::setSplitPolicy().
+ */
+const int SPLIT_RUN_SLOTS = 16;
+
+
+/**
+ * @brief Number of dirty index pages at which a checkpoint step flushes the index, see BTreeIndex::setCheckpointRate().
+ */
+const int DEFAULT_CHECKPOINT_PAGES = 64;
+
+/**
+ * @brief Number of inserts between two checkpoint steps, see BTreeIndex::setCheckpointRate().
+ */
+const int DEFAULT_CHECKPOINT_INTERVAL = 64;
+
+/**
+ * @brief Set to 1 to keep the number of leaf entries below every child of a non-leaf node.
+ * BTreeIndex::countRange() and BTreeIndex::keyAtRank() then read only O(height) pages, at the cost of non-leaf fanout.
+ */
+#ifndef BTREE_SUBTREE_COUNTS
+#define BTREE_SUBTREE_COUNTS 0
+#endif
+
+/**
+ * @brief Set to 1 to keep a KeyAggregate for every child of a non-leaf node and the included column in the leaves.
+ * BTreeIndex::aggregateRange() then only scans the two boundary leaves, at the cost of leaf and non-leaf fanout.
+ */
+#ifndef BTREE_SUBTREE_AGGREGATES
+#define BTREE_SUBTREE_AGGREGATES 0
+#endif
+
+/**
+ * @brief Aggregates over a set of index entries: the keys and the included column of the index.
+ * Kept per child in non-leaf nodes with BTREE_SUBTREE_AGGREGATES and returned by BTreeIndex::aggregateRange().
+ */
+struct KeyAggregate{
+  /**
+   * Number of entries.
+   */
+	int count;
+
+  /**
+   * Smallest and largest key. Only meaningful if count is not 0.
+   */
+	int minKey;
+	int maxKey;
+
+  /**
+   * Sum of the keys.
+   */
+	long long keySum;
+
+  /**
+   * Sum, smallest and largest value of the included column. Only meaningful if count is not 0.
+   */
+	double includeSum;
+	double includeMin;
+	double includeMax;
+
+	void clear()
+	{
+		count = 0;
+		minKey = maxKey = 0;
+		keySum = 0;
+		includeSum = includeMin = includeMax = 0;
+	}
+
+	void add( int key, double include )
+	{
+		if( !count || key < minKey ) minKey = key;
+		if( !count || key > maxKey ) maxKey = key;
+		if( !count || include < includeMin ) includeMin = include;
+		if( !count || include > includeMax ) includeMax = include;
+		count++;
+		keySum += key;
+		includeSum += include;
+	}
+
+	void combine( const KeyAggregate& other )
+	{
+		if( !other.count )
+			return;
+		if( !count || other.minKey < minKey ) minKey = other.minKey;
+		if( !count || other.maxKey > maxKey ) maxKey = other.maxKey;
+		if( !count || other.includeMin < includeMin ) includeMin = other.includeMin;
+		if( !count || other.includeMax > includeMax ) includeMax = other.includeMax;
+		count += other.count;
+		keySum += other.keySum;
+		includeSum += other.includeSum;
+	}
+};
+
+/**
+ * @brief Number of consecutive pages that make up one node. Larger nodes hold more keys, which lowers the tree and
+ * lets a scan get more entries out of every node it reads. An index file can only be opened with the node size
+ * it was built with. The tests in main.cpp are meant to be run built with BTREE_NODE_PAGES=2 as well.
+ */
+#ifndef BTREE_NODE_PAGES
+#define BTREE_NODE_PAGES 1
+#endif
+
+/**
+ * @brief Bytes in one node.
+ */
+const int NODE_SIZE = BTREE_NODE_PAGES * Page::SIZE;
 
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
+#if BTREE_SUBTREE_AGGREGATES
+//                                                  sibling ptr                      key               rid                 included column
+const  int INTARRAYLEAFSIZE = ( NODE_SIZE - sizeof( PageId ) - sizeof(int)) / ( sizeof( int ) + sizeof( RecordId ) + sizeof( double ) );
+#else
 //                                                  sibling ptr                      key               rid
-const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) - sizeof(int)) / ( sizeof( int ) + sizeof( RecordId ) );
+const  int INTARRAYLEAFSIZE = ( NODE_SIZE - sizeof( PageId ) - sizeof(int)) / ( sizeof( int ) + sizeof( RecordId ) );
+#endif
+
+/**
+ * @brief Bytes kept per child of a non-leaf node in addition to its key and page number.
+ */
+const  int NONLEAFSUMMARYSIZE = ( BTREE_SUBTREE_COUNTS ? sizeof( int ) : 0 ) + ( BTREE_SUBTREE_AGGREGATES ? sizeof( KeyAggregate ) : 0 );
 
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
-//                                                     level     extra pageNo                               key       pageNo
-const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) - sizeof(int) ) / ( sizeof( int ) + sizeof( PageId ) );
+//                                                     level     extra pageNo                      extra summary                     key       pageNo             summary
+const  int INTARRAYNONLEAFSIZE = ( NODE_SIZE - sizeof( int ) - sizeof( PageId ) - sizeof(int) - NONLEAFSUMMARYSIZE ) / ( sizeof( int ) + sizeof( PageId ) + NONLEAFSUMMARYSIZE );
+
+/**
+ * @brief Bits of IndexMetaInfo::nodeFormat, one for every optional part of the node layout.
+ */
+enum NodeFormat
+{
+	SUBTREE_COUNTS = 1,
+	SUBTREE_AGGREGATES = 2
+};
+
+/**
+ * @brief Node layout this build reads and writes. An index file built with a different layout cannot be opened.
+ */
+const int INDEX_NODE_FORMAT = ( BTREE_SUBTREE_COUNTS ? SUBTREE_COUNTS : 0 ) | ( BTREE_SUBTREE_AGGREGATES ? SUBTREE_AGGREGATES : 0 );
+
+/**
+ * @brief Version of the meta page layout written by this build, see IndexMetaInfo::metaVersion.
+ */
+const int INDEX_META_VERSION = 1;
 
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
@@ -128,6 +385,286 @@ struct IndexMetaInfo{
    * Page number of root page of the B+ Tree inside the file index file.
    */
 	PageId rootPageNo;
+
+  /**
+   * Sequence number of the last completed checkpoint. Every insert made up to this sequence number
+   * has reached the index file.
+   */
+	std::uint64_t checkpointLSN;
+
+  /**
+   * Optional node layout parts the index was built with, as NodeFormat bits.
+   */
+	int nodeFormat;
+
+  /**
+   * Offset of the included column inside the record, or -1 if the index has none.
+   */
+	int includeByteOffset;
+
+  /**
+   * Type of the included column.
+   */
+	Datatype includeType;
+
+  /**
+   * Bytes in a node, NODE_SIZE of the build that created the index.
+   */
+	int nodeSize;
+
+  /**
+   * INDEX_META_VERSION of the build that created the index. Files written before the fields after rootPageNo were
+   * added hold 0 in all of them, and are read as an index without optional node parts, without an included column
+   * and with single page nodes.
+   */
+	int metaVersion;
+};
+
+/**
+ * @brief Set to 0 to compile the BTreeIndex operation counters out. With 1 every counted event costs one increment.
+ */
+#ifndef BTREE_STATS
+#define BTREE_STATS 1
+#endif
+
+/**
+ * @brief Operation counters of one BTreeIndex, returned by BTreeIndex::stats().
+ * All counters stay 0 when the index is built with BTREE_STATS set to 0.
+*/
+struct IndexStats{
+  /**
+   * Buffer manager calls made for the index file.
+   */
+	std::uint64_t readPageCalls;
+	std::uint64_t allocPageCalls;
+	std::uint64_t unPinPageCalls;
+
+  /**
+   * readPage calls that found the page in the buffer pool, and those that had to read it from disk.
+   */
+	std::uint64_t bufferHits;
+	std::uint64_t bufferMisses;
+
+  /**
+   * Number of leaf and non-leaf node splits.
+   */
+	std::uint64_t leafSplits;
+	std::uint64_t internalSplits;
+
+  /**
+   * Key comparisons made by getIndexLeaf and getIndexNonLeaf.
+   */
+	std::uint64_t leafComparisons;
+	std::uint64_t nonLeafComparisons;
+
+  /**
+   * Leaf and non-leaf splits made at the insert position of an ascending or descending run instead of in half.
+   */
+	std::uint64_t skewedSplits;
+
+  /**
+   * Pages the kernel was asked to start reading ahead of time, by scans and prefetchKeys().
+   */
+	std::uint64_t prefetchedPages;
+
+  /**
+   * Inserts past the largest key made straight into the rightmost leaf, without a descent from the root.
+   */
+	std::uint64_t appendInserts;
+
+  /**
+   * Number of times a new root was created.
+   */
+	std::uint64_t rootChanges;
+
+  /**
+   * Number of nodes emptied into their left neighbour and removed by compact().
+   */
+	std::uint64_t nodeMerges;
+
+  /**
+   * Number of scans started, leaves visited by all of them and by the latest one.
+   */
+	std::uint64_t scans;
+	std::uint64_t scanLeavesVisited;
+	std::uint64_t lastScanLeavesVisited;
+
+  /**
+   * Scans started at a leaf predicted by learned routing, and those that took the non-leaf nodes because the
+   * prediction was off by more than the error bound.
+   */
+	std::uint64_t learnedLookups;
+	std::uint64_t learnedFallbacks;
+
+  /**
+   * Scans started at a leaf found through the front index.
+   */
+	std::uint64_t frontIndexLookups;
+
+  /**
+   * Entries in the range of a scan that its key predicate left out.
+   */
+	std::uint64_t scanEntriesFiltered;
+
+  /**
+   * Keys looked up by probeSorted(), and the descents from the root it made for them.
+   */
+	std::uint64_t probeKeys;
+	std::uint64_t probeDescents;
+
+	void clear()
+	{
+		memset( this, 0, sizeof( IndexStats ) );
+	}
+};
+
+/**
+ * @brief Index operations that have a latency histogram, see BTreeIndex::latencyHistogram().
+ */
+enum IndexOperation
+{
+	OP_INSERT_ENTRY = 0,
+	OP_START_SCAN = 1,
+	OP_SCAN_NEXT = 2,
+	OP_BUILD = 3,
+	NUM_INDEX_OPERATIONS = 4
+};
+
+/**
+ * @brief Number of linear sub-buckets per power of two in a LatencyHistogram, as a power of two.
+ */
+const int LATENCY_SUB_BUCKET_BITS = 4;
+const int LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BUCKET_BITS;
+
+/**
+ * @brief Number of powers of two covered by a LatencyHistogram. Larger values are counted in the last bucket.
+ */
+const int LATENCY_MAGNITUDES = 40;
+
+/**
+ * @brief Latency histogram in nanoseconds in the style of HdrHistogram. Values are bucketed by power of two and every
+ * power of two is split into LATENCY_SUB_BUCKETS linear sub-buckets, so values are kept with about 6% precision
+ * in constant space, from nanoseconds up to hours.
+ */
+class LatencyHistogram{
+public:
+	LatencyHistogram()
+	{
+		clear();
+	}
+
+  /**
+   * Forget all recorded values.
+   */
+	void clear();
+
+  /**
+   * Record one value.
+   * @param nanos  the value in nanoseconds
+   */
+	void record( std::uint64_t nanos );
+
+  /**
+   * Value below or at which a fraction of the recorded values lie, rounded up to the end of its bucket.
+   * @param fraction  between 0 and 1, e.g. 0.99 for p99
+   */
+	std::uint64_t percentile( double fraction ) const;
+
+	std::uint64_t count() const { return total; }
+	std::uint64_t max() const { return maxValue; }
+
+private:
+	static int bucketOf( std::uint64_t nanos );
+	static std::uint64_t bucketEnd( int bucket );
+
+	std::uint64_t buckets[ LATENCY_SUB_BUCKETS * ( LATENCY_MAGNITUDES + 1 ) ];
+	std::uint64_t total;
+	std::uint64_t maxValue;
+};
+
+/**
+ * @brief Maximum number of page numbers kept by one OperationTrace.
+ */
+const int MAX_TRACE_PAGES = 256;
+
+/**
+ * @brief What a slow index operation did, captured by the trace buffer of BTreeIndex.
+ */
+struct OperationTrace{
+  /**
+   * The operation and its latency in nanoseconds.
+   */
+	IndexOperation op;
+	std::uint64_t nanos;
+
+  /**
+   * Pages read, in order, up to MAX_TRACE_PAGES of them.
+   */
+	std::vector<PageId> pagesVisited;
+
+  /**
+   * Splits and buffer misses during the operation.
+   */
+	std::uint64_t leafSplits;
+	std::uint64_t internalSplits;
+	std::uint64_t bufferMisses;
+};
+
+/**
+ * @brief Number of buckets of a fill factor histogram, each covering an equal share of a node.
+ */
+const int FILL_HISTOGRAM_BUCKETS = 10;
+
+/**
+ * @brief Shape of one level of the tree, part of an IndexStructure.
+ */
+struct LevelStructure{
+  /**
+   * Number of nodes on the level.
+   */
+	int nodes;
+
+  /**
+   * Number of keys held by the nodes of the level, and the number of key slots they have.
+   */
+	long long keys;
+	long long capacity;
+
+  /**
+   * Number of nodes by fill factor. Bucket b counts the nodes filled to [b, b + 1) / FILL_HISTOGRAM_BUCKETS,
+   * full nodes are counted in the last bucket.
+   */
+	int fillHistogram[ FILL_HISTOGRAM_BUCKETS ];
+
+	double fillFactor() const { return capacity ? (double)keys / capacity : 0; }
+};
+
+/**
+ * @brief Shape of the tree and physical order of its leaves, returned by BTreeIndex::analyze().
+ */
+struct IndexStructure{
+  /**
+   * Number of levels, the leaf level included.
+   */
+	int height;
+
+  /**
+   * One entry per level, root first and leaves last.
+   */
+	std::vector<LevelStructure> levels;
+
+  /**
+   * Right sibling links from a leaf to the page right after it in the index file, to a page further on,
+   * and to a page before it. A scan reads the file sequentially only along the first kind.
+   */
+	int sequentialLinks;
+	int forwardLinks;
+	int backwardLinks;
+
+  /**
+   * Sum over all right sibling links of the distance in pages between the two leaves.
+   */
+	long long linkDistance;
 };
 
 /*
@@ -156,6 +693,20 @@ struct NonLeafNodeInt{
    */
 	PageId pageNoArray[ INTARRAYNONLEAFSIZE + 1 ];
 
+#if BTREE_SUBTREE_COUNTS
+  /**
+   * Stores the number of leaf entries in the subtree of each child page.
+   */
+	int countArray[ INTARRAYNONLEAFSIZE + 1 ];
+#endif
+
+#if BTREE_SUBTREE_AGGREGATES
+  /**
+   * Stores the aggregates over the leaf entries in the subtree of each child page.
+   */
+	KeyAggregate aggArray[ INTARRAYNONLEAFSIZE + 1 ];
+#endif
+
   /**
    * Stores the number of keys.
    */
@@ -168,140 +719,544 @@ struct NonLeafNodeInt{
 */
 struct LeafNodeInt{
   /**
-   * Stores keys.
+   * Stores keys.
+   */
+	int keyArray[ INTARRAYLEAFSIZE ];
+
+  /**
+   * Stores RecordIds.
+   */
+	RecordId ridArray[ INTARRAYLEAFSIZE ];
+
+#if BTREE_SUBTREE_AGGREGATES
+  /**
+   * Stores the value of the included column of each record.
+   */
+	double includeArray[ INTARRAYLEAFSIZE ];
+#endif
+
+  /**
+   * Page number of the leaf on the right side.
+	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   */
+	PageId rightSibPageNo;
+
+  /**
+   * Stores the number of keys.
+   */
+  int size;
+};
+
+
+/**
+ * @brief Linear model over a run of consecutive leaves, used by learned routing. A key is predicted to fall into leaf
+ * firstLeaf + slope * (key - firstKey), counting leaves from the leftmost one.
+*/
+struct LeafSegment{
+  /**
+   * Largest key of the first leaf of the run when the model was fitted.
+   */
+	int firstKey;
+
+  /**
+   * Position of the first leaf of the run.
+   */
+	int firstLeaf;
+
+  /**
+   * Leaves per key.
+   */
+	double slope;
+
+  /**
+   * Error added by splits and inserts since the model was fitted, on top of the error bound.
+   */
+	int drift;
+};
+
+/**
+ * @brief Sub-ranges of a parallel scan and the state shared by the threads working on them.
+ */
+struct ScanTaskQueue;
+
+/**
+ * @brief Heap pages of a parallel build and the sorted runs its threads produce.
+ */
+struct BuildQueue;
+
+/**
+ * @brief In-memory radix tree from the separator keys to the leaves, see BTreeIndex::setFrontIndex().
+ */
+class AdaptiveRadixTree;
+
+/**
+ * @brief A node of BTREE_NODE_PAGES pages copied into one buffer, while the buffer manager holds its pages.
+ */
+struct NodeExtent;
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
+ * relation. This index supports only one scan at a time.
+*/
+class BTreeIndex {
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Read-only mapping of the index file and its length, NULL unless the index was opened with OPEN_READ_ONLY_MAPPED.
+   * Nodes are read straight from the mapping and the file object is not used.
+   */
+	char		*mappedData;
+	size_t	mappedSize;
+
+  /**
+   * Read-only descriptor of the index file used to hint the kernel about pages that will be read soon, -1 if none.
+   */
+	int			prefetchFd;
+
+  /**
+   * Serializes page reads of the threads of a parallel scan, since the buffer manager and the counters are not thread safe.
+   */
+	std::mutex	pageLatch;
+
+  /**
+   * Buffers of the pinned nodes, by page number of their first page, when nodes span several pages.
+   */
+	std::map<PageId, NodeExtent *>	nodeExtents;
+
+  /**
+   * Buffers given back by the last unpin of their node, reused by the next nodes pinned.
+   */
+	std::vector<NodeExtent *>	spareExtents;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file.
+   */
+	PageId	rootPageNum;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+	Datatype	attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records. 
+   */
+	int 		attrByteOffset;
+
+  /**
+   * Number of keys in leaf node, depending upon the type of key.
+   */
+	int			leafOccupancy;
+
+  /**
+   * Number of keys in non-leaf node, depending upon the type of key.
+   */
+	int			nodeOccupancy;
+
+  /**
+   * Offset of the included column inside records, or -1 if the index has none.
+   */
+	int			includeByteOffset;
+
+  /**
+   * Datatype of the included column.
+   */
+	Datatype	includeType;
+
+  /**
+   * Included column value of the entry being inserted.
+   */
+	double	insertIncludeVal;
+
+
+	// MEMBERS SPECIFIC TO SCANNING
+
+  /**
+   * True if an index scan has been started.
+   */
+	bool		scanExecuting;
+
+  /**
+   * Index of next entry to be scanned in current leaf being scanned.
+   */
+	int			nextEntry;
+
+  /**
+   * Page number of current page being scanned.
+   */
+	PageId	currentPageNum;
+
+  /**
+   * Current Page being scanned.
+   */
+	Page		*currentPageData;
+
+  /**
+   * Low INTEGER value for scan.
+   */
+	int			lowValInt;
+
+  /**
+   * Low DOUBLE value for scan.
+   */
+	double	lowValDouble;
+
+  /**
+   * Low STRING value for scan.
+   */
+	std::string	lowValString;
+
+  /**
+   * High INTEGER value for scan.
+   */
+	int			highValInt;
+
+  /**
+   * High DOUBLE value for scan.
+   */
+	double	highValDouble;
+
+  /**
+   * High STRING value for scan.
+   */
+	std::string highValString;
+	
+  /**
+   * Low Operator. Can only be GT(>) or GTE(>=).
+   */
+	Operator	lowOp;
+
+  /**
+   * High Operator. Can only be LT(<) or LTE(<=).
+   */
+	Operator	highOp;
+
+  /**
+   * True if the scan has leaves left to read ahead, starting with the leaf above key readAheadKey.
+   */
+	bool		readAheadMore;
+	int			readAheadKey;
+
+  /**
+   * Leaves read ahead that the scan has not reached yet.
+   */
+	int			leavesReadAhead;
+
+  /**
+   * Key predicate of the scan, if scanFiltered.
+   */
+	KeyPredicate	scanFilter;
+	bool		scanFiltered;
+
+  /**
+   * Slots of the current leaf that satisfy the scan, from the entry the scan was at when the leaf was reached, and
+   * the position of the next one to return.
+   */
+	std::vector<int>	scanSelection;
+	size_t	scanSelectionNext;
+
+  /**
+   * True if the current leaf holds a key above the range, so the scan ends with it.
+   */
+	bool		scanLastLeaf;
+
+
+	// MEMBERS SPECIFIC TO CHECKPOINTING
+
+  /**
+   * Sequence number of the last insert applied to the index.
+   */
+	std::uint64_t	currentLSN;
+
+  /**
+   * Sequence number recorded by the last completed checkpoint.
+   */
+	std::uint64_t	checkpointLSN;
+
+  /**
+   * Pages dirtied since the last checkpoint.
+   */
+	std::set<PageId>	dirtyPages;
+
+  /**
+   * Number of dirty pages at which a checkpoint step flushes the index. 0 disables the checkpoint steps.
+   */
+	int			checkpointDirtyPages;
+
+  /**
+   * Pins handed out by readIndexPage() and allocIndexPage() and not given back yet. The index file can only be
+   * flushed while there are none.
+   */
+	int			pinnedPages;
+
+  /**
+   * Number of inserts between two checkpoint steps.
+   */
+	int			checkpointInterval;
+
+  /**
+   * Number of inserts since the last checkpoint step.
+   */
+	int			opsSinceCheckpoint;
+
+  /**
+   * True if the insert in progress split a node.
+   */
+	bool		structureChanged;
+
+  /**
+   * How full nodes are split.
+   */
+	SplitPolicy	splitPolicy;
+
+  /**
+   * Length of the insert run of recently filled leaves, by page number modulo SPLIT_RUN_SLOTS. A run is positive for
+   * consecutive inserts past the largest key of the leaf and negative for consecutive inserts before its smallest key.
+   */
+	PageId	runPages[ SPLIT_RUN_SLOTS ];
+	int			runLengths[ SPLIT_RUN_SLOTS ];
+
+  /**
+   * Direction of the leaf split in progress: 1 if it left the new entry alone at the right end, -1 if at the left end,
+   * 0 if it split in half. Non-leaf splits caused by it follow the same direction.
+   */
+	int			skewedSplit;
+
+  /**
+   * Rightmost leaf and the non-leaf pages on the path to it, root first, for appends past the largest key.
+   * 0 if not known, e.g. after a split of one of these pages.
+   */
+	PageId	appendLeafNum;
+	std::vector<PageId>	appendPath;
+
+  /**
+   * Number of entries and largest key of the rightmost leaf, kept up to date by every insert into it, so that an insert
+   * can tell whether it is an append without reading the leaf.
+   */
+	int			appendLeafSize;
+	int			appendLeafMaxKey;
+
+
+	// MEMBERS SPECIFIC TO LEARNED ROUTING
+
+  /**
+   * Error bound, in leaves, of the models in learnedSegments. 0 if learned routing is off.
    */
-	int keyArray[ INTARRAYLEAFSIZE ];
+	int			learnedMaxError;
 
   /**
-   * Stores RecordIds.
+   * Page number and largest key of every leaf, from left to right.
    */
-	RecordId ridArray[ INTARRAYLEAFSIZE ];
+	std::vector<PageId>	learnedLeafPages;
+	std::vector<int>	learnedLeafMaxKeys;
 
   /**
-   * Page number of the leaf on the right side.
-	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   * Models over the leaves, by position of their first leaf.
    */
-	PageId rightSibPageNo;
+	std::vector<LeafSegment>	learnedSegments;
 
   /**
-   * Stores the number of keys.
+   * Leaf the insert in progress put its entry into, and the leaf it split with the leaf created by the split, 0 if none.
    */
-  int size;
-};
+	PageId	insertLeafNum;
+	PageId	splitLeafNum;
+	PageId	splitNewLeafNum;
 
 
-/**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
- * relation. This index supports only one scan at a time.
-*/
-class BTreeIndex {
+	// MEMBERS SPECIFIC TO THE FRONT INDEX
 
- private:
+  /**
+   * Separator key to the leaf right of it, for every separator. NULL if the front index is off.
+   */
+	AdaptiveRadixTree	*frontIndex;
 
   /**
-   * File object for the index file.
+   * Leftmost leaf, which no separator leads to.
    */
-	File		*file;
+	PageId	frontFirstLeaf;
 
   /**
-   * Buffer Manager Instance.
+   * Operation counters, see stats(). The threads of a parallel scan or build update them under pageLatch, which
+   * they hold for every buffer manager call anyway.
    */
-	BufMgr	*bufMgr;
+	IndexStats	statCounters;
 
   /**
-   * Page number of meta page.
+   * Latency histogram of each IndexOperation.
    */
-	PageId	headerPageNum;
+	LatencyHistogram	latencies[ NUM_INDEX_OPERATIONS ];
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Operations slower than this many nanoseconds are kept in slowTraces.
    */
-	PageId	rootPageNum;
+	std::uint64_t	traceThreshold;
 
   /**
-   * Datatype of attribute over which index is built.
+   * Maximum number of traces kept. 0 disables tracing.
    */
-	Datatype	attributeType;
+	int			traceCapacity;
 
   /**
-   * Offset of attribute, over which index is built, inside records. 
+   * Latest traces of slow operations, oldest first.
    */
-	int 		attrByteOffset;
+	std::deque<OperationTrace>	slowTraces;
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * Trace of the operation in progress and whether one is being collected.
    */
-	int			leafOccupancy;
+	OperationTrace	currentTrace;
+	bool		tracing;
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Times one operation for its latency histogram and collects its trace if tracing is on. Records in its
+   * destructor, so operations that end with an exception are measured as well.
    */
-	int			nodeOccupancy;
+	class OperationTimer
+	{
+	 public:
+		OperationTimer(BTreeIndex *index, IndexOperation op);
+		~OperationTimer();
 
+	 private:
+		BTreeIndex *index;
+		IndexOperation op;
+		bool traced;
+		std::chrono::steady_clock::time_point start;
+	};
 
-	// MEMBERS SPECIFIC TO SCANNING
+  /**
+   * Read a page of the index file through the buffer manager and count the call.
+   * A node of several pages is pinned as a whole and returned as one buffer, which is only good until the last unpin
+   * of the node.
+   * @param pageNo  page to read
+   * @param page    the pinned page returned in this
+  **/
+	void readIndexPage(PageId pageNo, Page *&page);
 
   /**
-   * True if an index scan has been started.
-   */
-	bool		scanExecuting;
+   * Number of pages of a node, 1 for the meta page.
+   * @param pageNo  first page of the node
+  **/
+	int nodePages(PageId pageNo) const;
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
-   */
-	int			nextEntry;
+   * Buffer for a node being pinned, a spare one when there is one.
+   * @return  the buffer, with no pins
+  **/
+	NodeExtent *takeNodeExtent();
 
   /**
-   * Page number of current page being scanned.
-   */
-	PageId	currentPageNum;
+   * Map the index file read-only into memory, for OPEN_READ_ONLY_MAPPED.
+   * @param indexName  name of the index file
+   * @throws  FileNotFoundException If the index file does not exist or cannot be mapped.
+  **/
+	void mapIndexFile(const std::string & indexName);
 
   /**
-   * Current Page being scanned.
-   */
-	Page		*currentPageData;
+   * Release the mapping made by mapIndexFile(), if any.
+  **/
+	void unmapIndexFile();
 
   /**
-   * Low INTEGER value for scan.
-   */
-	int			lowValInt;
+   * Ask the kernel to start reading pages of the index file without waiting for them. All requests are in flight at
+   * the same time, so later reads through the buffer manager or the mapping find the pages in memory.
+   * @param pages  pages to read, in any order
+  **/
+	void prefetchIndexPages(std::vector<PageId> pages);
 
   /**
-   * Low DOUBLE value for scan.
-   */
-	double	lowValDouble;
+   * Issue the next read-ahead batch of the scan in progress: up to SCAN_READ_AHEAD leaves of the range, starting with
+   * the one that holds key. The leaves are taken from their level 1 parent, so they are known before the chain gets there.
+   * @param key  smallest key of the first leaf to read ahead
+   * @return  number of leaves read ahead
+  **/
+	int readAheadLeaves(int key);
 
   /**
-   * Low STRING value for scan.
-   */
-	std::string	lowValString;
+   * Refuse to modify an index opened with OPEN_READ_ONLY_MAPPED.
+   * @throws  BadgerDbException If the index is read-only.
+  **/
+	void checkWritable() const;
 
   /**
-   * High INTEGER value for scan.
-   */
-	int			highValInt;
+   * Allocate a page in the index file through the buffer manager and count the call.
+   * A node of several pages gets consecutive pages.
+   * @param pageNo  number of the new page returned in this
+   * @param page    the pinned page returned in this
+  **/
+	void allocIndexPage(PageId &pageNo, Page *&page);
 
   /**
-   * High DOUBLE value for scan.
-   */
-	double	highValDouble;
+   * Unpin a page of the index file. Pages unpinned dirty are counted by the checkpointer.
+   * @param pageNo  page to unpin
+   * @param dirty   true if the page was modified
+  **/
+	void unPinIndexPage(PageId pageNo, bool dirty);
 
   /**
-   * High STRING value for scan.
-   */
-	std::string highValString;
-	
+   * Insert an entry into the rightmost leaf without a descent from the root, if the key is larger than every key
+   * in the index and the leaf has room for it. Finds the rightmost leaf first if it is not known.
+   * @param key  key to insert
+   * @param rid  RecordId to insert
+   * @return true if the entry was inserted
+  **/
+	bool appendToRightmostLeaf(const void* key, const RecordId rid);
+
   /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
-   */
-	Operator	lowOp;
+   * Follow the last child of every non-leaf node from the root down and remember the pages visited as appendPath
+   * and the leaf reached as appendLeafNum, with its number of entries and largest key.
+  **/
+	void cacheRightmostPath();
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
-   */
-	Operator	highOp;
+   * Called when a page is split. Forgets the rightmost path if the page is on it.
+   * @param pageNo  page being split
+  **/
+	void forgetRightmostPath(PageId pageNo);
+
+  /**
+   * Extend or restart the insert run of a leaf.
+   * @param pageNo  the leaf
+   * @param index   position the new entry is inserted at
+   * @param size    number of entries in the leaf before the insert
+  **/
+	void recordInsertPosition(PageId pageNo, int index, int size);
+
+  /**
+   * Insert run of a leaf, 0 if none is tracked.
+   * @param pageNo  the leaf
+  **/
+	int insertRunOf(PageId pageNo) const;
+
+  /**
+   * Drop an unpinned page that is no longer part of the tree from the buffer pool and from the checkpointer.
+   * BlobFile does not reuse page numbers, so the index file does not shrink.
+   * @param pageNo  page to drop
+  **/
+	void freeIndexPage(PageId pageNo);
+
+  /**
+   * Write the meta page with the checkpoint that just completed straight to the index file.
+   * @param lsn     sequence number covered by the checkpoint
+  **/
+	void writeCheckpointRecord(std::uint64_t lsn);
 
-	
  public:
 
   /**
@@ -314,10 +1269,21 @@ class BTreeIndex {
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
    * @param attrType						Datatype of attribute over which index is built
+   * @param includeByteOffset	Offset of a column to aggregate along with the key (see aggregateRange()), or -1 for none
+   * @param includeType				Datatype of the included column, INTEGER or DOUBLE
+   * @param openMode					OPEN_READ_ONLY_MAPPED to map an existing index read-only instead of going through the buffer manager,
+   *                            OPEN_CREATE_EMPTY to create a missing index without indexing the relation
+   * @param buildThreads				Threads that build a new index, 0 for one per core. With more than one, the threads read
+   *                            the relation in chunks of pages and sort their entries, and the tree is loaded bottom up
+   *                            from the merged runs with full nodes. 1 inserts the records one by one.
    * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+   * @throws  BadIndexInfoException     If there is an included column that is neither INTEGER nor DOUBLE.
+   * @throws  FileNotFoundException     If the index is opened with OPEN_READ_ONLY_MAPPED but its file does not exist.
    */
 	BTreeIndex(const std::string & relationName, std::string & outIndexName,
-						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType);
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType,
+						const int includeByteOffset = -1, const Datatype includeType = DOUBLE,
+						const IndexOpenMode openMode = OPEN_READ_WRITE, const int buildThreads = 1);
 	
 
   /**
@@ -337,8 +1303,19 @@ class BTreeIndex {
 	 * Make sure to unpin pages as soon as you can.
    * @param key			Key to insert, pointer to integer/double/char string
    * @param rid			Record ID of a record whose entry is getting inserted into the index.
+   * @param includeVal	Value of the included column of the record, if the index has one.
+   * @throws  BadgerDbException If the index was opened with OPEN_READ_ONLY_MAPPED.
 	**/
-	const void insertEntry(const void* key, const RecordId rid);
+	const void insertEntry(const void* key, const RecordId rid, const double includeVal = 0);
+
+  /**
+   * Insert the entry of a record. The key and the included column are read from the record bytes in place,
+   * so a caller holding the record does not have to pull them out first.
+   * @param record  the record, laid out as in the relation
+   * @param rid     Record ID of the record
+   * @throws  BadgerDbException If the index was opened with OPEN_READ_ONLY_MAPPED.
+  **/
+	const void insertRecord(const char* record, const RecordId rid);
 
 
   /**
@@ -352,11 +1329,13 @@ class BTreeIndex {
    * @param lowOp		Low operator (GT/GTE)
    * @param highVal	High value of range, pointer to integer / double / char string
    * @param highOp	High operator (LT/LTE)
+   * @param filter	Predicate the keys must also satisfy, NULL for none. Copied, so it may go away before the scan.
    * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
    * @throws  BadScanrangeException If lowVal > highval
 	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
 	**/
-	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+						 const KeyPredicate* filter = NULL);
 
 
   /**
@@ -368,12 +1347,63 @@ class BTreeIndex {
 	**/
 	const void scanNext(RecordId& outRid);  // returned record id
 
+  /**
+   * Fetch the record ids of the next index entries that match the scan, as scanNext() would one at a time.
+   * The keys of a leaf are tested against the range and the filter a whole leaf at a time, so this is the cheap way to
+   * drain a selective scan.
+   * @param outRids	filled with up to maxRids record ids
+   * @param maxRids	largest number of record ids to return
+   * @return number of record ids returned, at least 1
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+  **/
+	const int scanNextBatch(RecordId* outRids, int maxRids);
+
   /**
 	 * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
 	 * @throws ScanNotInitializedException If no scan has been initialized.
 	**/
 	const void endScan();
 
+  /**
+   * Scan a range with several threads. The range is cut into sub-ranges at separator keys of the non-leaf levels, and
+   * each thread scans sub-ranges until none is left, so a thread that finishes early takes over from the slower ones.
+   * Partitions are in key order, each holding the record ids of one sub-range. Independent of startScan/scanNext;
+   * no entry may be inserted while the scan runs.
+   * @param lowVal      Low value of range, pointer to integer
+   * @param lowOp       Low operator (GT/GTE)
+   * @param highVal     High value of range, pointer to integer
+   * @param highOp      High operator (LT/LTE)
+   * @param threads     number of threads, 0 for one per core
+   * @param partitions  filled with the record ids found, one vector per sub-range
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+  **/
+	const void parallelScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+							int threads, std::vector<std::vector<RecordId> >& partitions);
+
+  /**
+   * Scan a range with several threads, see above, and return the record ids merged in key order.
+   * @param outRids  filled with the record ids found
+  **/
+	const void parallelScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+							int threads, std::vector<RecordId>& outRids);
+
+  /**
+   * Build several indexes over one relation with a single read of the relation. Every record is read once, its keys
+   * go to one sorted run per index and thread, and each index is then loaded bottom up from its runs. Indexes whose
+   * file exists already are opened as with OPEN_READ_WRITE and left as they are, unless they are empty.
+   * @param relationName  Name of the relation
+   * @param bufMgr        Buffer Manager Instance
+   * @param specs         the indexes to build
+   * @param indexes       filled with the opened indexes, in the order of specs. The caller deletes them.
+   * @param indexNames    filled with the names of the index files, in the order of specs
+   * @param buildThreads  threads that read the relation, 0 for one per core
+  **/
+	static const void buildIndexes(const std::string& relationName, BufMgr* bufMgr, const std::vector<IndexSpec>& specs,
+								   std::vector<BTreeIndex*>& indexes, std::vector<std::string>& indexNames,
+								   const int buildThreads = 1);
+
   /**
    * Helper function for insertEntry. Find the position in the tree to insert. 
    * @param key       key to be inserted
@@ -441,6 +1471,379 @@ class BTreeIndex {
 
   const bool inRange(int value);
 
+  /**
+   * Make scanSelection hold entries of the scan that have not been returned yet, moving right across the leaves as
+   * far as needed.
+   * @return false if no entry is left
+  **/
+  bool nextScanSelection();
+
+  /**
+   * Run one checkpoint step. Once maxPages pages of the index are dirty and none is pinned, the index file is
+   * flushed through the buffer manager, which writes every dirty page once and leaves its frame clean, and the
+   * sequence number of the last insert is recorded in the meta page. Closing the index then only writes the pages
+   * dirtied since. The flushed pages leave the buffer pool and are read back when they are needed again.
+   * Called every checkpointInterval inserts once setCheckpointRate() has turned it on; may also be called directly
+   * by the owner of the index.
+   * @param maxPages  number of dirty pages needed for a checkpoint, 0 or a negative number for any
+   * @return true if a checkpoint completed during this step
+  **/
+  const bool checkpoint(int maxPages);
+
+  /**
+   * Set how often the index is checkpointed along the inserts. Checkpoint steps are off until this is called.
+   * @param dirtyPages  number of dirty pages at which a checkpoint step flushes the index, 0 disables the steps
+   * @param interval    number of inserts between two checkpoint steps
+  **/
+  const void setCheckpointRate(int dirtyPages = DEFAULT_CHECKPOINT_PAGES, int interval = DEFAULT_CHECKPOINT_INTERVAL);
+
+  /**
+   * Choose how full nodes are split. With SPLIT_ADAPTIVE, a leaf that received a run of inserts past its largest key
+   * is split by starting a new empty leaf for the new entry, so append workloads leave full leaves behind. A run before
+   * the smallest key is handled the mirror way. Other splits, and all splits with SPLIT_EVEN, are made in half.
+   * @param policy  the split policy, SPLIT_ADAPTIVE by default
+  **/
+  const void setSplitPolicy(SplitPolicy policy);
+
+  /**
+   * Route scans with piecewise linear models fitted over the largest key of every leaf, instead of descending through
+   * the non-leaf nodes. A model predicts the leaf, which is searched for within the error bound, and interpolation
+   * inside the leaf predicts the slot. Splits and inserts adjust the models, and a model is fitted again once its
+   * error grows past twice the bound. A prediction found to be off by more falls back to the non-leaf nodes.
+   * Works best on smooth keys, such as ids and timestamps. Compaction fits the models again.
+   * @param maxError  error bound of a model in leaves, 0 turns learned routing off
+  **/
+  const void setLearnedRouting(int maxError);
+
+  /**
+   * Keep an in-memory adaptive radix tree over the separator keys, mapping every separator to the leaf on its right.
+   * It is built from the non-leaf nodes, without reading the leaves, and leaf splits add their separators to it.
+   * Scans then find their first leaf with one radix tree lookup instead of a descent through the non-leaf nodes.
+   * Meant for indexes whose non-leaf levels would be cached anyway. Compaction builds it again.
+   * @param enable  true to build the front index, false to drop it
+  **/
+  const void setFrontIndex(bool enable);
+
+  /**
+   * Prepare a batch of lookups. The keys are routed down the tree together, one level at a time, and the pages each level
+   * needs are requested from the disk at once, so a batch of cold lookups waits for one round of reads per level
+   * instead of one read per page.
+   * @param keys   keys that will be looked up
+   * @param count  number of keys
+  **/
+  const void prefetchKeys(const int* keys, int count);
+
+  /**
+   * Find the entries of a batch of keys, as for the inner side of an index nested loop join. The keys are sorted, so
+   * every leaf is reached with one descent from the root, shared by all the keys it holds, and the entries of the
+   * keys are found by walking the leaf forward from one key to the next.
+   * @param keys      keys to look up, in ascending order, repeated as often as needed
+   * @param tags      one value per key, paired with every entry of the key (the record id of the outer tuple)
+   * @param count     number of keys
+   * @param outPairs  a <tag, record id of the entry> pair per entry of every key is appended here, in key order
+   * @return number of pairs appended
+  **/
+  const int probeSorted(const int* keys, const RecordId* tags, int count,
+                        std::vector<std::pair<RecordId, RecordId> >& outPairs);
+
+  /**
+   * Sequence number of the last completed checkpoint.
+  **/
+  std::uint64_t getCheckpointLSN() const { return checkpointLSN; }
+
+  /**
+   * Count the entries that satisfy a range. The range is given the same way as for startScan().
+   * With BTREE_SUBTREE_COUNTS this reads one root-to-leaf path per bound, otherwise it walks the leaves in the range.
+   * Does not disturb a scan in progress.
+   * @param lowVal	Low value of range, pointer to integer
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer
+   * @param highOp	High operator (LT/LTE)
+   * @return number of entries in the range
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+  **/
+  const int countRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+  /**
+   * Find the entry at a given position in key order.
+   * With BTREE_SUBTREE_COUNTS this reads one root-to-leaf path, otherwise it walks the leaves from the left.
+   * @param rank    0-based position of the entry
+   * @param outKey  key of the entry returned in this, pointer to integer
+   * @param outRid  RecordId of the entry returned in this
+   * @throws  NoSuchKeyFoundException If rank is negative or not smaller than the number of entries.
+  **/
+  const void keyAtRank(const int rank, void* outKey, RecordId& outRid);
+
+  /**
+   * Snapshot of the operation counters of this index.
+   * @param reset  set all counters back to 0 after taking the snapshot
+   * @return the counters
+  **/
+  IndexStats stats(bool reset = false);
+
+  /**
+   * Latency histogram of one kind of operation. OP_BUILD holds one value per index built by the constructor.
+   * Stays empty when the index is built with BTREE_STATS set to 0.
+   * @param op  the operation
+  **/
+  const LatencyHistogram& latencyHistogram(IndexOperation op) const { return latencies[op]; }
+
+  /**
+   * Clear all latency histograms.
+  **/
+  const void resetLatencyHistograms();
+
+  /**
+   * Keep a trace of the pages visited, the splits and the buffer misses of every insertEntry, startScan and scanNext
+   * call that takes longer than a threshold. Only the latest traces are kept.
+   * @param thresholdNanos  minimum latency of a traced operation in nanoseconds
+   * @param capacity        number of traces kept, 0 turns tracing off
+  **/
+  const void setSlowOperationTrace(std::uint64_t thresholdNanos, int capacity);
+
+  /**
+   * Traces of the latest slow operations, oldest first.
+  **/
+  std::vector<OperationTrace> slowOperations() const { return std::vector<OperationTrace>(slowTraces.begin(), slowTraces.end()); }
+
+  /**
+   * Compute count, MIN, MAX and SUM of the keys and of the included column over a range. The range is given
+   * the same way as for startScan(); AVG is sum / count.
+   * With BTREE_SUBTREE_AGGREGATES the aggregates of fully covered subtrees are combined and only the two boundary
+   * leaves are scanned. Otherwise every leaf in the range is scanned and the included column aggregates stay 0.
+   * Does not disturb a scan in progress.
+   * @param lowVal	Low value of range, pointer to integer
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer
+   * @param highOp	High operator (LT/LTE)
+   * @param outAgg	aggregates over the entries in the range returned in this
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+  **/
+  const void aggregateRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp, KeyAggregate& outAgg);
+
+  /**
+   * Walk the whole tree and report its height, the number of nodes and keys and the fill factor distribution
+   * of every level, and how the leaf chain is laid out in the index file.
+   * Does not disturb a scan in progress.
+   * @return the structure of the tree
+  **/
+  IndexStructure analyze();
+
+  /**
+   * Compact the tree in place, so that scans read fewer pages. The entries below every non-leaf node are packed to the
+   * left until each child is filled to maxFill, and children left empty are removed from the tree. The non-leaf levels
+   * are packed from the bottom up. A root left with a single non-leaf child is replaced by that child.
+   * Ends a scan in progress.
+   * @param maxFill  fill factor to pack the nodes to, between 0 and 1
+   * @return number of pages removed from the tree
+   * @throws  BadgerDbException If the index was opened with OPEN_READ_ONLY_MAPPED.
+  **/
+  const int compact(double maxFill = 1.0);
+
+  /**
+   * Write the entries of the index, in key order, into an immutable snapshot file to be opened with BTreeSnapshot.
+   * The snapshot does not follow later inserts, it is exported again to pick them up.
+   * @param snapshotName  Name of the snapshot file, replaced if it exists
+   * @param compress      True to compress the leaves of the snapshot, for indexes that are mostly cold
+   * @return number of entries written
+  **/
+  const int exportSnapshot(const std::string& snapshotName, const bool compress = false);
+
+ private:
+
+  /**
+   * Pack the entries of the children of a non-leaf node to the left and remove the children left empty,
+   * compacting non-leaf children below it first.
+   * @param pageNo          the non-leaf node
+   * @param maxLeafKeys     number of entries to fill a leaf to
+   * @param maxNonLeafKeys  number of keys to fill a non-leaf node to
+   * @return number of pages removed from the tree
+  **/
+  int compactChildren(PageId pageNo, int maxLeafKeys, int maxNonLeafKeys);
+
+  /**
+   * Collect the page number and largest key of every leaf and fit the learned models over them.
+  **/
+  void buildLearnedRouting();
+
+  /**
+   * Fit models with error learnedMaxError over a run of leaves, greedily making each one as long as possible.
+   * @param first     position of the first leaf of the run
+   * @param end       position past the last leaf of the run
+   * @param segments  the models are appended to this
+  **/
+  void fitLeafSegments(int first, int end, std::vector<LeafSegment>& segments);
+
+  /**
+   * Fit the leaves of one model again.
+   * @param segment  position of the model in learnedSegments
+  **/
+  void refitLeafSegment(int segment);
+
+  /**
+   * Predict the first leaf whose largest key reaches key, and check it within the error bound.
+   * @param key        key to search for
+   * @param inclusive  true to find the first leaf with a key >= key, false for a key > key
+   * @return the position of the leaf, the number of leaves if none, or -1 if the prediction was off
+  **/
+  int predictLeaf(int key, bool inclusive);
+
+  /**
+   * Bring the leaves and models of learned routing up to date after an insert.
+   * @param key  key that was inserted
+  **/
+  void learnedAfterInsert(int key);
+
+  /**
+   * Add the separators below a non-leaf node to the front index, from left to right.
+   * @param pageNo    the non-leaf node
+   * @param hasFence  false if the node is on the leftmost path
+   * @param fence     separator to the left of the node
+  **/
+  void buildFrontIndex(PageId pageNo, bool hasFence, int fence);
+
+  /**
+   * Remove the child at index + 1 of a non-leaf node, together with the key separating it from the child at index,
+   * after its entries were moved into the child at index.
+   * @param node   the non-leaf node
+   * @param index  position of the child that took over the entries
+  **/
+  void removeMergedChild(NonLeafNodeInt* node, int index);
+
+  /**
+   * Separator keys that cut a range into sub-ranges of whole subtrees. The keys are taken from the highest level
+   * that has enough of them inside the range, and thinned out to at most wanted - 1 keys.
+   * @param lowKey      smallest key of the range
+   * @param highKey     high value of the range
+   * @param wanted      number of sub-ranges wanted
+   * @param separators  filled with the separator keys in ascending order
+  **/
+  void scanSeparators(int lowKey, int highKey, int wanted, std::vector<int>& separators);
+
+  /**
+   * Body of the threads of a parallel scan: take the next sub-range from the queue and scan it, until none is left.
+   * @param queue  the sub-ranges and their partitions
+  **/
+  void runScanTasks(ScanTaskQueue* queue);
+
+  /**
+   * Append the record ids of the entries in a range to rids, reading the pages under pageLatch.
+   * @param lowVal   low value of range
+   * @param lowOp    low operator (GT/GTE)
+   * @param highVal  high value of range
+   * @param highOp   high operator (LT/LTE)
+   * @param rids     the record ids found are appended here
+  **/
+  void scanPartition(int lowVal, Operator lowOp, int highVal, Operator highOp, std::vector<RecordId>& rids);
+
+  /**
+   * Build the new, empty index from the relation with several threads.
+   * @param relationName  the relation
+   * @param threads       number of threads, 0 for one per core
+   * @return number of records indexed
+  **/
+  int buildParallel(const std::string& relationName, int threads);
+
+  /**
+   * Read the relation once with several threads, producing sorted runs for every index of the queue.
+   * The heap pages are read through this index's buffer manager.
+   * @param relationName  the relation
+   * @param threads       number of threads, 0 for one per core
+   * @param queue         the indexes to read entries for, filled with their runs
+  **/
+  void scanRelation(const std::string& relationName, int threads, BuildQueue* queue);
+
+  /**
+   * Body of the threads of a parallel build: claim the next chunk of heap pages and add their entries to the thread's
+   * run of every index, until the relation is read, then sort the runs.
+   * @param queue   the heap pages and the runs
+   * @param worker  index of the thread's runs
+  **/
+  void runBuildMorsels(BuildQueue* queue, int worker);
+
+  /**
+   * Load the sorted runs of one index of the queue into this empty tree bottom up: merge them into full leaves, then
+   * add full non-leaf levels until one node is left, which becomes the root.
+   * @param queue  the sorted runs
+   * @param index  position of this index in the queue
+   * @return number of entries loaded
+  **/
+  int bulkLoad(BuildQueue* queue, int index);
+
+  /**
+   * True if the tree holds no entry, so that it can be bulk loaded.
+  **/
+  bool isEmpty();
+
+  /**
+   * Value of the included column inside a record, 0 if the index has none.
+   * @param record  the record
+  **/
+  double includeValue(const char* record);
+
+  /**
+   * Add the entries of a subtree that satisfy the range to an aggregate.
+   * @param pageNo     root of the subtree
+   * @param isLeaf     true if the page is a leaf
+   * @param checkLow   true if the subtree may hold entries below the range
+   * @param checkHigh  true if the subtree may hold entries above the range
+   * @param lowVal     low value of range
+   * @param lowOp      low operator (GT/GTE)
+   * @param highVal    high value of range
+   * @param highOp     high operator (LT/LTE)
+   * @param agg        the aggregate to add to
+  **/
+  void aggregateSubtree(PageId pageNo, bool isLeaf, bool checkLow, bool checkHigh,
+                        int lowVal, Operator lowOp, int highVal, Operator highOp, KeyAggregate& agg);
+
+#if BTREE_SUBTREE_AGGREGATES
+  /**
+   * Aggregates over the leaf entries below a page.
+   * @param pageNo  the page
+   * @param isLeaf  true if the page is a leaf
+  **/
+  KeyAggregate subtreeAggregate(PageId pageNo, bool isLeaf);
+#endif
+
+#if BTREE_SUBTREE_COUNTS
+  /**
+   * Number of entries that are smaller than key, or smaller than or equal to key if inclusive is set.
+   * @param key        the key
+   * @param inclusive  also count entries equal to key
+  **/
+  int rankOf(int key, bool inclusive);
+
+  /**
+   * Number of leaf entries below a page.
+   * @param pageNo  the page
+   * @param isLeaf  true if the page is a leaf
+  **/
+  int subtreeCount(PageId pageNo, bool isLeaf);
+#else
+  /**
+   * Number of entries in a range, counted in the leaves from the one the low bound leads to.
+   * @param lowVal   low value of range
+   * @param lowOp    low operator (GT/GTE)
+   * @param highVal  high value of range
+   * @param highOp   high operator (LT/LTE)
+  **/
+  int countLeafRange(int lowVal, Operator lowOp, int highVal, Operator highOp);
+#endif
+
+#if BTREE_SUBTREE_COUNTS || BTREE_SUBTREE_AGGREGATES
+  /**
+   * Bring the per-child counts and aggregates on the root-to-leaf path of key up to date after key was inserted.
+   * Without a split the inserted entry is added to every summary on the path. After a split the summaries on the path
+   * are recomputed from the children.
+   * @param pageNo   non-leaf page on the path
+   * @param key      the inserted key
+   * @param recount  recompute the summaries instead of adding the entry to them
+  **/
+  void updateSubtreeSummaries(PageId pageNo, const void* key, bool recount);
+#endif
+
 };
 
 
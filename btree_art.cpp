@@ -0,0 +1,417 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "btree_art.h"
+#include <cstring>
+
+namespace badgerdb
+{
+
+struct ArtNode4 : ArtNode{
+	unsigned char keys[4];
+	void *children[4];
+};
+
+struct ArtNode16 : ArtNode{
+	unsigned char keys[16];
+	void *children[16];
+};
+
+struct ArtNode48 : ArtNode{
+  /**
+   * Position + 1 of the child of every byte in children, 0 if there is none.
+   */
+	unsigned char childIndex[256];
+	void *children[48];
+};
+
+struct ArtNode256 : ArtNode{
+	void *children[256];
+};
+
+/**
+ * Leaf of the radix tree, holding the whole normalized key and its page number.
+ */
+struct ArtLeaf{
+	unsigned int key;
+	PageId pageNo;
+};
+
+/**
+ * Normalize a key so that comparing its bytes from the top down gives the order of the keys.
+ */
+static inline unsigned int artKey(int key)
+{
+	return (unsigned int)key ^ 0x80000000U;
+}
+
+/**
+ * Byte of a normalized key used at a depth of the tree, the most significant one first.
+ */
+static inline unsigned char artByte(unsigned int key, int depth)
+{
+	return (unsigned char)(key >> (8 * (ART_KEY_BYTES - 1 - depth)));
+}
+
+static ArtNode *newNode4()
+{
+	ArtNode4 *node = new ArtNode4;
+	node->type = ART_NODE4;
+	node->count = 0;
+	return node;
+}
+
+// -----------------------------------------------------------------------------
+// AdaptiveRadixTree::AdaptiveRadixTree -- Constructor
+// -----------------------------------------------------------------------------
+
+AdaptiveRadixTree::AdaptiveRadixTree()
+{
+	this->root = NULL;
+	this->numKeys = 0;
+}
+
+// -----------------------------------------------------------------------------
+// AdaptiveRadixTree::~AdaptiveRadixTree -- destructor
+// -----------------------------------------------------------------------------
+
+AdaptiveRadixTree::~AdaptiveRadixTree()
+{
+	clear();
+}
+
+// -----------------------------------------------------------------------------
+// AdaptiveRadixTree::clear
+// -----------------------------------------------------------------------------
+
+void AdaptiveRadixTree::clear()
+{
+	if (this->root)
+	{
+		freeNode(this->root, 0);
+	}
+	this->root = NULL;
+	this->numKeys = 0;
+}
+
+// -----------------------------------------------------------------------------
+// AdaptiveRadixTree::freeNode
+// -----------------------------------------------------------------------------
+
+void AdaptiveRadixTree::freeNode(void *node, int depth)
+{
+	if (depth == ART_KEY_BYTES)
+	{
+		delete (ArtLeaf *)node;
+		return;
+	}
+	ArtNode *inner = (ArtNode *)node;
+	switch (inner->type)
+	{
+	case ART_NODE4:
+		for (int i = 0; i < inner->count; i++)
+			freeNode(((ArtNode4 *)inner)->children[i], depth + 1);
+		delete (ArtNode4 *)inner;
+		break;
+	case ART_NODE16:
+		for (int i = 0; i < inner->count; i++)
+			freeNode(((ArtNode16 *)inner)->children[i], depth + 1);
+		delete (ArtNode16 *)inner;
+		break;
+	case ART_NODE48:
+		for (int i = 0; i < inner->count; i++)
+			freeNode(((ArtNode48 *)inner)->children[i], depth + 1);
+		delete (ArtNode48 *)inner;
+		break;
+	case ART_NODE256:
+		for (int i = 0; i < 256; i++)
+		{
+			if (((ArtNode256 *)inner)->children[i])
+				freeNode(((ArtNode256 *)inner)->children[i], depth + 1);
+		}
+		delete (ArtNode256 *)inner;
+		break;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// AdaptiveRadixTree::findChild
+// -----------------------------------------------------------------------------
+
+void **AdaptiveRadixTree::findChild(ArtNode *node, unsigned char byte)
+{
+	switch (node->type)
+	{
+	case ART_NODE4:
+	{
+		ArtNode4 *n = (ArtNode4 *)node;
+		for (int i = 0; i < n->count; i++)
+		{
+			if (n->keys[i] == byte)
+				return &n->children[i];
+		}
+		return NULL;
+	}
+	case ART_NODE16:
+	{
+		ArtNode16 *n = (ArtNode16 *)node;
+		for (int i = 0; i < n->count; i++)
+		{
+			if (n->keys[i] == byte)
+				return &n->children[i];
+		}
+		return NULL;
+	}
+	case ART_NODE48:
+	{
+		ArtNode48 *n = (ArtNode48 *)node;
+		return n->childIndex[byte] ? &n->children[n->childIndex[byte] - 1] : NULL;
+	}
+	case ART_NODE256:
+	{
+		ArtNode256 *n = (ArtNode256 *)node;
+		return n->children[byte] ? &n->children[byte] : NULL;
+	}
+	}
+	return NULL;
+}
+
+// -----------------------------------------------------------------------------
+// AdaptiveRadixTree::addChild
+// -----------------------------------------------------------------------------
+
+void AdaptiveRadixTree::addChild(ArtNode *&nodeRef, unsigned char byte, void *child)
+{
+	ArtNode *node = nodeRef;
+	if (node->type == ART_NODE4 && node->count == 4)
+	{
+		ArtNode4 *old = (ArtNode4 *)node;
+		ArtNode16 *grown = new ArtNode16;
+		grown->type = ART_NODE16;
+		grown->count = old->count;
+		memcpy(grown->keys, old->keys, sizeof(old->keys));
+		memcpy(grown->children, old->children, sizeof(old->children));
+		delete old;
+		node = nodeRef = grown;
+	}
+	else if (node->type == ART_NODE16 && node->count == 16)
+	{
+		ArtNode16 *old = (ArtNode16 *)node;
+		ArtNode48 *grown = new ArtNode48;
+		grown->type = ART_NODE48;
+		grown->count = old->count;
+		memset(grown->childIndex, 0, sizeof(grown->childIndex));
+		for (int i = 0; i < old->count; i++)
+		{
+			grown->childIndex[old->keys[i]] = i + 1;
+			grown->children[i] = old->children[i];
+		}
+		delete old;
+		node = nodeRef = grown;
+	}
+	else if (node->type == ART_NODE48 && node->count == 48)
+	{
+		ArtNode48 *old = (ArtNode48 *)node;
+		ArtNode256 *grown = new ArtNode256;
+		grown->type = ART_NODE256;
+		grown->count = old->count;
+		memset(grown->children, 0, sizeof(grown->children));
+		for (int b = 0; b < 256; b++)
+		{
+			if (old->childIndex[b])
+				grown->children[b] = old->children[old->childIndex[b] - 1];
+		}
+		delete old;
+		node = nodeRef = grown;
+	}
+
+	switch (node->type)
+	{
+	case ART_NODE4:
+	case ART_NODE16:
+	{
+		// The small nodes keep their keys sorted, so the children are in key order for floor()
+		unsigned char *keys = node->type == ART_NODE4 ? ((ArtNode4 *)node)->keys : ((ArtNode16 *)node)->keys;
+		void **children = node->type == ART_NODE4 ? ((ArtNode4 *)node)->children : ((ArtNode16 *)node)->children;
+		int i = node->count;
+		while (i > 0 && keys[i - 1] > byte)
+		{
+			keys[i] = keys[i - 1];
+			children[i] = children[i - 1];
+			i--;
+		}
+		keys[i] = byte;
+		children[i] = child;
+		break;
+	}
+	case ART_NODE48:
+	{
+		// Children are never removed, so the next free position is the count
+		ArtNode48 *n = (ArtNode48 *)node;
+		n->children[n->count] = child;
+		n->childIndex[byte] = n->count + 1;
+		break;
+	}
+	case ART_NODE256:
+		((ArtNode256 *)node)->children[byte] = child;
+		break;
+	}
+	node->count++;
+}
+
+// -----------------------------------------------------------------------------
+// AdaptiveRadixTree::childBelow
+// -----------------------------------------------------------------------------
+
+void *AdaptiveRadixTree::childBelow(ArtNode *node, int limit)
+{
+	switch (node->type)
+	{
+	case ART_NODE4:
+	{
+		ArtNode4 *n = (ArtNode4 *)node;
+		for (int i = n->count - 1; i >= 0; i--)
+		{
+			if (n->keys[i] < limit)
+				return n->children[i];
+		}
+		return NULL;
+	}
+	case ART_NODE16:
+	{
+		ArtNode16 *n = (ArtNode16 *)node;
+		for (int i = n->count - 1; i >= 0; i--)
+		{
+			if (n->keys[i] < limit)
+				return n->children[i];
+		}
+		return NULL;
+	}
+	case ART_NODE48:
+	{
+		ArtNode48 *n = (ArtNode48 *)node;
+		for (int b = limit - 1; b >= 0; b--)
+		{
+			if (n->childIndex[b])
+				return n->children[n->childIndex[b] - 1];
+		}
+		return NULL;
+	}
+	case ART_NODE256:
+	{
+		ArtNode256 *n = (ArtNode256 *)node;
+		for (int b = limit - 1; b >= 0; b--)
+		{
+			if (n->children[b])
+				return n->children[b];
+		}
+		return NULL;
+	}
+	}
+	return NULL;
+}
+
+// -----------------------------------------------------------------------------
+// AdaptiveRadixTree::maximum
+// -----------------------------------------------------------------------------
+
+void *AdaptiveRadixTree::maximum(void *node, int depth)
+{
+	while (depth < ART_KEY_BYTES)
+	{
+		node = childBelow((ArtNode *)node, 256);
+		depth++;
+	}
+	return node;
+}
+
+// -----------------------------------------------------------------------------
+// AdaptiveRadixTree::floor
+// -----------------------------------------------------------------------------
+
+void *AdaptiveRadixTree::floor(ArtNode *node, int depth, unsigned int key, bool inclusive)
+{
+	unsigned char byte = artByte(key, depth);
+	void **child = findChild(node, byte);
+	if (child)
+	{
+		// At the last level the child holds the key itself
+		if (depth == ART_KEY_BYTES - 1)
+		{
+			if (inclusive)
+				return *child;
+		}
+		else
+		{
+			void *found = floor((ArtNode *)*child, depth + 1, key, inclusive);
+			if (found)
+				return found;
+		}
+	}
+	// Nothing below the key byte, so the answer is the largest key under a smaller byte
+	void *below = childBelow(node, byte);
+	return below ? maximum(below, depth + 1) : NULL;
+}
+
+bool AdaptiveRadixTree::floor(int key, bool inclusive, PageId &outPageNo) const
+{
+	if (!this->root)
+	{
+		return false;
+	}
+	ArtLeaf *leaf = (ArtLeaf *)floor(this->root, 0, artKey(key), inclusive);
+	if (!leaf)
+	{
+		return false;
+	}
+	outPageNo = leaf->pageNo;
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// AdaptiveRadixTree::insert
+// -----------------------------------------------------------------------------
+
+bool AdaptiveRadixTree::insert(int key, PageId pageNo, bool replace)
+{
+	unsigned int normalized = artKey(key);
+	if (!this->root)
+	{
+		this->root = newNode4();
+	}
+	ArtNode **nodeRef = &this->root;
+	for (int depth = 0; depth < ART_KEY_BYTES - 1; depth++)
+	{
+		unsigned char byte = artByte(normalized, depth);
+		void **child = findChild(*nodeRef, byte);
+		if (!child)
+		{
+			addChild(*nodeRef, byte, newNode4());
+			child = findChild(*nodeRef, byte);
+		}
+		nodeRef = (ArtNode **)child;
+	}
+
+	unsigned char byte = artByte(normalized, ART_KEY_BYTES - 1);
+	void **child = findChild(*nodeRef, byte);
+	if (child)
+	{
+		if (replace)
+		{
+			((ArtLeaf *)*child)->pageNo = pageNo;
+		}
+		return false;
+	}
+	ArtLeaf *leaf = new ArtLeaf;
+	leaf->key = normalized;
+	leaf->pageNo = pageNo;
+	addChild(*nodeRef, byte, leaf);
+	this->numKeys++;
+	return true;
+}
+
+}
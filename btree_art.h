@@ -0,0 +1,151 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "types.h"
+
+namespace badgerdb
+{
+
+/**
+ * @brief Number of bytes of a key in the radix tree. An integer key is normalized to 4 big-endian bytes with the
+ * sign bit flipped, so that byte order is key order.
+ */
+const int ART_KEY_BYTES = 4;
+
+/**
+ * @brief Kinds of inner nodes of the radix tree. A node grows into the next kind when it runs out of children.
+ */
+enum ArtNodeType
+{
+	ART_NODE4,		/* Up to 4 children, keys searched linearly */
+	ART_NODE16,		/* Up to 16 children, keys kept sorted */
+	ART_NODE48,		/* Up to 48 children, reached through a 256 entry byte index */
+	ART_NODE256		/* A child slot for every byte */
+};
+
+/**
+ * @brief Header shared by all inner nodes.
+ */
+struct ArtNode{
+  /**
+   * Kind of the node.
+   */
+	ArtNodeType type;
+
+  /**
+   * Number of children.
+   */
+	int count;
+};
+
+/**
+ * @brief In-memory adaptive radix tree mapping integer keys to page numbers, with ordered lookups.
+ * Inner nodes come in four sizes and grow with their fan-out, so a sparse level costs little memory and a dense level
+ * is a direct array lookup. A lookup reads at most ART_KEY_BYTES nodes, independent of the number of keys.
+ * Used by BTreeIndex as a front index from the separator keys to the leaves.
+*/
+class AdaptiveRadixTree {
+
+ private:
+
+  /**
+   * Root node, NULL when the tree is empty.
+   */
+	ArtNode		*root;
+
+  /**
+   * Number of keys.
+   */
+	int				numKeys;
+
+  /**
+   * Child of a node for a key byte, NULL if there is none. At the last level, a child is a leaf with the page number.
+   */
+	static void **findChild(ArtNode *node, unsigned char byte);
+
+  /**
+   * Add a child to a node, growing the node into the next kind if it is full.
+   * @param nodeRef  reference to the node, replaced if it grows
+   * @param byte     key byte of the child
+   * @param child    the child
+   */
+	static void addChild(ArtNode *&nodeRef, unsigned char byte, void *child);
+
+  /**
+   * Child with the largest key byte below a bound, NULL if there is none.
+   * @param node   the node
+   * @param limit  the bound; 256 to find the largest child
+   */
+	static void *childBelow(ArtNode *node, int limit);
+
+  /**
+   * Largest key below a node.
+   * @param node   the node
+   * @param depth  number of key bytes above the node
+   */
+	static void *maximum(void *node, int depth);
+
+  /**
+   * Largest key up to a key, below a node.
+   * @param node       the node
+   * @param depth      number of key bytes above the node
+   * @param key        normalized key
+   * @param inclusive  true to accept the key itself
+   */
+	static void *floor(ArtNode *node, int depth, unsigned int key, bool inclusive);
+
+  /**
+   * Free a node and everything below it.
+   */
+	static void freeNode(void *node, int depth);
+
+  /**
+   * Not copyable, the tree owns its nodes.
+   */
+	AdaptiveRadixTree(const AdaptiveRadixTree &);
+	AdaptiveRadixTree &operator=(const AdaptiveRadixTree &);
+
+ public:
+
+	AdaptiveRadixTree();
+
+	~AdaptiveRadixTree();
+
+  /**
+   * Number of keys in the tree.
+   */
+	int size() const { return numKeys; }
+
+  /**
+   * Remove all keys.
+   */
+	void clear();
+
+  /**
+   * Map a key to a page number.
+   * @param key       the key
+   * @param pageNo    the page number
+   * @param replace   true to replace the page number of a key that is already there, false to keep it
+   * @return true if the key was not there before
+   */
+	bool insert(int key, PageId pageNo, bool replace);
+
+  /**
+   * Find the page number of the largest key below a key, or up to it.
+   * @param key        the key
+   * @param inclusive  true to find the largest key <= key, false to find the largest key < key
+   * @param outPageNo  page number of the key found
+   * @return true if there is such a key
+   */
+	bool floor(int key, bool inclusive, PageId &outPageNo) const;
+};
+
+}
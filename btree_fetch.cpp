@@ -0,0 +1,197 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "btree_fetch.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace badgerdb
+{
+
+static bool ridLess(const RecordId &a, const RecordId &b)
+{
+	return a.page_number < b.page_number || (a.page_number == b.page_number && a.slot_number < b.slot_number);
+}
+
+// -----------------------------------------------------------------------------
+// HeapFetch::HeapFetch -- Constructor
+// -----------------------------------------------------------------------------
+
+HeapFetch::HeapFetch(File *heapFileIn, BufMgr *bufMgrIn, const int readAheadPages)
+{
+	this->heapFile = heapFileIn;
+	this->bufMgr = bufMgrIn;
+	this->nextRid = 0;
+	this->currentPageNum = 0;
+	this->currentPage = NULL;
+	this->readAheadPages = readAheadPages;
+	this->readAheadNext = 0;
+	this->numPagesRead = 0;
+	this->readAheadFd = readAheadPages > 0 ? open(heapFileIn->filename().c_str(), O_RDONLY) : -1;
+}
+
+// -----------------------------------------------------------------------------
+// HeapFetch::~HeapFetch -- destructor
+// -----------------------------------------------------------------------------
+
+HeapFetch::~HeapFetch()
+{
+	releasePage();
+	if (this->readAheadFd >= 0)
+	{
+		close(this->readAheadFd);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// HeapFetch::releasePage
+// -----------------------------------------------------------------------------
+
+void HeapFetch::releasePage()
+{
+	if (this->currentPageNum)
+	{
+		this->bufMgr->unPinPage(this->heapFile, this->currentPageNum, false);
+		this->currentPageNum = 0;
+		this->currentPage = NULL;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// HeapFetch::start
+// -----------------------------------------------------------------------------
+
+void HeapFetch::start()
+{
+	releasePage();
+	std::sort(this->rids.begin(), this->rids.end(), ridLess);
+	this->nextRid = 0;
+	this->readAheadNext = 0;
+	this->numPagesRead = 0;
+}
+
+// -----------------------------------------------------------------------------
+// HeapFetch::fetchRange
+// -----------------------------------------------------------------------------
+
+const int HeapFetch::fetchRange(BTreeIndex *index, const void *lowVal, const Operator lowOp, const void *highVal,
+								const Operator highOp, const KeyPredicate *filter)
+{
+	this->rids.clear();
+	try
+	{
+		index->startScan(lowVal, lowOp, highVal, highOp, filter);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		// The scan was started on a range without entries, it is ended like one that ran out
+		index->endScan();
+		start();
+		return 0;
+	}
+	try
+	{
+		RecordId batch[FETCH_SCAN_BATCH];
+		while (1)
+		{
+			int found = index->scanNextBatch(batch, FETCH_SCAN_BATCH);
+			this->rids.insert(this->rids.end(), batch, batch + found);
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	catch (...)
+	{
+		index->endScan();
+		throw;
+	}
+	index->endScan();
+	start();
+	return this->rids.size();
+}
+
+// -----------------------------------------------------------------------------
+// HeapFetch::fetchRids
+// -----------------------------------------------------------------------------
+
+const void HeapFetch::fetchRids(const std::vector<RecordId> &ridsIn)
+{
+	this->rids = ridsIn;
+	start();
+}
+
+// -----------------------------------------------------------------------------
+// HeapFetch::readAhead
+// -----------------------------------------------------------------------------
+
+void HeapFetch::readAhead()
+{
+	if (this->readAheadFd < 0)
+	{
+		return;
+	}
+	// Pages between the fetch and readAheadNext have been asked for already
+	int pagesAhead = 0;
+	if (this->readAheadNext > this->nextRid)
+	{
+		pagesAhead = this->rids[this->readAheadNext - 1].page_number - this->rids[this->nextRid].page_number;
+	}
+	if (pagesAhead >= this->readAheadPages / 2)
+	{
+		return;
+	}
+	// One request per run of consecutive pages. A PageFile keeps page n a file header past (n - 1) * Page::SIZE,
+	// so every run is asked for from the start of its first page to the end of the page after its last one.
+	int pagesAsked = 0;
+	while (this->readAheadNext < this->rids.size() && pagesAsked < this->readAheadPages)
+	{
+		PageId first = this->rids[this->readAheadNext].page_number;
+		PageId last = first;
+		while (this->readAheadNext < this->rids.size() && this->rids[this->readAheadNext].page_number <= last + 1 &&
+			   pagesAsked + (int)(this->rids[this->readAheadNext].page_number - first) < this->readAheadPages)
+		{
+			last = this->rids[this->readAheadNext].page_number;
+			this->readAheadNext++;
+		}
+		posix_fadvise(this->readAheadFd, (off_t)(first - 1) * Page::SIZE, (off_t)(last - first + 2) * Page::SIZE,
+					  POSIX_FADV_WILLNEED);
+		pagesAsked += last - first + 1;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// HeapFetch::next
+// -----------------------------------------------------------------------------
+
+const void HeapFetch::next(RecordId &outRid, std::string &outRecord)
+{
+	if (this->nextRid >= this->rids.size())
+	{
+		releasePage();
+		throw EndOfFileException();
+	}
+	const RecordId &rid = this->rids[this->nextRid];
+	if (rid.page_number != this->currentPageNum)
+	{
+		// The record ids are sorted, so the fetch is done with the page it leaves
+		releasePage();
+		readAhead();
+		this->bufMgr->readPage(this->heapFile, rid.page_number, this->currentPage);
+		this->currentPageNum = rid.page_number;
+		this->numPagesRead++;
+	}
+	outRid = rid;
+	outRecord = this->currentPage->getRecord(rid);
+	this->nextRid++;
+}
+
+}
@@ -0,0 +1,160 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "btree.h"
+
+namespace badgerdb
+{
+
+/**
+ * @brief Number of record ids HeapFetch takes from an index scan at once.
+ */
+const int FETCH_SCAN_BATCH = 256;
+
+/**
+ * @brief Default number of heap pages HeapFetch asks the kernel to read ahead of the page it is on.
+ */
+const int FETCH_READ_AHEAD_PAGES = 32;
+
+/**
+ * @brief Fetches the records of a set of record ids from the heap file of a relation, reading every page once.
+ * An index scan returns record ids in key order, which visits the heap pages in random order and reads a page again
+ * for every entry on it. HeapFetch collects the record ids first and sorts them by page, so the heap is read in page
+ * order, one readPage per page, and the kernel is asked to read the pages ahead of the fetch.
+ * The records come out in page order, not in key order.
+*/
+class HeapFetch {
+
+ private:
+
+  /**
+   * Heap file of the relation.
+   */
+	File		*heapFile;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Record ids to fetch, sorted by page, and the position of the next one.
+   */
+	std::vector<RecordId>	rids;
+	size_t	nextRid;
+
+  /**
+   * Heap page holding the record id before nextRid, pinned while the fetch is on it. 0 if none is pinned.
+   */
+	PageId	currentPageNum;
+	Page		*currentPage;
+
+  /**
+   * Number of pages to read ahead, 0 to read none.
+   */
+	int			readAheadPages;
+
+  /**
+   * Position in rids of the first record id whose page has not been read ahead yet.
+   */
+	size_t	readAheadNext;
+
+  /**
+   * Descriptor of the heap file used to advise the kernel of the pages read ahead, -1 if it could not be opened.
+   */
+	int			readAheadFd;
+
+  /**
+   * Number of heap pages read by the fetch.
+   */
+	int			numPagesRead;
+
+  /**
+   * Unpin the current page, if any.
+   */
+	void releasePage();
+
+  /**
+   * Ask the kernel to read the next readAheadPages pages of the fetch, once fewer than half of them are left ahead.
+   */
+	void readAhead();
+
+  /**
+   * Sort the record ids and start over with the first of them.
+   */
+	void start();
+
+	HeapFetch(const HeapFetch &);
+	HeapFetch &operator=(const HeapFetch &);
+
+ public:
+
+  /**
+   * HeapFetch Constructor.
+   * @param heapFileIn      Heap file of the relation, the one its pages are read through elsewhere
+   * @param bufMgrIn        Buffer Manager Instance
+   * @param readAheadPages  Number of pages to read ahead, 0 to read none
+   */
+	HeapFetch(File *heapFileIn, BufMgr *bufMgrIn, const int readAheadPages = FETCH_READ_AHEAD_PAGES);
+
+  /**
+   * HeapFetch Destructor. Unpins the current page.
+   */
+	~HeapFetch();
+
+  /**
+   * Fetch the records of the index entries in a range. The range is given the same way as for BTreeIndex::startScan().
+   * The scan runs to its end here, using the index's scan, before the first record is read. It is ended on every
+   * return and exception, so another scan of the index may start afterwards.
+   * @param index    Index over the relation
+   * @param lowVal   Low value of range, pointer to integer
+   * @param lowOp    Low operator (GT/GTE)
+   * @param highVal  High value of range, pointer to integer
+   * @param highOp   High operator (LT/LTE)
+   * @param filter   Predicate the keys must also satisfy, NULL for none
+   * @return number of records to fetch
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   */
+	const int fetchRange(BTreeIndex *index, const void* lowVal, const Operator lowOp, const void* highVal,
+						 const Operator highOp, const KeyPredicate* filter = NULL);
+
+  /**
+   * Fetch the records of a set of record ids.
+   * @param ridsIn  the record ids, in any order
+   */
+	const void fetchRids(const std::vector<RecordId>& ridsIn);
+
+  /**
+   * Return the next record of the fetch.
+   * @param outRid     Record ID of the record
+   * @param outRecord  the record
+   * @throws EndOfFileException If all records have been returned.
+   */
+	const void next(RecordId& outRid, std::string& outRecord);
+
+  /**
+   * Number of records of the fetch.
+   */
+	int size() const { return rids.size(); }
+
+  /**
+   * Number of heap pages read so far.
+   */
+	int pagesRead() const { return numPagesRead; }
+};
+
+}
@@ -0,0 +1,114 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "btree_join.h"
+#include "exceptions/end_of_file_exception.h"
+#include <algorithm>
+#include <cstring>
+
+namespace badgerdb
+{
+
+static bool pairKeyLess(const std::pair<int, RecordId> &a, const std::pair<int, RecordId> &b)
+{
+	return a.first < b.first;
+}
+
+// -----------------------------------------------------------------------------
+// IndexNestedLoopJoin::IndexNestedLoopJoin -- Constructor
+// -----------------------------------------------------------------------------
+
+IndexNestedLoopJoin::IndexNestedLoopJoin(const std::string &outerRelation,
+										 const int outerByteOffset,
+										 BTreeIndex *innerIndex,
+										 BufMgr *bufMgr,
+										 const int batchSize)
+{
+	this->outerScan = new FileScan(outerRelation, bufMgr);
+	this->outerByteOffset = outerByteOffset;
+	this->inner = innerIndex;
+	this->batchSize = batchSize > 0 ? batchSize : 1;
+	this->nextPair = 0;
+	this->numOuter = 0;
+}
+
+// -----------------------------------------------------------------------------
+// IndexNestedLoopJoin::~IndexNestedLoopJoin -- destructor
+// -----------------------------------------------------------------------------
+
+IndexNestedLoopJoin::~IndexNestedLoopJoin()
+{
+	delete this->outerScan;
+}
+
+// -----------------------------------------------------------------------------
+// IndexNestedLoopJoin::nextBatch
+// -----------------------------------------------------------------------------
+
+bool IndexNestedLoopJoin::nextBatch()
+{
+	std::vector<std::pair<int, RecordId> > outer;
+	try
+	{
+		RecordId scanRid;
+		std::string recordStr;
+		while (this->outerScan && (int)outer.size() < this->batchSize)
+		{
+			this->outerScan->scanNext(scanRid);
+			recordStr = this->outerScan->getRecord();
+			int key;
+			memcpy(&key, recordStr.c_str() + this->outerByteOffset, sizeof(int));
+			outer.push_back(std::make_pair(key, scanRid));
+		}
+	}
+	catch (const EndOfFileException &e)
+	{
+		delete this->outerScan;
+		this->outerScan = NULL;
+	}
+	if (outer.empty())
+	{
+		return false;
+	}
+	this->numOuter += outer.size();
+
+	// Sorted keys share their descents and walk the leaves forward
+	std::sort(outer.begin(), outer.end(), pairKeyLess);
+	std::vector<int> keys(outer.size());
+	std::vector<RecordId> tags(outer.size());
+	for (size_t i = 0; i < outer.size(); i++)
+	{
+		keys[i] = outer[i].first;
+		tags[i] = outer[i].second;
+	}
+	this->inner->prefetchKeys(&keys[0], keys.size());
+	this->pairs.clear();
+	this->nextPair = 0;
+	this->inner->probeSorted(&keys[0], &tags[0], keys.size(), this->pairs);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// IndexNestedLoopJoin::next
+// -----------------------------------------------------------------------------
+
+const void IndexNestedLoopJoin::next(RecordId &outerRid, RecordId &innerRid)
+{
+	// A batch may have no pairs at all, so batches are read until one has
+	while (this->nextPair >= this->pairs.size())
+	{
+		if (!nextBatch())
+		{
+			throw EndOfFileException();
+		}
+	}
+	outerRid = this->pairs[this->nextPair].first;
+	innerRid = this->pairs[this->nextPair].second;
+	this->nextPair++;
+}
+
+}
@@ -0,0 +1,111 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+#include "buffer.h"
+#include "filescan.h"
+#include "btree.h"
+
+namespace badgerdb
+{
+
+/**
+ * @brief Default number of outer tuples IndexNestedLoopJoin reads, sorts and probes the index with at once.
+ */
+const int JOIN_OUTER_BATCH = 4096;
+
+/**
+ * @brief Index nested loop join of a relation (the outer side) with the relation of a BTreeIndex (the inner side),
+ * on an integer attribute of the outer relation equal to the key of the index.
+ * Instead of a scan of the index per outer tuple, the outer tuples are read in batches and sorted on their join key.
+ * The index is asked to prefetch the pages the batch leads to, then probed with the whole batch, so every leaf is
+ * reached with one descent from the root for all the keys it holds. The join pairs are streamed out a batch at a time,
+ * in key order within a batch.
+*/
+class IndexNestedLoopJoin {
+
+ private:
+
+  /**
+   * Scan of the outer relation, NULL once it has reached the end.
+   */
+	FileScan	*outerScan;
+
+  /**
+   * Offset of the join attribute inside outer records.
+   */
+	int			outerByteOffset;
+
+  /**
+   * Index over the inner relation.
+   */
+	BTreeIndex	*inner;
+
+  /**
+   * Number of outer tuples per batch.
+   */
+	int			batchSize;
+
+  /**
+   * Join pairs of the current batch, <outer record id, inner record id>, and the position of the next one.
+   */
+	std::vector<std::pair<RecordId, RecordId> >	pairs;
+	size_t	nextPair;
+
+  /**
+   * Number of outer tuples read so far.
+   */
+	int			numOuter;
+
+  /**
+   * Read the next batch of outer tuples and probe the index with it.
+   * @return false if the outer relation has no tuples left
+   */
+	bool nextBatch();
+
+	IndexNestedLoopJoin(const IndexNestedLoopJoin &);
+	IndexNestedLoopJoin &operator=(const IndexNestedLoopJoin &);
+
+ public:
+
+  /**
+   * IndexNestedLoopJoin Constructor.
+   * @param outerRelation    Name of the outer relation
+   * @param outerByteOffset  Offset of the integer join attribute inside outer records
+   * @param innerIndex       Index over the inner relation, on the join attribute. No scan of it may run meanwhile.
+   * @param bufMgr           Buffer Manager Instance
+   * @param batchSize        Number of outer tuples to read and sort at once
+   */
+	IndexNestedLoopJoin(const std::string& outerRelation, const int outerByteOffset, BTreeIndex *innerIndex,
+						BufMgr *bufMgr, const int batchSize = JOIN_OUTER_BATCH);
+
+  /**
+   * IndexNestedLoopJoin Destructor.
+   */
+	~IndexNestedLoopJoin();
+
+  /**
+   * Return the next pair of joining tuples.
+   * @param outerRid  Record ID of the outer tuple
+   * @param innerRid  Record ID of the inner tuple, as found in the index
+   * @throws EndOfFileException If all pairs have been returned.
+   */
+	const void next(RecordId& outerRid, RecordId& innerRid);
+
+  /**
+   * Number of outer tuples read so far.
+   */
+	int outerTuples() const { return numOuter; }
+};
+
+}
@@ -0,0 +1,730 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "btree_snapshot.h"
+#include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/scan_not_initialized_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/badgerdb_exception.h"
+#include <climits>
+#include <cstring>
+
+namespace badgerdb
+{
+
+/**
+ * True if a key comes before the searched position: below the key for an inclusive search, up to it otherwise.
+ */
+static inline bool keyBefore(int entryKey, int key, bool inclusive)
+{
+	return inclusive ? entryKey < key : entryKey <= key;
+}
+
+/**
+ * Append an unsigned integer in 7 bit groups, the low group first, with the top bit of a byte set if more follow.
+ */
+static inline void putVarint(std::vector<unsigned char> &out, std::uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((unsigned char)value);
+}
+
+static inline std::uint64_t getVarint(const unsigned char *&in)
+{
+	std::uint64_t value = 0;
+	for (int shift = 0;; shift += 7)
+	{
+		unsigned char byte = *in++;
+		value |= (std::uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+		{
+			return value;
+		}
+	}
+}
+
+/**
+ * Map a signed difference to an unsigned one, small magnitudes to small values, so it takes few varint bytes.
+ */
+static inline std::uint64_t zigzag(std::int64_t value)
+{
+	return ((std::uint64_t)value << 1) ^ (std::uint64_t)(value >> 63);
+}
+
+static inline std::int64_t unzigzag(std::uint64_t value)
+{
+	return (std::int64_t)(value >> 1) ^ -(std::int64_t)(value & 1);
+}
+
+/**
+ * Compress a leaf: the first key, the gaps between consecutive keys, then the record ids as the change of the page
+ * number and the slot number. Keys are sorted and records of neighbouring keys are usually on the same or nearby
+ * pages, so most entries take 3 or 4 bytes instead of 12.
+ */
+static void encodeLeaf(const SnapshotLeafInt *leaf, std::vector<unsigned char> &out)
+{
+	putVarint(out, zigzag(leaf->keyArray[0]));
+	for (int i = 1; i < leaf->size; i++)
+	{
+		putVarint(out, (std::uint32_t)leaf->keyArray[i] - (std::uint32_t)leaf->keyArray[i - 1]);
+	}
+	std::int64_t prevPage = 0;
+	for (int i = 0; i < leaf->size; i++)
+	{
+		putVarint(out, zigzag((std::int64_t)leaf->ridArray[i].page_number - prevPage));
+		putVarint(out, leaf->ridArray[i].slot_number);
+		prevPage = leaf->ridArray[i].page_number;
+	}
+}
+
+static void decodeLeaf(const unsigned char *in, int size, SnapshotLeafInt *leaf)
+{
+	leaf->size = size;
+	std::uint32_t key = (std::uint32_t)unzigzag(getVarint(in));
+	leaf->keyArray[0] = (int)key;
+	for (int i = 1; i < size; i++)
+	{
+		key += (std::uint32_t)getVarint(in);
+		leaf->keyArray[i] = (int)key;
+	}
+	std::int64_t page = 0;
+	for (int i = 0; i < size; i++)
+	{
+		page += unzigzag(getVarint(in));
+		leaf->ridArray[i].page_number = (PageId)page;
+		leaf->ridArray[i].slot_number = (SlotId)getVarint(in);
+	}
+}
+
+/**
+ * Number of blocks on each level of the inner search tree over numLeaves leaves, lowest level first.
+ */
+static std::vector<int> snapshotLevelSizes(int numLeaves)
+{
+	std::vector<int> sizes;
+	int keys = numLeaves;
+	while (keys > 0)
+	{
+		int blocks = (keys + SNAPSHOT_BLOCK_KEYS - 1) / SNAPSHOT_BLOCK_KEYS;
+		sizes.push_back(blocks);
+		if (blocks == 1)
+		{
+			break;
+		}
+		keys = blocks;
+	}
+	return sizes;
+}
+
+// -----------------------------------------------------------------------------
+// SnapshotWriter::SnapshotWriter -- Constructor
+// -----------------------------------------------------------------------------
+
+SnapshotWriter::SnapshotWriter(const std::string &snapshotName,
+							   BufMgr *bufMgrIn,
+							   const std::string &relationName,
+							   const int attrByteOffset,
+							   const Datatype attrType,
+							   const bool compress)
+{
+	this->bufMgr = bufMgrIn;
+	this->leafPage = NULL;
+	this->leafPageNum = 0;
+	this->numEntries = 0;
+	this->finished = false;
+	this->compress = compress;
+	this->pendingLeaf = NULL;
+	this->streamWritten = 0;
+	if (compress)
+	{
+		this->pendingLeaf = new SnapshotLeafInt;
+		this->pendingLeaf->size = 0;
+	}
+
+	// A snapshot is never changed in place, a new export replaces the whole file
+	if (File::exists(snapshotName))
+	{
+		File::remove(snapshotName);
+	}
+	this->file = new BlobFile(snapshotName, true);
+
+	this->bufMgr->allocPage(this->file, this->metaPageNum, this->metaPage);
+	SnapshotMetaInfo *meta = (SnapshotMetaInfo *)this->metaPage;
+	memset(meta, 0, sizeof(SnapshotMetaInfo));
+	strncpy(meta->relationName, relationName.c_str(), sizeof(meta->relationName) - 1);
+	meta->attrByteOffset = attrByteOffset;
+	meta->attrType = attrType;
+	meta->compressed = compress ? 1 : 0;
+}
+
+// -----------------------------------------------------------------------------
+// SnapshotWriter::~SnapshotWriter -- destructor
+// -----------------------------------------------------------------------------
+
+SnapshotWriter::~SnapshotWriter()
+{
+	try
+	{
+		if (!this->finished)
+		{
+			this->finish();
+		}
+		this->bufMgr->flushFile(this->file);
+	}
+	catch (badgerdb::BadgerDbException e)
+	{
+		std::cerr << e.what() << '\n';
+	}
+	delete this->pendingLeaf;
+	this->pendingLeaf = NULL;
+	delete this->file;
+	this->file = NULL;
+}
+
+// -----------------------------------------------------------------------------
+// SnapshotWriter::allocLeafPage
+// -----------------------------------------------------------------------------
+
+PageId SnapshotWriter::allocLeafPage(Page *&page)
+{
+	PageId pageNo;
+	this->bufMgr->allocPage(this->file, pageNo, page);
+	// Leaves are found by their position, so they have to follow each other in the file
+	if (this->leafPageNum != 0 && pageNo != this->leafPageNum + 1)
+	{
+		throw BadgerDbException("Snapshot leaves are not on consecutive pages");
+	}
+	if (this->leafPageNum == 0)
+	{
+		((SnapshotMetaInfo *)this->metaPage)->firstLeafPageNo = pageNo;
+	}
+	this->leafPageNum = pageNo;
+	return pageNo;
+}
+
+// -----------------------------------------------------------------------------
+// SnapshotWriter::append
+// -----------------------------------------------------------------------------
+
+const void SnapshotWriter::append(const int key, const RecordId rid)
+{
+	if (this->compress)
+	{
+		this->pendingLeaf->keyArray[this->pendingLeaf->size] = key;
+		this->pendingLeaf->ridArray[this->pendingLeaf->size] = rid;
+		this->pendingLeaf->size++;
+		this->numEntries++;
+		if (this->pendingLeaf->size == SNAPSHOT_LEAF_SIZE)
+		{
+			closeCompressedLeaf();
+		}
+		return;
+	}
+	if (this->leafPage == NULL)
+	{
+		allocLeafPage(this->leafPage);
+		((SnapshotLeafInt *)this->leafPage)->size = 0;
+	}
+
+	SnapshotLeafInt *leaf = (SnapshotLeafInt *)this->leafPage;
+	leaf->keyArray[leaf->size] = key;
+	leaf->ridArray[leaf->size] = rid;
+	leaf->size++;
+	this->numEntries++;
+	if (leaf->size == SNAPSHOT_LEAF_SIZE)
+	{
+		this->leafMaxKeys.push_back(key);
+		this->bufMgr->unPinPage(this->file, this->leafPageNum, true);
+		this->leafPage = NULL;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// SnapshotWriter::closeCompressedLeaf
+// -----------------------------------------------------------------------------
+
+const void SnapshotWriter::closeCompressedLeaf()
+{
+	this->leafMaxKeys.push_back(this->pendingLeaf->keyArray[this->pendingLeaf->size - 1]);
+	this->leafOffsets.push_back(this->streamWritten + (int)this->stream.size());
+	encodeLeaf(this->pendingLeaf, this->stream);
+	this->pendingLeaf->size = 0;
+	writeStream(false);
+}
+
+// -----------------------------------------------------------------------------
+// SnapshotWriter::writeStream
+// -----------------------------------------------------------------------------
+
+const void SnapshotWriter::writeStream(bool all)
+{
+	size_t start = 0;
+	while (this->stream.size() - start >= (size_t)Page::SIZE || (all && start < this->stream.size()))
+	{
+		Page *page;
+		PageId pageNo = allocLeafPage(page);
+		size_t count = std::min(this->stream.size() - start, (size_t)Page::SIZE);
+		memcpy((char *)page, &this->stream[start], count);
+		this->bufMgr->unPinPage(this->file, pageNo, true);
+		start += count;
+	}
+	this->stream.erase(this->stream.begin(), this->stream.begin() + start);
+	this->streamWritten += start;
+}
+
+// -----------------------------------------------------------------------------
+// SnapshotWriter::finish
+// -----------------------------------------------------------------------------
+
+const void SnapshotWriter::finish()
+{
+	if (this->finished)
+	{
+		return;
+	}
+	if (this->compress)
+	{
+		if (this->pendingLeaf->size)
+		{
+			closeCompressedLeaf();
+		}
+		this->leafOffsets.push_back(this->streamWritten + (int)this->stream.size());
+		writeStream(true);
+	}
+	else if (this->leafPage != NULL)
+	{
+		SnapshotLeafInt *leaf = (SnapshotLeafInt *)this->leafPage;
+		this->leafMaxKeys.push_back(leaf->keyArray[leaf->size - 1]);
+		this->bufMgr->unPinPage(this->file, this->leafPageNum, true);
+		this->leafPage = NULL;
+	}
+
+	// Build the levels bottom up. Key i of a block is the largest key under its child i, missing children get INT_MAX
+	std::vector<int> sizes = snapshotLevelSizes(this->leafMaxKeys.size());
+	std::vector<std::vector<int> > levels(sizes.size());
+	for (size_t level = 0; level < sizes.size(); level++)
+	{
+		const std::vector<int> &below = (level == 0) ? this->leafMaxKeys : levels[level - 1];
+		int stride = (level == 0) ? 1 : SNAPSHOT_BLOCK_KEYS;
+		levels[level].assign(sizes[level] * SNAPSHOT_BLOCK_KEYS, INT_MAX);
+		for (int i = 0; i < (int)levels[level].size() && (size_t)i * stride < below.size(); i++)
+		{
+			levels[level][i] = below[(i + 1) * stride - 1];
+		}
+	}
+
+	// Write the blocks top level first, SNAPSHOT_BLOCKS_PER_PAGE to a page
+	SnapshotMetaInfo *meta = (SnapshotMetaInfo *)this->metaPage;
+	meta->numEntries = this->numEntries;
+	meta->numLeaves = this->leafMaxKeys.size();
+	meta->height = sizes.size();
+	std::vector<int> blocks;
+	for (int level = (int)levels.size() - 1; level >= 0; level--)
+	{
+		blocks.insert(blocks.end(), levels[level].begin(), levels[level].end());
+	}
+	meta->numBlocks = blocks.size() / SNAPSHOT_BLOCK_KEYS;
+	const int keysPerPage = SNAPSHOT_BLOCKS_PER_PAGE * SNAPSHOT_BLOCK_KEYS;
+	for (size_t start = 0; start < blocks.size(); start += keysPerPage)
+	{
+		PageId pageNo;
+		Page *page;
+		this->bufMgr->allocPage(this->file, pageNo, page);
+		if (start == 0)
+		{
+			meta->firstBlockPageNo = pageNo;
+		}
+		size_t count = std::min(blocks.size() - start, (size_t)keysPerPage);
+		memcpy((char *)page, &blocks[start], count * sizeof(int));
+		this->bufMgr->unPinPage(this->file, pageNo, true);
+	}
+
+	// The leaf offsets follow the blocks, so a compressed leaf is found without reading the ones before it
+	const int offsetsPerPage = Page::SIZE / sizeof(int);
+	for (size_t start = 0; start < this->leafOffsets.size(); start += offsetsPerPage)
+	{
+		PageId pageNo;
+		Page *page;
+		this->bufMgr->allocPage(this->file, pageNo, page);
+		if (start == 0)
+		{
+			meta->firstOffsetPageNo = pageNo;
+		}
+		size_t count = std::min(this->leafOffsets.size() - start, (size_t)offsetsPerPage);
+		memcpy((char *)page, &this->leafOffsets[start], count * sizeof(int));
+		this->bufMgr->unPinPage(this->file, pageNo, true);
+	}
+
+	this->bufMgr->unPinPage(this->file, this->metaPageNum, true);
+	this->metaPage = NULL;
+	this->finished = true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::BTreeSnapshot -- Constructor
+// -----------------------------------------------------------------------------
+
+BTreeSnapshot::BTreeSnapshot(const std::string &snapshotName, BufMgr *bufMgrIn)
+{
+	this->bufMgr = bufMgrIn;
+	this->scanExecuting = false;
+	this->nextEntry = 0;
+	this->endEntry = 0;
+	this->currentLeafNum = -1;
+	this->currentLeaf = NULL;
+	this->decodedLeaf = NULL;
+	this->decodedLeafNum = -1;
+	this->file = new BlobFile(snapshotName, false);
+
+	Page *metaPage;
+	PageId metaPageNum = this->file->getFirstPageNo();
+	this->bufMgr->readPage(this->file, metaPageNum, metaPage);
+	SnapshotMetaInfo *meta = (SnapshotMetaInfo *)metaPage;
+	this->numEntries = meta->numEntries;
+	this->numLeaves = meta->numLeaves;
+	this->firstLeafPageNum = meta->firstLeafPageNo;
+	int numBlocks = meta->numBlocks;
+	PageId blockPageNum = meta->firstBlockPageNo;
+	int height = meta->height;
+	this->compressed = (meta->compressed != 0);
+	PageId offsetPageNum = meta->firstOffsetPageNo;
+	this->bufMgr->unPinPage(this->file, metaPageNum, false);
+
+	// The inner blocks are small, a few kilobytes for millions of entries, and stay in memory
+	std::vector<int> sizes = snapshotLevelSizes(this->numLeaves);
+	int expectedBlocks = 0;
+	for (size_t level = 0; level < sizes.size(); level++)
+	{
+		expectedBlocks += sizes[level];
+	}
+	if ((int)sizes.size() != height || expectedBlocks != numBlocks)
+	{
+		delete this->file;
+		throw BadgerDbException("Snapshot inner blocks do not match its leaves");
+	}
+	int levelKeys = 0;
+	for (int level = (int)sizes.size() - 1; level >= 0; level--)
+	{
+		this->levelStart.push_back(levelKeys);
+		levelKeys += sizes[level] * SNAPSHOT_BLOCK_KEYS;
+	}
+
+	this->blocks.resize(numBlocks * SNAPSHOT_BLOCK_KEYS);
+	const int keysPerPage = SNAPSHOT_BLOCKS_PER_PAGE * SNAPSHOT_BLOCK_KEYS;
+	for (size_t start = 0; start < this->blocks.size(); start += keysPerPage, blockPageNum++)
+	{
+		Page *page;
+		this->bufMgr->readPage(this->file, blockPageNum, page);
+		size_t count = std::min(this->blocks.size() - start, (size_t)keysPerPage);
+		memcpy(&this->blocks[start], (char *)page, count * sizeof(int));
+		this->bufMgr->unPinPage(this->file, blockPageNum, false);
+	}
+
+	if (this->compressed)
+	{
+		this->leafOffsets.resize(this->numLeaves + 1);
+		const int offsetsPerPage = Page::SIZE / sizeof(int);
+		for (size_t start = 0; start < this->leafOffsets.size(); start += offsetsPerPage, offsetPageNum++)
+		{
+			Page *page;
+			this->bufMgr->readPage(this->file, offsetPageNum, page);
+			size_t count = std::min(this->leafOffsets.size() - start, (size_t)offsetsPerPage);
+			memcpy(&this->leafOffsets[start], (char *)page, count * sizeof(int));
+			this->bufMgr->unPinPage(this->file, offsetPageNum, false);
+		}
+		this->decodedLeaf = new SnapshotLeafInt;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::~BTreeSnapshot -- destructor
+// -----------------------------------------------------------------------------
+
+BTreeSnapshot::~BTreeSnapshot()
+{
+	try
+	{
+		if (this->scanExecuting)
+		{
+			this->endScan();
+		}
+		this->bufMgr->flushFile(this->file);
+	}
+	catch (badgerdb::BadgerDbException e)
+	{
+		std::cerr << e.what() << '\n';
+	}
+	delete this->decodedLeaf;
+	this->decodedLeaf = NULL;
+	delete this->file;
+	this->file = NULL;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::leafPages
+// -----------------------------------------------------------------------------
+
+int BTreeSnapshot::leafPages() const
+{
+	if (this->compressed)
+	{
+		return (this->leafOffsets.back() + Page::SIZE - 1) / Page::SIZE;
+	}
+	return this->numLeaves;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::readLeaf
+// -----------------------------------------------------------------------------
+
+const SnapshotLeafInt *BTreeSnapshot::readLeaf(int leafNum)
+{
+	if (!this->compressed)
+	{
+		Page *page;
+		this->bufMgr->readPage(this->file, this->firstLeafPageNum + leafNum, page);
+		return (SnapshotLeafInt *)page;
+	}
+	if (leafNum != this->decodedLeafNum)
+	{
+		// Gather the compressed bytes, a leaf may run over into the next page
+		int start = this->leafOffsets[leafNum];
+		int end = this->leafOffsets[leafNum + 1];
+		std::vector<unsigned char> bytes(end - start);
+		for (int offset = start; offset < end;)
+		{
+			PageId pageNo = this->firstLeafPageNum + offset / Page::SIZE;
+			int inPage = offset % Page::SIZE;
+			int count = std::min(end - offset, (int)Page::SIZE - inPage);
+			Page *page;
+			this->bufMgr->readPage(this->file, pageNo, page);
+			memcpy(&bytes[offset - start], (char *)page + inPage, count);
+			this->bufMgr->unPinPage(this->file, pageNo, false);
+			offset += count;
+		}
+		decodeLeaf(&bytes[0], std::min(this->numEntries - leafNum * SNAPSHOT_LEAF_SIZE, SNAPSHOT_LEAF_SIZE), this->decodedLeaf);
+		this->decodedLeafNum = leafNum;
+	}
+	return this->decodedLeaf;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::releaseLeaf
+// -----------------------------------------------------------------------------
+
+void BTreeSnapshot::releaseLeaf(int leafNum)
+{
+	// A decompressed leaf holds no page
+	if (!this->compressed)
+	{
+		this->bufMgr->unPinPage(this->file, this->firstLeafPageNum + leafNum, false);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::findLeaf
+// -----------------------------------------------------------------------------
+
+int BTreeSnapshot::findLeaf(int key, bool inclusive) const
+{
+	int block = 0;
+	for (size_t level = 0; level < this->levelStart.size(); level++)
+	{
+		// A key above every key can lead past the last block of a level, where the one above it has no padding
+		size_t levelEnd = level + 1 < this->levelStart.size() ? this->levelStart[level + 1] : this->blocks.size();
+		if (this->levelStart[level] + (size_t)(block + 1) * SNAPSHOT_BLOCK_KEYS > levelEnd)
+		{
+			return this->numLeaves;
+		}
+		const int *keys = &this->blocks[this->levelStart[level] + block * SNAPSHOT_BLOCK_KEYS];
+		// Count the children that end before the key without branching on each comparison, so the loop vectorizes
+		int count = 0;
+		if (inclusive)
+		{
+			for (int i = 0; i < SNAPSHOT_BLOCK_KEYS; i++)
+				count += keys[i] < key;
+		}
+		else
+		{
+			for (int i = 0; i < SNAPSHOT_BLOCK_KEYS; i++)
+				count += keys[i] <= key;
+		}
+		if (count == SNAPSHOT_BLOCK_KEYS)
+		{
+			return this->numLeaves;
+		}
+		block = block * SNAPSHOT_BLOCK_KEYS + count;
+	}
+	return std::min(block, this->numLeaves);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::position
+// -----------------------------------------------------------------------------
+
+int BTreeSnapshot::position(int key, bool inclusive)
+{
+	int leafNum = findLeaf(key, inclusive);
+	if (leafNum >= this->numLeaves)
+	{
+		return this->numEntries;
+	}
+
+	const SnapshotLeafInt *leaf = readLeaf(leafNum);
+	// Branch free binary search, the leaf is known to hold an entry past the key
+	const int *base = leaf->keyArray;
+	int length = leaf->size;
+	while (length > 1)
+	{
+		int half = length / 2;
+		base += keyBefore(base[half - 1], key, inclusive) ? half : 0;
+		length -= half;
+	}
+	int offset = (base - leaf->keyArray) + (keyBefore(*base, key, inclusive) ? 1 : 0);
+	releaseLeaf(leafNum);
+	return leafNum * SNAPSHOT_LEAF_SIZE + offset;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::lookup
+// -----------------------------------------------------------------------------
+
+const void BTreeSnapshot::lookup(const void *keyParm, RecordId &outRid)
+{
+	int key = *(int *)keyParm;
+	int pos = position(key, true);
+	if (pos >= this->numEntries)
+	{
+		throw NoSuchKeyFoundException();
+	}
+
+	int leafNum = pos / SNAPSHOT_LEAF_SIZE;
+	const SnapshotLeafInt *leaf = readLeaf(leafNum);
+	bool found = (leaf->keyArray[pos % SNAPSHOT_LEAF_SIZE] == key);
+	outRid = leaf->ridArray[pos % SNAPSHOT_LEAF_SIZE];
+	releaseLeaf(leafNum);
+	if (!found)
+	{
+		throw NoSuchKeyFoundException();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::startScan
+// -----------------------------------------------------------------------------
+
+const void BTreeSnapshot::startScan(const void *lowValParm,
+									const Operator lowOpParm,
+									const void *highValParm,
+									const Operator highOpParm)
+{
+	if (this->scanExecuting)
+	{
+		this->endScan();
+	}
+	if ((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE))
+	{
+		throw BadOpcodesException();
+	}
+	if (*(int *)lowValParm > *(int *)highValParm)
+	{
+		throw BadScanrangeException();
+	}
+
+	// The scan returns the entries from the first one in range up to the first one past the high bound
+	int first = position(*(int *)lowValParm, lowOpParm == GTE);
+	int end = position(*(int *)highValParm, highOpParm == LT);
+	if (first >= end)
+	{
+		throw NoSuchKeyFoundException();
+	}
+	this->nextEntry = first;
+	this->endEntry = end;
+	this->scanExecuting = true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::scanNext
+// -----------------------------------------------------------------------------
+
+const void BTreeSnapshot::scanNext(RecordId &outRid)
+{
+	if (!this->scanExecuting)
+	{
+		throw ScanNotInitializedException();
+	}
+	if (this->nextEntry >= this->endEntry)
+	{
+		throw IndexScanCompletedException();
+	}
+
+	// The current leaf stays pinned until the scan moves past it. A lookup in between may have decompressed another leaf.
+	int leafNum = this->nextEntry / SNAPSHOT_LEAF_SIZE;
+	if (leafNum != this->currentLeafNum || (this->compressed && leafNum != this->decodedLeafNum))
+	{
+		if (this->currentLeafNum >= 0)
+		{
+			releaseLeaf(this->currentLeafNum);
+			this->currentLeafNum = -1;
+		}
+		this->currentLeaf = readLeaf(leafNum);
+		this->currentLeafNum = leafNum;
+	}
+	outRid = this->currentLeaf->ridArray[this->nextEntry % SNAPSHOT_LEAF_SIZE];
+	this->nextEntry++;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::endScan
+// -----------------------------------------------------------------------------
+
+const void BTreeSnapshot::endScan()
+{
+	if (!this->scanExecuting)
+	{
+		throw ScanNotInitializedException();
+	}
+	if (this->currentLeafNum >= 0)
+	{
+		releaseLeaf(this->currentLeafNum);
+	}
+	this->currentLeaf = NULL;
+	this->currentLeafNum = -1;
+	this->scanExecuting = false;
+	this->nextEntry = 0;
+	this->endEntry = 0;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeSnapshot::countRange
+// -----------------------------------------------------------------------------
+
+const int BTreeSnapshot::countRange(const void *lowValParm,
+									const Operator lowOpParm,
+									const void *highValParm,
+									const Operator highOpParm)
+{
+	if ((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE))
+	{
+		throw BadOpcodesException();
+	}
+	if (*(int *)lowValParm > *(int *)highValParm)
+	{
+		throw BadScanrangeException();
+	}
+
+	int count = position(*(int *)highValParm, highOpParm == LT) - position(*(int *)lowValParm, lowOpParm == GTE);
+	return count > 0 ? count : 0;
+}
+
+}
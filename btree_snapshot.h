@@ -0,0 +1,406 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "btree.h"
+
+namespace badgerdb
+{
+
+/**
+ * @brief Number of keys in one block of the inner search structure of a snapshot. A block fills one cache line,
+ * so it is searched by comparing the key against all of its keys at once instead of branching on each of them.
+ */
+const int SNAPSHOT_BLOCK_KEYS = 16;
+
+/**
+ * @brief Number of inner blocks stored on one page of a snapshot file.
+ */
+const int SNAPSHOT_BLOCKS_PER_PAGE = Page::SIZE / ( SNAPSHOT_BLOCK_KEYS * sizeof( int ) );
+
+/**
+ * @brief Number of entries in a leaf of a snapshot. Every leaf but the last one is full.
+ */
+const int SNAPSHOT_LEAF_SIZE = ( Page::SIZE - sizeof( int ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+
+/**
+ * @brief The meta page of a snapshot file, always its first page.
+ * A snapshot file holds the meta page, then the leaves on consecutive pages, then the inner blocks, then for a
+ * compressed snapshot the leaf offsets.
+*/
+struct SnapshotMetaInfo{
+  /**
+   * Name of base relation.
+   */
+	char relationName[20];
+
+  /**
+   * Offset of attribute, over which the index is built, inside the record stored in pages.
+   */
+	int attrByteOffset;
+
+  /**
+   * Type of the attribute over which the index is built.
+   */
+	Datatype attrType;
+
+  /**
+   * Number of entries in the snapshot.
+   */
+	int numEntries;
+
+  /**
+   * Number of leaves, found on the pages from firstLeafPageNo on.
+   */
+	int numLeaves;
+
+  /**
+   * Page number of the first leaf.
+   */
+	PageId firstLeafPageNo;
+
+  /**
+   * Number of inner blocks, stored from firstBlockPageNo on with the top level first.
+   */
+	int numBlocks;
+
+  /**
+   * Page number of the first page of inner blocks.
+   */
+	PageId firstBlockPageNo;
+
+  /**
+   * Number of levels of inner blocks.
+   */
+	int height;
+
+  /**
+   * 1 if the leaves are compressed. Compressed leaves are packed one after the other into a byte stream that runs over
+   * the pages from firstLeafPageNo on, and numLeaves + 1 byte offsets into that stream, the last one being its length,
+   * are stored from firstOffsetPageNo on.
+   */
+	int compressed;
+	PageId firstOffsetPageNo;
+};
+
+/**
+ * @brief Structure of a snapshot leaf. Keys and record ids are kept in separate arrays so the keys are contiguous.
+ * A compressed leaf is stored as its first key, the differences between consecutive keys, and for every record id
+ * the difference to the page number of the one before and the slot number, all as variable length integers.
+*/
+struct SnapshotLeafInt{
+  /**
+   * Stores the number of keys.
+   */
+	int size;
+
+  /**
+   * Stores keys.
+   */
+	int keyArray[ SNAPSHOT_LEAF_SIZE ];
+
+  /**
+   * Stores RecordIds.
+   */
+	RecordId ridArray[ SNAPSHOT_LEAF_SIZE ];
+};
+
+/**
+ * @brief Writes the entries of an index, in key order, into a new snapshot file.
+*/
+class SnapshotWriter {
+
+ private:
+
+  /**
+   * File object for the snapshot file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Meta page of the snapshot and its page number, pinned until finish().
+   */
+	Page		*metaPage;
+	PageId	metaPageNum;
+
+  /**
+   * Leaf being filled and its page number, NULL if there is none.
+   */
+	Page		*leafPage;
+	PageId	leafPageNum;
+
+  /**
+   * Number of entries written so far.
+   */
+	int			numEntries;
+
+  /**
+   * Largest key of every full leaf.
+   */
+	std::vector<int>	leafMaxKeys;
+
+  /**
+   * True once finish() wrote the inner blocks.
+   */
+	bool		finished;
+
+  /**
+   * True if the leaves are compressed.
+   */
+	bool		compress;
+
+  /**
+   * Leaf being filled before it is compressed, NULL unless the leaves are compressed.
+   */
+	SnapshotLeafInt	*pendingLeaf;
+
+  /**
+   * Compressed bytes not written to a page yet, and the offset of every compressed leaf in the stream.
+   */
+	std::vector<unsigned char>	stream;
+	std::vector<int>	leafOffsets;
+
+  /**
+   * Number of bytes of the stream written to pages.
+   */
+	int			streamWritten;
+
+  /**
+   * Allocate the next leaf page, which has to follow the one before.
+   * @param page  the new page, pinned
+   * @return its page number
+   */
+	PageId allocLeafPage(Page *&page);
+
+  /**
+   * Compress the pending leaf into the stream and write out the pages it filled.
+   */
+	const void closeCompressedLeaf();
+
+  /**
+   * Write the full pages of the stream, and the partial last one too if requested.
+   * @param all  true to write out the partial last page
+   */
+	const void writeStream(bool all);
+
+ public:
+
+  /**
+   * Create the snapshot file. A file of that name is replaced.
+   * @param snapshotName    Name of the snapshot file
+   * @param bufMgrIn        Buffer Manager Instance
+   * @param relationName    Name of the indexed relation
+   * @param attrByteOffset  Offset of the indexed attribute inside records
+   * @param attrType        Type of the indexed attribute
+   * @param compress        True to compress the leaves
+   */
+	SnapshotWriter(const std::string & snapshotName, BufMgr *bufMgrIn, const std::string & relationName,
+				   const int attrByteOffset, const Datatype attrType, const bool compress = false);
+
+  /**
+   * Flush the snapshot file and release it. An unfinished snapshot is finished first.
+   */
+	~SnapshotWriter();
+
+  /**
+   * Append an entry. Entries must come in key order.
+   * @param key  Key of the entry
+   * @param rid  Record ID of the entry
+   */
+	const void append(const int key, const RecordId rid);
+
+  /**
+   * Close the last leaf and write the inner blocks above the leaves.
+   */
+	const void finish();
+};
+
+/**
+ * @brief Immutable, read-optimized copy of a BTreeIndex, written by BTreeIndex::exportSnapshot().
+ * The leaves are completely full and laid out on consecutive pages, so the position of an entry gives its page.
+ * Above them, the largest key of every leaf is kept in an implicit B-ary search tree of SNAPSHOT_BLOCK_KEYS key blocks.
+ * Child i of block b on one level is block b * SNAPSHOT_BLOCK_KEYS + i on the next, so the tree stores no page
+ * numbers and is held in memory while the snapshot is open. A lookup reads a single leaf page.
+ * A compressed snapshot is smaller on disk and reads fewer pages per scan; its leaves are decompressed when read.
+ * It supports the scan and count semantics of BTreeIndex. This index supports only one scan at a time.
+*/
+class BTreeSnapshot {
+
+ private:
+
+  /**
+   * File object for the snapshot file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Number of entries, leaves and the page of the first leaf.
+   */
+	int			numEntries;
+	int			numLeaves;
+	PageId	firstLeafPageNum;
+
+  /**
+   * Inner blocks of all levels, top level first, and where each level starts.
+   */
+	std::vector<int>	blocks;
+	std::vector<int>	levelStart;
+
+  /**
+   * True if the leaves are compressed, and the offset of every leaf in the compressed stream.
+   */
+	bool		compressed;
+	std::vector<int>	leafOffsets;
+
+  /**
+   * Last leaf decompressed and its number, -1 if none.
+   */
+	SnapshotLeafInt	*decodedLeaf;
+	int			decodedLeafNum;
+
+	// MEMBERS SPECIFIC TO SCANNING
+
+  /**
+   * True if a scan has been started.
+   */
+	bool		scanExecuting;
+
+  /**
+   * Position of the next entry to be returned and the position the scan stops at.
+   */
+	int			nextEntry;
+	int			endEntry;
+
+  /**
+   * Number of the leaf being scanned, held by readLeaf() while the scan is on it, -1 if none.
+   */
+	int			currentLeafNum;
+
+  /**
+   * Leaf being scanned.
+   */
+	const SnapshotLeafInt	*currentLeaf;
+
+  /**
+   * Get a leaf, pinning its page or decompressing it. Every call is matched by releaseLeaf().
+   * @param leafNum  the leaf number, counting from 0
+   */
+	const SnapshotLeafInt *readLeaf(int leafNum);
+
+  /**
+   * Release a leaf got from readLeaf().
+   * @param leafNum  the leaf number
+   */
+	void releaseLeaf(int leafNum);
+
+  /**
+   * Find the leaf that holds the first entry above the key, or numLeaves if there is none.
+   * @param key        Key to search for
+   * @param inclusive  True to find the first entry >= key, false to find the first entry > key
+   * @return the leaf number, counting from 0
+   */
+	int findLeaf(int key, bool inclusive) const;
+
+  /**
+   * Position of the first entry above the key, or numEntries if there is none.
+   * @param key        Key to search for
+   * @param inclusive  True to find the first entry >= key, false to find the first entry > key
+   * @return the position of the entry, counting from 0
+   */
+	int position(int key, bool inclusive);
+
+ public:
+
+  /**
+   * Open a snapshot file.
+   * @param snapshotName  Name of the snapshot file
+   * @param bufMgrIn      Buffer Manager Instance
+   */
+	BTreeSnapshot(const std::string & snapshotName, BufMgr *bufMgrIn);
+
+  /**
+   * End any ongoing scan and release the snapshot file.
+   */
+	~BTreeSnapshot();
+
+  /**
+   * Number of entries in the snapshot.
+   */
+	int size() const { return numEntries; }
+
+  /**
+   * Number of pages holding the leaves.
+   */
+	int leafPages() const;
+
+  /**
+   * Find the first entry with the given key.
+   * @param key     Key to look up
+   * @param outRid  Record ID of the entry
+   * @throws  NoSuchKeyFoundException If no entry has the key
+   */
+	const void lookup(const void* key, RecordId& outRid);
+
+  /**
+   * Begin a filtered scan of the snapshot, as BTreeIndex::startScan().
+   * @param lowVal   Low value of range, pointer to integer
+   * @param lowOp    Low operator (GT/GTE)
+   * @param highVal  High value of range, pointer to integer
+   * @param highOp   High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in the snapshot which satisfies the scan criteria.
+   */
+	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+  /**
+   * Fetch the record id of the next entry that matches the scan.
+   * @param outRid  RecordId of next record found that satisfies the scan criteria
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   * @throws IndexScanCompletedException If no more records satisfying the scan criteria are left to be scanned.
+   */
+	const void scanNext(RecordId& outRid);
+
+  /**
+   * Terminate the current scan.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   */
+	const void endScan();
+
+  /**
+   * Count the entries in a range, as BTreeIndex::countRange(). Since every leaf but the last is full, the count is
+   * the difference of two positions and reads at most two leaves.
+   * @param lowVal   Low value of range, pointer to integer
+   * @param lowOp    Low operator (GT/GTE)
+   * @param highVal  High value of range, pointer to integer
+   * @param highOp   High operator (LT/LTE)
+   * @return number of entries in the range
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   */
+	const int countRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+};
+
+}
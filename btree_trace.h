@@ -0,0 +1,170 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+/**
+ * @brief Trace levels. Events above BTREE_TRACE_LEVEL are compiled out, the rest are appended to the trace ring.
+ */
+#define BTREE_TRACE_LEVEL_OFF 0
+#define BTREE_TRACE_LEVEL_ERROR 1
+#define BTREE_TRACE_LEVEL_INFO 2
+#define BTREE_TRACE_LEVEL_DEBUG 3
+
+#ifndef BTREE_TRACE_LEVEL
+#define BTREE_TRACE_LEVEL BTREE_TRACE_LEVEL_ERROR
+#endif
+
+/**
+ * @brief Number of records kept by the trace ring. Must be a power of two.
+ */
+#ifndef BTREE_TRACE_RING_SIZE
+#define BTREE_TRACE_RING_SIZE 4096
+#endif
+
+#if BTREE_TRACE_LEVEL >= BTREE_TRACE_LEVEL_ERROR
+#define BTREE_TRACE_ERROR(event, a, b) badgerdb::traceRing().append(BTREE_TRACE_LEVEL_ERROR, event, a, b)
+#else
+#define BTREE_TRACE_ERROR(event, a, b) ((void)0)
+#endif
+
+#if BTREE_TRACE_LEVEL >= BTREE_TRACE_LEVEL_INFO
+#define BTREE_TRACE_INFO(event, a, b) badgerdb::traceRing().append(BTREE_TRACE_LEVEL_INFO, event, a, b)
+#else
+#define BTREE_TRACE_INFO(event, a, b) ((void)0)
+#endif
+
+#if BTREE_TRACE_LEVEL >= BTREE_TRACE_LEVEL_DEBUG
+#define BTREE_TRACE_DEBUG(event, a, b) badgerdb::traceRing().append(BTREE_TRACE_LEVEL_DEBUG, event, a, b)
+#else
+#define BTREE_TRACE_DEBUG(event, a, b) ((void)0)
+#endif
+
+namespace badgerdb
+{
+
+/**
+ * @brief Events written to the trace ring. The meaning of the two arguments is given per event.
+ */
+enum TraceEvent
+{
+	TRACE_BUILD_DONE = 0,    /* records inserted, root page */
+	TRACE_INSERT_ENTRY = 1,  /* key, rid page number */
+	TRACE_LEAF_SPLIT = 2,    /* split page, new page */
+	TRACE_INTERNAL_SPLIT = 3,/* split page, new page */
+	TRACE_ROOT_CHANGE = 4,   /* new root page, old root page */
+	TRACE_START_SCAN = 5,    /* low value, high value */
+	TRACE_UNPIN_FAILED = 6,  /* page number, 0 */
+	TRACE_CHECKPOINT = 7,    /* checkpoint sequence number, current root page */
+	TRACE_NODE_MERGE = 8,    /* surviving page, freed page */
+	NUM_TRACE_EVENTS = 9
+};
+
+/**
+ * @brief One record of the trace ring.
+ */
+struct TraceRecord
+{
+  /**
+   * Position of the record in the trace, starting at 1. 0 while the record is being written.
+   */
+	std::atomic<std::uint64_t> seq;
+
+	int level;
+	int event;
+	std::int64_t a;
+	std::int64_t b;
+};
+
+/**
+ * @brief Fixed size ring of trace records. Appending takes one atomic increment and never blocks or allocates,
+ * so tracing can stay enabled in hot paths. Once full, the oldest records are overwritten.
+ */
+class TraceRing
+{
+public:
+	TraceRing() : head(0)
+	{
+		for (int i = 0; i < BTREE_TRACE_RING_SIZE; i++)
+			records[i].seq.store(0, std::memory_order_relaxed);
+	}
+
+  /**
+   * Append a record.
+   * @param level  trace level of the event
+   * @param event  the TraceEvent
+   * @param a      first argument of the event
+   * @param b      second argument of the event
+   */
+	void append(int level, int event, std::int64_t a, std::int64_t b)
+	{
+		std::uint64_t pos = head.fetch_add(1, std::memory_order_relaxed);
+		TraceRecord &record = records[pos & (BTREE_TRACE_RING_SIZE - 1)];
+		record.seq.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		record.level = level;
+		record.event = event;
+		record.a = a;
+		record.b = b;
+		record.seq.store(pos + 1, std::memory_order_release);
+	}
+
+  /**
+   * Write the records still in the ring as text, oldest first. Records being overwritten while dumping are skipped.
+   * @param out  stream to write to
+   */
+	void dump(std::ostream &out)
+	{
+		static const char *levelNames[] = {"off", "error", "info", "debug"};
+		static const char *eventNames[NUM_TRACE_EVENTS] = {"build_done", "insert_entry", "leaf_split", "internal_split",
+														   "root_change", "start_scan", "unpin_failed", "checkpoint",
+														   "node_merge"};
+		std::uint64_t end = head.load(std::memory_order_acquire);
+		std::uint64_t begin = end > BTREE_TRACE_RING_SIZE ? end - BTREE_TRACE_RING_SIZE : 0;
+		for (std::uint64_t pos = begin; pos < end; pos++)
+		{
+			TraceRecord &record = records[pos & (BTREE_TRACE_RING_SIZE - 1)];
+			if (record.seq.load(std::memory_order_acquire) != pos + 1)
+				continue;
+			int level = record.level;
+			int event = record.event;
+			std::int64_t a = record.a;
+			std::int64_t b = record.b;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (record.seq.load(std::memory_order_relaxed) != pos + 1)
+				continue;
+			out << pos + 1 << ' ' << levelNames[level] << ' ' << eventNames[event] << ' ' << a << ' ' << b << '\n';
+		}
+	}
+
+  /**
+   * Number of records appended so far, including overwritten ones.
+   */
+	std::uint64_t appended() const
+	{
+		return head.load(std::memory_order_relaxed);
+	}
+
+private:
+	TraceRecord records[BTREE_TRACE_RING_SIZE];
+	std::atomic<std::uint64_t> head;
+};
+
+/**
+ * @brief The process wide trace ring.
+ */
+inline TraceRing &traceRing()
+{
+	static TraceRing ring;
+	return ring;
+}
+
+}
@@ -0,0 +1,396 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "hash_index.h"
+#include "filescan.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/badgerdb_exception.h"
+#include <cstring>
+
+namespace badgerdb
+{
+
+// -----------------------------------------------------------------------------
+// HashIndex::HashIndex -- Constructor
+// -----------------------------------------------------------------------------
+
+HashIndex::HashIndex(const std::string &relationName,
+					 std::string &outIndexName,
+					 BufMgr *bufMgrIn,
+					 const int attrByteOffset,
+					 const Datatype attrType)
+{
+	this->bufMgr = bufMgrIn;
+	this->attrByteOffset = attrByteOffset;
+	this->attributeType = attrType;
+	this->globalDepth = 0;
+	this->numEntries = 0;
+	this->directoryChanged = false;
+	//------Create the name of index file------//
+	std::ostringstream idxStr;
+	idxStr << relationName << ".hash." << attrByteOffset;
+	outIndexName = idxStr.str();
+
+	if (File::exists(outIndexName))
+	{
+		this->file = new BlobFile(outIndexName, false);
+		this->headerPageNum = this->file->getFirstPageNo();
+		Page *meta;
+		this->bufMgr->readPage(this->file, this->headerPageNum, meta);
+		HashMetaInfo *metaPage = (HashMetaInfo *)meta;
+		if (metaPage->attrByteOffset != attrByteOffset || metaPage->relationName != relationName || metaPage->attrType != attrType)
+		{
+			//Unpin the meta page and drop it from the pool before throwing the exception, or a file opened later at
+			//the same address would be served this page
+			this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+			this->bufMgr->flushFile(this->file);
+			delete this->file;
+			throw badgerdb::BadIndexInfoException("MetaInfo mismatch!");
+		}
+		this->globalDepth = metaPage->globalDepth;
+		this->numEntries = metaPage->numEntries;
+		std::vector<PageId> dirPageNos(metaPage->dirPageNos, metaPage->dirPageNos + metaPage->numDirPages);
+		this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+
+		// The directory is read once and kept in memory, so a probe only reads its bucket
+		this->directory.resize(1 << this->globalDepth);
+		for (size_t dirPage = 0; dirPage < dirPageNos.size(); dirPage++)
+		{
+			Page *page;
+			this->bufMgr->readPage(this->file, dirPageNos[dirPage], page);
+			size_t start = dirPage * HASH_DIR_PAGE_SLOTS;
+			size_t count = std::min(this->directory.size() - start, (size_t)HASH_DIR_PAGE_SLOTS);
+			memcpy(&this->directory[start], (char *)page, count * sizeof(PageId));
+			this->bufMgr->unPinPage(this->file, dirPageNos[dirPage], false);
+		}
+	}
+	else
+	{
+		this->file = new BlobFile(outIndexName, true);
+		Page *meta;
+		this->bufMgr->allocPage(this->file, this->headerPageNum, meta);
+		HashMetaInfo *metaPage = (HashMetaInfo *)meta;
+		memset(metaPage, 0, sizeof(HashMetaInfo));
+		strncpy(metaPage->relationName, relationName.c_str(), sizeof(metaPage->relationName) - 1);
+		metaPage->attrByteOffset = attrByteOffset;
+		metaPage->attrType = attrType;
+		this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+
+		// Start with a single bucket that every key maps to
+		PageId bucketNo;
+		Page *page;
+		this->bufMgr->allocPage(this->file, bucketNo, page);
+		HashBucketInt *bucket = (HashBucketInt *)page;
+		bucket->localDepth = 0;
+		bucket->size = 0;
+		bucket->overflowPageNo = 0;
+		this->bufMgr->unPinPage(this->file, bucketNo, true);
+		this->directory.push_back(bucketNo);
+		this->directoryChanged = true;
+
+		//Scan all tuples in the relation. Insert all tuples into the index.
+		FileScan scn(relationName, bufMgrIn);
+		try
+		{
+			RecordId scanRid;
+			std::string recordStr;
+			while (1)
+			{
+				scn.scanNext(scanRid);
+				recordStr = scn.getRecord();
+				int key;
+				memcpy(&key, recordStr.c_str() + attrByteOffset, sizeof(int));
+				insertEntry(&key, scanRid);
+			}
+		}
+		catch (const badgerdb::EndOfFileException &e)
+		{
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::~HashIndex -- destructor
+// -----------------------------------------------------------------------------
+
+HashIndex::~HashIndex()
+{
+	try
+	{
+		if (this->directoryChanged)
+		{
+			this->writeDirectory();
+		}
+		this->bufMgr->flushFile(this->file);
+	}
+	catch (badgerdb::BadgerDbException e)
+	{
+		std::cerr << e.what() << '\n';
+	}
+	delete this->file;
+	this->file = NULL;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::hashKey
+// -----------------------------------------------------------------------------
+
+unsigned int HashIndex::hashKey(int key)
+{
+	// Mix every bit of the key into the low bits, which pick the slot; consecutive keys would otherwise fill
+	// the directory unevenly once buckets split
+	unsigned int hash = (unsigned int)key;
+	hash ^= hash >> 16;
+	hash *= 0x7feb352dU;
+	hash ^= hash >> 15;
+	hash *= 0x846ca68bU;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+const void HashIndex::insertEntry(const void *keyParm, const RecordId rid)
+{
+	int key = *(int *)keyParm;
+	unsigned int hash = hashKey(key);
+	while (1)
+	{
+		unsigned int slot = hash & ((1U << this->globalDepth) - 1);
+		PageId bucketNo = this->directory[slot];
+		Page *page;
+		this->bufMgr->readPage(this->file, bucketNo, page);
+		HashBucketInt *bucket = (HashBucketInt *)page;
+		if (bucket->size < HASH_BUCKET_SIZE)
+		{
+			bucket->keyArray[bucket->size] = key;
+			bucket->ridArray[bucket->size] = rid;
+			bucket->size++;
+			this->bufMgr->unPinPage(this->file, bucketNo, true);
+			break;
+		}
+
+		// A split cannot separate keys that hash alike, such a bucket grows an overflow chain instead
+		bool sameHash = true;
+		for (int i = 0; i < bucket->size && sameHash; i++)
+		{
+			sameHash = (hashKey(bucket->keyArray[i]) == hash);
+		}
+		int localDepth = bucket->localDepth;
+		this->bufMgr->unPinPage(this->file, bucketNo, false);
+		if (sameHash || localDepth == HASH_MAX_GLOBAL_DEPTH)
+		{
+			insertOverflow(bucketNo, key, rid);
+			break;
+		}
+		splitBucket(slot);
+	}
+	this->numEntries++;
+	this->directoryChanged = true;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::splitBucket
+// -----------------------------------------------------------------------------
+
+const void HashIndex::splitBucket(unsigned int slot)
+{
+	PageId oldNo = this->directory[slot];
+	Page *oldPage;
+	this->bufMgr->readPage(this->file, oldNo, oldPage);
+	HashBucketInt *oldBucket = (HashBucketInt *)oldPage;
+	int depth = oldBucket->localDepth;
+	if (depth == this->globalDepth)
+	{
+		// Double the directory, the upper half points to the same buckets as the lower half
+		size_t slots = this->directory.size();
+		this->directory.resize(2 * slots);
+		std::copy(this->directory.begin(), this->directory.begin() + slots, this->directory.begin() + slots);
+		this->globalDepth++;
+	}
+
+	PageId newNo;
+	Page *newPage;
+	this->bufMgr->allocPage(this->file, newNo, newPage);
+	HashBucketInt *newBucket = (HashBucketInt *)newPage;
+	newBucket->localDepth = depth + 1;
+	newBucket->size = 0;
+	newBucket->overflowPageNo = 0;
+	oldBucket->localDepth = depth + 1;
+
+	// Entries whose next hash bit is set move to the new bucket
+	int keep = 0;
+	for (int i = 0; i < oldBucket->size; i++)
+	{
+		if ((hashKey(oldBucket->keyArray[i]) >> depth) & 1)
+		{
+			newBucket->keyArray[newBucket->size] = oldBucket->keyArray[i];
+			newBucket->ridArray[newBucket->size] = oldBucket->ridArray[i];
+			newBucket->size++;
+		}
+		else
+		{
+			oldBucket->keyArray[keep] = oldBucket->keyArray[i];
+			oldBucket->ridArray[keep] = oldBucket->ridArray[i];
+			keep++;
+		}
+	}
+	oldBucket->size = keep;
+	// Only a bucket whose keys all hash alike has overflow pages, they go wherever its entries went
+	if (oldBucket->overflowPageNo != 0 && newBucket->size > 0)
+	{
+		newBucket->overflowPageNo = oldBucket->overflowPageNo;
+		oldBucket->overflowPageNo = 0;
+	}
+
+	for (size_t i = 0; i < this->directory.size(); i++)
+	{
+		if (this->directory[i] == oldNo && ((i >> depth) & 1))
+		{
+			this->directory[i] = newNo;
+		}
+	}
+	this->bufMgr->unPinPage(this->file, oldNo, true);
+	this->bufMgr->unPinPage(this->file, newNo, true);
+	this->directoryChanged = true;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::insertOverflow
+// -----------------------------------------------------------------------------
+
+const void HashIndex::insertOverflow(PageId bucketNo, int key, const RecordId rid)
+{
+	PageId pageNo = bucketNo;
+	Page *page;
+	this->bufMgr->readPage(this->file, pageNo, page);
+	HashBucketInt *bucket = (HashBucketInt *)page;
+	while (bucket->size == HASH_BUCKET_SIZE)
+	{
+		PageId nextNo = bucket->overflowPageNo;
+		Page *next;
+		if (nextNo == 0)
+		{
+			this->bufMgr->allocPage(this->file, nextNo, next);
+			HashBucketInt *overflow = (HashBucketInt *)next;
+			overflow->localDepth = bucket->localDepth;
+			overflow->size = 0;
+			overflow->overflowPageNo = 0;
+			bucket->overflowPageNo = nextNo;
+			this->bufMgr->unPinPage(this->file, pageNo, true);
+		}
+		else
+		{
+			this->bufMgr->unPinPage(this->file, pageNo, false);
+			this->bufMgr->readPage(this->file, nextNo, next);
+		}
+		pageNo = nextNo;
+		bucket = (HashBucketInt *)next;
+	}
+	bucket->keyArray[bucket->size] = key;
+	bucket->ridArray[bucket->size] = rid;
+	bucket->size++;
+	this->bufMgr->unPinPage(this->file, pageNo, true);
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::lookup
+// -----------------------------------------------------------------------------
+
+const void HashIndex::lookup(const void *keyParm, RecordId &outRid)
+{
+	int key = *(int *)keyParm;
+	PageId pageNo = this->directory[hashKey(key) & ((1U << this->globalDepth) - 1)];
+	while (pageNo != 0)
+	{
+		Page *page;
+		this->bufMgr->readPage(this->file, pageNo, page);
+		HashBucketInt *bucket = (HashBucketInt *)page;
+		for (int i = 0; i < bucket->size; i++)
+		{
+			if (bucket->keyArray[i] == key)
+			{
+				outRid = bucket->ridArray[i];
+				this->bufMgr->unPinPage(this->file, pageNo, false);
+				return;
+			}
+		}
+		PageId nextNo = bucket->overflowPageNo;
+		this->bufMgr->unPinPage(this->file, pageNo, false);
+		pageNo = nextNo;
+	}
+	throw NoSuchKeyFoundException();
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::lookupAll
+// -----------------------------------------------------------------------------
+
+const int HashIndex::lookupAll(const void *keyParm, std::vector<RecordId> &outRids)
+{
+	int key = *(int *)keyParm;
+	int found = 0;
+	PageId pageNo = this->directory[hashKey(key) & ((1U << this->globalDepth) - 1)];
+	while (pageNo != 0)
+	{
+		Page *page;
+		this->bufMgr->readPage(this->file, pageNo, page);
+		HashBucketInt *bucket = (HashBucketInt *)page;
+		for (int i = 0; i < bucket->size; i++)
+		{
+			if (bucket->keyArray[i] == key)
+			{
+				outRids.push_back(bucket->ridArray[i]);
+				found++;
+			}
+		}
+		PageId nextNo = bucket->overflowPageNo;
+		this->bufMgr->unPinPage(this->file, pageNo, false);
+		pageNo = nextNo;
+	}
+	return found;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::writeDirectory
+// -----------------------------------------------------------------------------
+
+const void HashIndex::writeDirectory()
+{
+	Page *meta;
+	this->bufMgr->readPage(this->file, this->headerPageNum, meta);
+	HashMetaInfo *metaPage = (HashMetaInfo *)meta;
+	int dirPages = (int)((this->directory.size() + HASH_DIR_PAGE_SLOTS - 1) / HASH_DIR_PAGE_SLOTS);
+	for (int dirPage = 0; dirPage < dirPages; dirPage++)
+	{
+		Page *page;
+		if (dirPage < metaPage->numDirPages)
+		{
+			this->bufMgr->readPage(this->file, metaPage->dirPageNos[dirPage], page);
+		}
+		else
+		{
+			// The directory only grows, pages of a smaller directory are reused
+			this->bufMgr->allocPage(this->file, metaPage->dirPageNos[dirPage], page);
+			metaPage->numDirPages = dirPage + 1;
+		}
+		size_t start = dirPage * HASH_DIR_PAGE_SLOTS;
+		size_t count = std::min(this->directory.size() - start, (size_t)HASH_DIR_PAGE_SLOTS);
+		memcpy((char *)page, &this->directory[start], count * sizeof(PageId));
+		this->bufMgr->unPinPage(this->file, metaPage->dirPageNos[dirPage], true);
+	}
+	metaPage->globalDepth = this->globalDepth;
+	metaPage->numEntries = this->numEntries;
+	this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+	this->directoryChanged = false;
+}
+
+}
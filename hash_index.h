@@ -0,0 +1,240 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "btree.h"
+
+namespace badgerdb
+{
+
+/**
+ * @brief Number of entries in one bucket page of a hash index.
+ */
+const int HASH_BUCKET_SIZE = ( Page::SIZE - 2 * sizeof( int ) - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+
+/**
+ * @brief Number of directory slots stored on one directory page.
+ */
+const int HASH_DIR_PAGE_SLOTS = Page::SIZE / sizeof( PageId );
+
+/**
+ * @brief Largest global depth of the directory. A bucket that is full at this depth grows an overflow chain instead
+ * of splitting.
+ */
+const int HASH_MAX_GLOBAL_DEPTH = 20;
+
+/**
+ * @brief Number of directory pages of a directory at the largest global depth.
+ */
+const int HASH_MAX_DIR_PAGES = ( 1 << HASH_MAX_GLOBAL_DEPTH ) / HASH_DIR_PAGE_SLOTS;
+
+/**
+ * @brief The meta page of a hash index file, always its first page.
+*/
+struct HashMetaInfo{
+  /**
+   * Name of base relation.
+   */
+	char relationName[20];
+
+  /**
+   * Offset of attribute, over which the index is built, inside the record stored in pages.
+   */
+	int attrByteOffset;
+
+  /**
+   * Type of the attribute over which the index is built.
+   */
+	Datatype attrType;
+
+  /**
+   * Number of low hash bits that select a directory slot.
+   */
+	int globalDepth;
+
+  /**
+   * Number of entries in the index.
+   */
+	int numEntries;
+
+  /**
+   * Number of directory pages and their page numbers, in slot order.
+   */
+	int numDirPages;
+	PageId dirPageNos[ HASH_MAX_DIR_PAGES ];
+};
+
+/**
+ * @brief Structure of a bucket page. The overflow pages of a bucket have the same structure.
+*/
+struct HashBucketInt{
+  /**
+   * Number of low hash bits shared by all keys of the bucket. 2^(globalDepth - localDepth) directory slots
+   * point to the bucket.
+   */
+	int localDepth;
+
+  /**
+   * Stores the number of entries on this page.
+   */
+	int size;
+
+  /**
+   * Page number of the next overflow page of the bucket, 0 if there is none.
+   */
+	PageId overflowPageNo;
+
+  /**
+   * Stores keys.
+   */
+	int keyArray[ HASH_BUCKET_SIZE ];
+
+  /**
+   * Stores RecordIds.
+   */
+	RecordId ridArray[ HASH_BUCKET_SIZE ];
+};
+
+/**
+ * @brief Extendible hash index over an integer attribute of a relation, for equality probes.
+ * The directory of bucket page numbers is held in memory while the index is open, so a probe reads one bucket page,
+ * plus the overflow pages of buckets whose keys all hash alike (long runs of a duplicate key).
+ * A full bucket splits on one more hash bit, doubling the directory when the bucket already uses all of its bits.
+*/
+class HashIndex {
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * Offset of attribute, over which the index is built, inside records.
+   */
+	int			attrByteOffset;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+	Datatype	attributeType;
+
+  /**
+   * Number of low hash bits that select a directory slot.
+   */
+	int			globalDepth;
+
+  /**
+   * Page number of the bucket of every directory slot.
+   */
+	std::vector<PageId>	directory;
+
+  /**
+   * Number of entries in the index.
+   */
+	int			numEntries;
+
+  /**
+   * True if the directory or the entry count changed since they were written to the meta and directory pages.
+   */
+	bool		directoryChanged;
+
+  /**
+   * Hash of a key. The directory slot of the key is given by its low globalDepth bits.
+   * @param key  Key to hash
+   */
+	static unsigned int hashKey(int key);
+
+  /**
+   * Split a bucket on its next hash bit into itself and a new bucket, doubling the directory if needed.
+   * @param slot  A directory slot of the bucket
+   */
+	const void splitBucket(unsigned int slot);
+
+  /**
+   * Add an entry to the overflow chain of a bucket, adding an overflow page if the chain is full.
+   * @param bucketNo  Page number of the bucket
+   * @param key       Key of the entry
+   * @param rid       Record ID of the entry
+   */
+	const void insertOverflow(PageId bucketNo, int key, const RecordId rid);
+
+  /**
+   * Write the directory and the entry count to the meta and directory pages.
+   */
+	const void writeDirectory();
+
+ public:
+
+  /**
+   * HashIndex Constructor.
+   * Open the index file if it exists. If not, create it and insert entries for every tuple in the base relation.
+   * @param relationName    Name of the indexed relation
+   * @param outIndexName    Return the name of index file
+   * @param bufMgrIn        Buffer Manager Instance
+   * @param attrByteOffset  Offset of attribute, over which index is to be built, in the record
+   * @param attrType        Datatype of attribute over which index is built
+   * @throws  BadIndexInfoException  If the index file already exists, but its meta page does not match the parameters.
+   */
+	HashIndex(const std::string & relationName, std::string & outIndexName,
+						BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType);
+
+  /**
+   * HashIndex Destructor.
+   * Write the directory, flush the index file and close it. Exceptions are caught in here.
+   */
+	~HashIndex();
+
+  /**
+   * Number of entries in the index.
+   */
+	int size() const { return numEntries; }
+
+  /**
+   * Insert a new entry using the pair <value,rid>.
+   * @param key  Key to insert, pointer to integer
+   * @param rid  Record ID of a record whose entry is getting inserted into the index.
+   */
+	const void insertEntry(const void* key, const RecordId rid);
+
+  /**
+   * Find an entry with the given key.
+   * @param key     Key to look up, pointer to integer
+   * @param outRid  Record ID of the entry
+   * @throws  NoSuchKeyFoundException If no entry has the key
+   */
+	const void lookup(const void* key, RecordId& outRid);
+
+  /**
+   * Find all entries with the given key.
+   * @param key      Key to look up, pointer to integer
+   * @param outRids  Record IDs of the entries are appended here
+   * @return number of entries found
+   */
+	const int lookupAll(const void* key, std::vector<RecordId>& outRids);
+};
+
+}
@@ -5,8 +5,13 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <climits>
 #include <vector>
 #include "btree.h"
+#include "btree_snapshot.h"
+#include "hash_index.h"
+#include "btree_fetch.h"
+#include "btree_join.h"
 #include "page.h"
 #include "filescan.h"
 #include "page_iterator.h"
@@ -17,6 +22,7 @@
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_index_info_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
 
@@ -73,8 +79,25 @@ void newCreateRelationBackward(int newRelationSize);
 void newCreateRelationRandom(int newRelationSize);
 void newIndexTests();
 void intTests();
+void mappedIntTests();
+void snapshotIntTests();
+void hashIntTests();
+void learnedIntTests();
+void frontIndexIntTests();
+void filterIntTests();
+void heapFetchIntTests();
+void joinIntTests();
+void insertIntTests();
+void splitPolicyIntTests();
+void nodeBufferIntTests();
+int intJoin(BTreeIndex *index, int batchSize, int &selfPairs);
+void parallelBuildIntTests();
+void multiBuildIntTests();
 void newIntTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int intCount(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int intFilterScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, const KeyPredicate &filter, int batchSize);
+void rankTests(BTreeIndex *index);
 void indexTests();
 void test1();
 void test2();
@@ -89,7 +112,7 @@ void deleteRelation();
 int main(int argc, char **argv)
 {
 
-	std::cout << "leaf size:" << INTARRAYLEAFSIZE << " non-leaf size:" << INTARRAYNONLEAFSIZE << std::endl;
+	std::cout << "node size:" << NODE_SIZE << " leaf size:" << INTARRAYLEAFSIZE << " non-leaf size:" << INTARRAYNONLEAFSIZE << std::endl;
 
 	// Clean up from any previous runs that crashed.
 	try
@@ -602,6 +625,33 @@ void indexTests()
 	if (testNum == 1)
 	{
 		intTests();
+		mappedIntTests();
+		snapshotIntTests();
+		hashIntTests();
+		learnedIntTests();
+		frontIndexIntTests();
+		filterIntTests();
+		heapFetchIntTests();
+		joinIntTests();
+		insertIntTests();
+		splitPolicyIntTests();
+		nodeBufferIntTests();
+		try
+		{
+			File::remove(intIndexName);
+		}
+		catch (FileNotFoundException e)
+		{
+		}
+		parallelBuildIntTests();
+		try
+		{
+			File::remove(intIndexName);
+		}
+		catch (FileNotFoundException e)
+		{
+		}
+		multiBuildIntTests();
 		try
 		{
 			File::remove(intIndexName);
@@ -629,6 +679,1064 @@ void intTests()
 									checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
 											checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
 													checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+
+	// range counts must agree with the scans above
+	checkPassFail(intCount(&index, 25, GT, 40, LT), 14)
+			checkPassFail(intCount(&index, 20, GTE, 35, LTE), 16)
+					checkPassFail(intCount(&index, -3, GT, 3, LT), 3)
+							checkPassFail(intCount(&index, 996, GT, 1001, LT), 4)
+									checkPassFail(intCount(&index, 0, GT, 1, LT), 0)
+											checkPassFail(intCount(&index, 300, GT, 400, LT), 99)
+													checkPassFail(intCount(&index, 3000, GTE, 4000, LT), 1000)
+	rankTests(&index);
+
+	// aggregates over [20, 35]
+	KeyAggregate agg;
+	int aggLow = 20, aggHigh = 35;
+	index.aggregateRange(&aggLow, GTE, &aggHigh, LTE, agg);
+	checkPassFail(agg.count, 16)
+	checkPassFail(agg.keySum, 440)
+	checkPassFail(agg.minKey, 20)
+	checkPassFail(agg.maxKey, 35)
+
+	// the counters start over after a reset
+	IndexStats indexStats = index.stats(true);
+	std::cout << "readPage calls:" << indexStats.readPageCalls << " buffer misses:" << indexStats.bufferMisses
+			  << " leaf splits:" << indexStats.leafSplits << " internal splits:" << indexStats.internalSplits
+			  << " scans:" << indexStats.scans << " leaves scanned:" << indexStats.scanLeavesVisited << std::endl;
+	checkPassFail(index.stats().scans, 0)
+	std::cout << "insertEntry p50/p99 ns:" << index.latencyHistogram(OP_INSERT_ENTRY).percentile(0.5) << "/"
+			  << index.latencyHistogram(OP_INSERT_ENTRY).percentile(0.99)
+			  << " scanNext p50/p99 ns:" << index.latencyHistogram(OP_SCAN_NEXT).percentile(0.5) << "/"
+			  << index.latencyHistogram(OP_SCAN_NEXT).percentile(0.99) << std::endl;
+
+	// packing the leaves keeps every entry and never adds a leaf
+	IndexStructure before = index.analyze();
+	int pagesFreed = index.compact(0.9);
+	IndexStructure after = index.analyze();
+	std::cout << "height:" << after.height << " leaves before/after compaction:" << before.levels.back().nodes << "/"
+			  << after.levels.back().nodes << " leaf fill before/after:" << before.levels.back().fillFactor() << "/"
+			  << after.levels.back().fillFactor() << std::endl;
+	checkPassFail(after.levels.back().keys, before.levels.back().keys)
+	int nodesBefore = 0, nodesAfter = 0;
+	for (size_t level = 0; level < before.levels.size(); level++)
+		nodesBefore += before.levels[level].nodes;
+	for (size_t level = 0; level < after.levels.size(); level++)
+		nodesAfter += after.levels[level].nodes;
+	checkPassFail(nodesBefore - nodesAfter, pagesFreed)
+	checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+	checkPassFail(intCount(&index, 300, GT, 400, LT), 99)
+}
+
+// -----------------------------------------------------------------------------
+// mappedIntTests
+// -----------------------------------------------------------------------------
+
+void mappedIntTests()
+{
+	std::cout << "Open the B+ Tree index on the integer field read-only" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, -1, DOUBLE, OPEN_READ_ONLY_MAPPED);
+
+	checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+	checkPassFail(intCount(&index, 300, GT, 400, LT), 99)
+
+	// a parallel scan returns the record ids of a sequential scan, in the same order
+	int low = 1000, high = 4000;
+	std::vector<RecordId> scanRids, parallelRids;
+	index.startScan(&low, GT, &high, LTE);
+	try
+	{
+		RecordId rid;
+		while (1)
+		{
+			index.scanNext(rid);
+			scanRids.push_back(rid);
+		}
+	}
+	catch (IndexScanCompletedException e)
+	{
+	}
+	index.endScan();
+	index.parallelScan(&low, GT, &high, LTE, 4, parallelRids);
+	int sameRids = 0;
+	for (size_t i = 0; i < parallelRids.size() && i < scanRids.size(); i++)
+	{
+		if (parallelRids[i].page_number == scanRids[i].page_number && parallelRids[i].slot_number == scanRids[i].slot_number)
+			sameRids++;
+	}
+	checkPassFail((int)parallelRids.size(), 3000)
+	checkPassFail(sameRids, 3000)
+
+	// read-ahead only hints the kernel, a scan over every leaf still returns each key once
+	int batch[] = {4999, 17, 2500, 17, 0};
+	index.prefetchKeys(batch, 5);
+	checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+
+	try
+	{
+		int key = 0;
+		RecordId rid;
+		index.insertEntry(&key, rid);
+		std::cout << "Insert into a read-only index Test Failed." << std::endl;
+	}
+	catch (BadgerDbException e)
+	{
+		std::cout << "Insert into a read-only index Test Passed." << std::endl;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// snapshotIntTests
+// -----------------------------------------------------------------------------
+
+void snapshotIntTests()
+{
+	std::cout << "Export the B+ Tree index on the integer field to a snapshot" << std::endl;
+	std::string snapshotName = intIndexName + ".snapshot";
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	int numKeys = intCount(&index, 0, GTE, 1 << 30, LTE);
+	checkPassFail(index.exportSnapshot(snapshotName), numKeys)
+
+	{
+		BTreeSnapshot snapshot(snapshotName, bufMgr);
+		checkPassFail(snapshot.size(), numKeys)
+		int low = 25, high = 40;
+		checkPassFail(snapshot.countRange(&low, GT, &high, LT), 14)
+		low = 3000;
+		high = 4000;
+		checkPassFail(snapshot.countRange(&low, GTE, &high, LT), 1000)
+
+		// the snapshot returns the record ids of the tree, in the same order
+		low = 1000;
+		std::vector<RecordId> scanRids, snapshotRids;
+		RecordId rid;
+		index.startScan(&low, GT, &high, LTE);
+		snapshot.startScan(&low, GT, &high, LTE);
+		try
+		{
+			while (1)
+			{
+				index.scanNext(rid);
+				scanRids.push_back(rid);
+			}
+		}
+		catch (IndexScanCompletedException e)
+		{
+		}
+		try
+		{
+			while (1)
+			{
+				snapshot.scanNext(rid);
+				snapshotRids.push_back(rid);
+			}
+		}
+		catch (IndexScanCompletedException e)
+		{
+		}
+		index.endScan();
+		snapshot.endScan();
+		int sameRids = 0;
+		for (size_t i = 0; i < snapshotRids.size() && i < scanRids.size(); i++)
+		{
+			if (snapshotRids[i].page_number == scanRids[i].page_number && snapshotRids[i].slot_number == scanRids[i].slot_number)
+				sameRids++;
+		}
+		checkPassFail((int)snapshotRids.size(), 3000)
+		checkPassFail(sameRids, 3000)
+
+		int key = 1001;
+		snapshot.lookup(&key, rid);
+		checkPassFail(rid.page_number, scanRids[0].page_number)
+		checkPassFail(rid.slot_number, scanRids[0].slot_number)
+		try
+		{
+			key = numKeys;
+			snapshot.lookup(&key, rid);
+			std::cout << "Snapshot lookup of a missing key Test Failed." << std::endl;
+		}
+		catch (NoSuchKeyFoundException e)
+		{
+			std::cout << "Snapshot lookup of a missing key Test Passed." << std::endl;
+		}
+	}
+
+	// a compressed snapshot answers the same on fewer leaf pages
+	int plainLeafPages;
+	{
+		BTreeSnapshot snapshot(snapshotName, bufMgr);
+		plainLeafPages = snapshot.leafPages();
+	}
+	checkPassFail(index.exportSnapshot(snapshotName, true), numKeys)
+	{
+		BTreeSnapshot snapshot(snapshotName, bufMgr);
+		checkPassFail(snapshot.size(), numKeys)
+		checkPassFail((snapshot.leafPages() < plainLeafPages), true)
+		int low = 25, high = 40;
+		checkPassFail(snapshot.countRange(&low, GT, &high, LT), 14)
+		low = 1000;
+		high = 4000;
+		RecordId rid, scanRid;
+		index.startScan(&low, GTE, &low, LTE);
+		index.scanNext(scanRid);
+		index.endScan();
+		snapshot.lookup(&low, rid);
+		checkPassFail(rid.page_number, scanRid.page_number)
+		checkPassFail(rid.slot_number, scanRid.slot_number)
+		int scanned = 0;
+		snapshot.startScan(&low, GT, &high, LTE);
+		try
+		{
+			while (1)
+			{
+				snapshot.scanNext(rid);
+				scanned++;
+			}
+		}
+		catch (IndexScanCompletedException e)
+		{
+		}
+		snapshot.endScan();
+		checkPassFail(scanned, 3000)
+	}
+
+	// with a multiple of SNAPSHOT_BLOCK_KEYS full leaves, the blocks above them have no room left past the last leaf
+	std::string fullIndexName;
+	{
+		BTreeIndex fullIndex("relSnapshot", fullIndexName, bufMgr, offsetof(tuple, i), INTEGER, -1, DOUBLE, OPEN_CREATE_EMPTY);
+		int numFull = 2 * SNAPSHOT_BLOCK_KEYS * SNAPSHOT_LEAF_SIZE;
+		for (int key = 0; key < numFull; key++)
+		{
+			RecordId rid = {1, 1};
+			fullIndex.insertEntry(&key, rid);
+		}
+		checkPassFail(fullIndex.exportSnapshot(snapshotName), numFull)
+		BTreeSnapshot snapshot(snapshotName, bufMgr);
+		int low = numFull - 5, high = numFull + 100;
+		checkPassFail(snapshot.countRange(&low, GTE, &high, LTE), 5)
+		low = numFull;
+		checkPassFail(snapshot.countRange(&low, GTE, &high, LTE), 0)
+		try
+		{
+			RecordId rid;
+			snapshot.lookup(&high, rid);
+			std::cout << "Snapshot lookup past the last key Test Failed." << std::endl;
+		}
+		catch (NoSuchKeyFoundException e)
+		{
+			std::cout << "Snapshot lookup past the last key Test Passed." << std::endl;
+		}
+	}
+
+	try
+	{
+		File::remove(snapshotName);
+		File::remove(fullIndexName);
+	}
+	catch (FileNotFoundException e)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// hashIntTests
+// -----------------------------------------------------------------------------
+
+void hashIntTests()
+{
+	std::cout << "Create a hash index on the integer field" << std::endl;
+	std::string hashIndexName;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		HashIndex hashIndex(relationName, hashIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		int numKeys = intCount(&index, 0, GTE, 1 << 30, LTE);
+		checkPassFail(hashIndex.size(), numKeys)
+
+		// a probe finds the same record as an equality scan of the B+ Tree
+		int key = 2500;
+		RecordId scanRid, hashRid;
+		index.startScan(&key, GTE, &key, LTE);
+		index.scanNext(scanRid);
+		index.endScan();
+		hashIndex.lookup(&key, hashRid);
+		checkPassFail(hashRid.page_number, scanRid.page_number)
+		checkPassFail(hashRid.slot_number, scanRid.slot_number)
+
+		// duplicates of one key outgrow a bucket and go to overflow pages
+		RecordId rid = {1, 1};
+		key = 77;
+		for (int dup = 0; dup < 2000; dup++)
+		{
+			hashIndex.insertEntry(&key, rid);
+		}
+		std::vector<RecordId> rids;
+		checkPassFail(hashIndex.lookupAll(&key, rids), 2001)
+		key = 78;
+		rids.clear();
+		checkPassFail(hashIndex.lookupAll(&key, rids), 1)
+	}
+
+	{
+		// the directory is written with the index and read back on open
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		HashIndex hashIndex(relationName, hashIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		int numKeys = intCount(&index, 0, GTE, 1 << 30, LTE);
+		checkPassFail(hashIndex.size(), numKeys + 2000)
+		std::vector<RecordId> rids;
+		int key = numKeys - 1;
+		checkPassFail(hashIndex.lookupAll(&key, rids), 1)
+		try
+		{
+			key = numKeys;
+			RecordId rid;
+			hashIndex.lookup(&key, rid);
+			std::cout << "Hash lookup of a missing key Test Failed." << std::endl;
+		}
+		catch (NoSuchKeyFoundException e)
+		{
+			std::cout << "Hash lookup of a missing key Test Passed." << std::endl;
+		}
+	}
+
+	try
+	{
+		HashIndex hashIndex(relationName, hashIndexName, bufMgr, offsetof(tuple, i), DOUBLE);
+		std::cout << "Hash index meta page mismatch Test Failed." << std::endl;
+	}
+	catch (BadIndexInfoException e)
+	{
+		std::cout << "Hash index meta page mismatch Test Passed." << std::endl;
+	}
+
+	try
+	{
+		File::remove(hashIndexName);
+	}
+	catch (FileNotFoundException e)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// learnedIntTests
+// -----------------------------------------------------------------------------
+
+void learnedIntTests()
+{
+	std::cout << "Route scans of the B+ Tree index on the integer field with learned models" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	index.setLearnedRouting(4);
+	index.stats(true);
+	int numKeys = intCount(&index, 0, GTE, 1 << 30, LTE);
+
+	checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
+	checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+	checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
+
+	// splits at both ends of the key range adjust the models
+	RecordId rid = {1, 1};
+	for (int key = 1; key <= 2000; key++)
+	{
+		int newKey = -key;
+		index.insertEntry(&newKey, rid);
+		newKey = numKeys + key;
+		index.insertEntry(&newKey, rid);
+	}
+	checkPassFail(intScan(&index, -1000, GTE, -900, LT), 100)
+	checkPassFail(intScan(&index, numKeys + 500, GT, numKeys + 700, LTE), 200)
+	checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+#if BTREE_STATS
+	IndexStats learnedStats = index.stats();
+	checkPassFail((learnedStats.learnedLookups > 0), true)
+#endif
+
+	index.compact();
+	checkPassFail(intScan(&index, -2000, GTE, numKeys + 2000, LTE), numKeys + 4000)
+
+	// a leaf whose keys are too far apart for their differences to fit in an int
+	std::string wideIndexName;
+	{
+		BTreeIndex wideIndex("relLearned", wideIndexName, bufMgr, offsetof(tuple, i), INTEGER, -1, DOUBLE, OPEN_CREATE_EMPTY);
+		for (int key = 0; key < 2 * INTARRAYLEAFSIZE; key++)
+		{
+			wideIndex.insertEntry(&key, rid);
+		}
+		int minKey = INT_MIN + 1;
+		wideIndex.insertEntry(&minKey, rid);
+		wideIndex.setLearnedRouting(4);
+		checkPassFail(intScan(&wideIndex, 100, GTE, 110, LT), 10)
+		checkPassFail(intScan(&wideIndex, minKey, GTE, 10, LT), 11)
+	}
+	try
+	{
+		File::remove(wideIndexName);
+	}
+	catch (FileNotFoundException e)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// frontIndexIntTests
+// -----------------------------------------------------------------------------
+
+void frontIndexIntTests()
+{
+	std::cout << "Route scans of the B+ Tree index on the integer field through the front index" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	index.setFrontIndex(true);
+	index.stats(true);
+	int numKeys = intCount(&index, -(1 << 30), GTE, 1 << 30, LTE);
+
+	checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
+	checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+
+	// leaf splits in the middle and at the left end add their separators
+	RecordId rid = {1, 1};
+	for (int key = 100; key <= 1100; key++)
+	{
+		index.insertEntry(&key, rid);
+		int newKey = -3000 - key;
+		index.insertEntry(&newKey, rid);
+	}
+	checkPassFail(intScan(&index, 99, GT, 1100, LTE), 2002)
+	checkPassFail(intScan(&index, -4100, GTE, -3100, LTE), 1001)
+	checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+#if BTREE_STATS
+	IndexStats frontStats = index.stats();
+	checkPassFail((frontStats.frontIndexLookups > 0), true)
+#endif
+
+	index.compact();
+	checkPassFail(intScan(&index, -(1 << 30), GTE, 1 << 30, LTE), numKeys + 2002)
+	checkPassFail(intScan(&index, 996, GT, 1001, LT), 8)
+}
+
+// -----------------------------------------------------------------------------
+// filterIntTests
+// -----------------------------------------------------------------------------
+
+void filterIntTests()
+{
+	std::cout << "Filter scans of the B+ Tree index on the integer field with key predicates" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	index.stats(true);
+
+	// [2000,3000) still holds every key once, the earlier tests only added keys outside of it
+	checkPassFail(intFilterScan(&index, 2000, GTE, 3000, LT, KeyPredicate::mod(7, 0), 0), 143)
+	checkPassFail(intFilterScan(&index, 2000, GTE, 3000, LT, KeyPredicate::mod(7, 0), 16), 143)
+	checkPassFail(intFilterScan(&index, 2000, GTE, 3000, LT, KeyPredicate::mask(3, 1), 1000), 250)
+	std::vector<int> excluded;
+	excluded.push_back(2500);
+	excluded.push_back(2001);
+	excluded.push_back(5000);
+	excluded.push_back(2000);
+	checkPassFail(intFilterScan(&index, 1999, GT, 3000, LT, KeyPredicate::notIn(excluded), 7), 997)
+	// odd multiples of 7
+	checkPassFail(intFilterScan(&index, 2000, GTE, 2999, LTE,
+								KeyPredicate::both(KeyPredicate::mod(7, 0), KeyPredicate::negate(KeyPredicate::mask(1, 0))), 0), 71)
+	// a NOT-IN list long enough to be binary searched
+	excluded.clear();
+	for (int key = 2020; key > 2000; key--)
+	{
+		excluded.push_back(key);
+	}
+	checkPassFail(intFilterScan(&index, 2000, GTE, 3000, LT,
+								KeyPredicate::either(KeyPredicate::mod(100, 0), KeyPredicate::notIn(excluded)), 64), 980)
+	checkPassFail(intFilterScan(&index, 2000, GTE, 3000, LT, KeyPredicate::mod(0, 0), 64), 0)
+	checkPassFail(intFilterScan(&index, 2000, GTE, 3000, LT, KeyPredicate(), 64), 1000)
+
+#if BTREE_STATS
+	IndexStats filterStats = index.stats();
+	checkPassFail((filterStats.scanEntriesFiltered > 0), true)
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// heapFetchIntTests
+// -----------------------------------------------------------------------------
+
+void heapFetchIntTests()
+{
+	std::cout << "Fetch the records of B+ Tree index entries on the integer field page by page" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	HeapFetch fetch(file1, bufMgr);
+
+	int lowVal = 2000;
+	int highVal = 3000;
+	checkPassFail(fetch.fetchRange(&index, &lowVal, GTE, &highVal, LT), 1000)
+	RecordId rid;
+	std::string record;
+	std::set<PageId> pages;
+	PageId lastPage = 0;
+	int numRecords = 0;
+	bool inOrder = true;
+	bool inRange = true;
+	while (1)
+	{
+		try
+		{
+			fetch.next(rid, record);
+		}
+		catch (EndOfFileException e)
+		{
+			break;
+		}
+		RECORD myRec = *(reinterpret_cast<const RECORD *>(record.data()));
+		inRange = inRange && myRec.i >= lowVal && myRec.i < highVal;
+		inOrder = inOrder && rid.page_number >= lastPage;
+		lastPage = rid.page_number;
+		pages.insert(rid.page_number);
+		numRecords++;
+	}
+	checkPassFail(numRecords, 1000)
+	checkPassFail(inRange, true)
+	checkPassFail(inOrder, true)
+	checkPassFail(fetch.pagesRead(), (int)pages.size())
+
+	KeyPredicate sevens = KeyPredicate::mod(7, 0);
+	checkPassFail(fetch.fetchRange(&index, &lowVal, GTE, &highVal, LT, &sevens), 143)
+
+	// a range without entries leaves no scan of the index running
+	std::string smallIndexName;
+	{
+		BTreeIndex smallIndex("relFetch", smallIndexName, bufMgr, offsetof(tuple, i), INTEGER, -1, DOUBLE, OPEN_CREATE_EMPTY);
+		for (int key = 0; key < 10; key++)
+		{
+			RecordId smallRid = {1, 1};
+			smallIndex.insertEntry(&key, smallRid);
+		}
+		int missingLow = 100;
+		int missingHigh = 200;
+		checkPassFail(fetch.fetchRange(&smallIndex, &missingLow, GT, &missingHigh, LT), 0)
+		bool scanEnded = false;
+		try
+		{
+			smallIndex.endScan();
+		}
+		catch (ScanNotInitializedException e)
+		{
+			scanEnded = true;
+		}
+		checkPassFail(scanEnded, true)
+	}
+	try
+	{
+		File::remove(smallIndexName);
+	}
+	catch (FileNotFoundException e)
+	{
+	}
+
+	// record ids in random order, each twice, still read every page once
+	std::vector<RecordId> rids;
+	index.startScan(&lowVal, GTE, &highVal, LT);
+	try
+	{
+		while (1)
+		{
+			index.scanNext(rid);
+			rids.push_back(rid);
+			rids.push_back(rid);
+		}
+	}
+	catch (IndexScanCompletedException e)
+	{
+	}
+	index.endScan();
+	for (size_t i = rids.size(); i > 1; i--)
+	{
+		std::swap(rids[i - 1], rids[random() % i]);
+	}
+	fetch.fetchRids(rids);
+	numRecords = 0;
+	try
+	{
+		while (1)
+		{
+			fetch.next(rid, record);
+			numRecords++;
+		}
+	}
+	catch (EndOfFileException e)
+	{
+	}
+	checkPassFail(numRecords, 2000)
+	checkPassFail(fetch.pagesRead(), (int)pages.size())
+}
+
+// -----------------------------------------------------------------------------
+// joinIntTests
+// -----------------------------------------------------------------------------
+
+void joinIntTests()
+{
+	std::cout << "Join the relation with itself through the B+ Tree index on the integer field" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+	// The relation holds every key from 0 up once, so the outer tuples join with all the entries of that range,
+	// and each of them at least with its own entry
+	std::set<int> outerKeys;
+	int numOuter = 0;
+	{
+		FileScan scan(relationName, bufMgr);
+		try
+		{
+			RecordId scanRid;
+			while (1)
+			{
+				scan.scanNext(scanRid);
+				RECORD myRec = *(reinterpret_cast<const RECORD *>(scan.getRecord().data()));
+				outerKeys.insert(myRec.i);
+				numOuter++;
+			}
+		}
+		catch (EndOfFileException e)
+		{
+		}
+	}
+	checkPassFail((int)outerKeys.size(), numOuter)
+	checkPassFail(*outerKeys.rbegin(), numOuter - 1)
+	int expected = intFilterScan(&index, 0, GTE, numOuter - 1, LTE, KeyPredicate(), 64);
+
+	index.stats(true);
+	int selfPairs = 0;
+	checkPassFail(intJoin(&index, JOIN_OUTER_BATCH, selfPairs), expected)
+	checkPassFail((selfPairs >= numOuter), true)
+#if BTREE_STATS
+	IndexStats joinStats = index.stats();
+	checkPassFail((int)joinStats.probeKeys, numOuter)
+	checkPassFail((joinStats.probeDescents < joinStats.probeKeys), true)
+#endif
+
+	// batches that end in the middle of leaves and of duplicate keys
+	checkPassFail(intJoin(&index, 7, selfPairs), expected)
+	checkPassFail((selfPairs >= numOuter), true)
+}
+
+// Join the relation with the index on its integer field and count the pairs, and those of a tuple with itself
+int intJoin(BTreeIndex *index, int batchSize, int &selfPairs)
+{
+	std::cout << "Join in batches of " << batchSize << std::endl;
+	IndexNestedLoopJoin join(relationName, offsetof(tuple, i), index, bufMgr, batchSize);
+	int numPairs = 0;
+	selfPairs = 0;
+	try
+	{
+		RecordId outerRid;
+		RecordId innerRid;
+		while (1)
+		{
+			join.next(outerRid, innerRid);
+			numPairs++;
+			if (outerRid.page_number == innerRid.page_number && outerRid.slot_number == innerRid.slot_number)
+			{
+				selfPairs++;
+			}
+		}
+	}
+	catch (EndOfFileException e)
+	{
+	}
+	return numPairs;
+}
+
+// -----------------------------------------------------------------------------
+// insertIntTests
+// -----------------------------------------------------------------------------
+
+void insertIntTests()
+{
+	std::cout << "Insert into an empty B+ Tree index on the integer field" << std::endl;
+	const std::string insertRelationName = "relInsert";
+	std::string insertIndexName;
+	int closeWrites = 0;
+	{
+		BTreeIndex index(insertRelationName, insertIndexName, bufMgr, offsetof(tuple, i), INTEGER, offsetof(tuple, d),
+						 DOUBLE, OPEN_CREATE_EMPTY);
+
+		// counts and aggregates hold after every insert, across the split of the root leaf
+		int numKeys = 2 * INTARRAYLEAFSIZE;
+		int low = -(1 << 30), high = 1 << 30;
+		int wrongCounts = 0, wrongAggregates = 0;
+		long long keySum = 0;
+		for (int key = numKeys - 1; key >= 0; key--)
+		{
+			RecordId rid = {1, 1};
+			index.insertEntry(&key, rid, 2.0 * key);
+			keySum += key;
+			int inserted = numKeys - key;
+			KeyAggregate agg;
+			index.aggregateRange(&low, GTE, &high, LTE, agg);
+			if (index.countRange(&low, GTE, &high, LTE) != inserted)
+				wrongCounts++;
+#if BTREE_SUBTREE_AGGREGATES
+			if (agg.count != inserted || agg.keySum != keySum || agg.includeSum != 2.0 * keySum)
+#else
+			if (agg.count != inserted || agg.keySum != keySum)
+#endif
+				wrongAggregates++;
+		}
+		checkPassFail(wrongCounts, 0)
+		checkPassFail(wrongAggregates, 0)
+		checkPassFail(intCount(&index, 0, GTE, INTARRAYLEAFSIZE, LT), INTARRAYLEAFSIZE)
+
+		// ascending keys past the largest one are appended to the rightmost leaf, which splits along the way
+		index.stats(true);
+		for (int key = numKeys; key < 6 * numKeys; key++)
+		{
+			RecordId rid = {1, 1};
+			index.insertEntry(&key, rid, 2.0 * key);
+			keySum += key;
+			if (index.countRange(&low, GTE, &high, LTE) != key + 1)
+				wrongCounts++;
+		}
+		checkPassFail(wrongCounts, 0)
+#if BTREE_STATS
+		checkPassFail((index.stats().appendInserts > (std::uint64_t)numKeys), true)
+#endif
+
+		// inserts that descend into the rightmost leaf, in between appends to it
+		for (int key = 6 * numKeys - 2; key > 6 * numKeys - 12; key -= 2)
+		{
+			RecordId rid = {1, 1};
+			index.insertEntry(&key, rid, 2.0 * key);
+			int newKey = 6 * numKeys + (6 * numKeys - key);
+			index.insertEntry(&newKey, rid, 2.0 * newKey);
+			keySum += key + newKey;
+		}
+		KeyAggregate agg;
+		index.aggregateRange(&low, GTE, &high, LTE, agg);
+		checkPassFail(agg.count, 6 * numKeys + 10)
+		checkPassFail(agg.keySum, keySum)
+		checkPassFail(intScan(&index, 6 * numKeys - 12, GT, 6 * numKeys + 12, LT), 21)
+		checkPassFail(intCount(&index, 6 * numKeys - 12, GT, 6 * numKeys + 12, LT), 21)
+
+		// nothing is checkpointed until it is asked for
+		checkPassFail((int)index.getCheckpointLSN(), 0)
+	}
+	{
+		// closing the index recorded a checkpoint of every insert
+		BTreeIndex index(insertRelationName, insertIndexName, bufMgr, offsetof(tuple, i), INTEGER, offsetof(tuple, d),
+						 DOUBLE, OPEN_CREATE_EMPTY);
+		int numEntries = 12 * INTARRAYLEAFSIZE + 10;
+		KeyAggregate agg;
+		checkPassFail((int)index.getCheckpointLSN(), numEntries)
+		checkPassFail(index.checkpoint(-1), false)
+
+		// checkpoint steps along the inserts flush the index as soon as a page is dirty, and a direct one covers the
+		// inserts made since
+		index.setCheckpointRate(1);
+		int numInserts = 4 * DEFAULT_CHECKPOINT_INTERVAL + 1;
+		for (int key = -1; key >= -numInserts; key--)
+		{
+			RecordId rid = {1, 1};
+			index.insertEntry(&key, rid, 2.0 * key);
+		}
+		checkPassFail(((int)index.getCheckpointLSN() > numEntries), true)
+		checkPassFail(index.checkpoint(-1), true)
+		checkPassFail((int)index.getCheckpointLSN(), numEntries + numInserts)
+		checkPassFail(index.checkpoint(-1), false)
+		checkPassFail(intCount(&index, -numInserts, GTE, 0, LT), numInserts)
+
+		// copies of a key split into several leaves, and the separators between them are copies too
+		int dupKey = -1000, numDups = 3 * INTARRAYLEAFSIZE;
+		for (int i = 0; i < numDups; i++)
+		{
+			RecordId rid = {1, 1};
+			index.insertEntry(&dupKey, rid, 2.0 * dupKey);
+		}
+		checkPassFail(intScan(&index, dupKey, GTE, dupKey, LTE), numDups)
+		checkPassFail(intCount(&index, dupKey, GTE, dupKey, LTE), numDups)
+		checkPassFail(intCount(&index, dupKey - 1, GT, dupKey, LTE), numDups)
+		checkPassFail(intCount(&index, dupKey - 1, GT, dupKey, LT), 0)
+		checkPassFail(intCount(&index, dupKey, GT, 0, LT), numInserts)
+		checkPassFail(intCount(&index, dupKey, GTE, 0, LT), numDups + numInserts)
+		int dupLow = dupKey - 1, zero = 0;
+		index.aggregateRange(&dupKey, GTE, &dupKey, LTE, agg);
+		checkPassFail(agg.count, numDups)
+		checkPassFail(agg.keySum, (long long)numDups * dupKey)
+#if BTREE_SUBTREE_AGGREGATES
+		checkPassFail(agg.includeSum, 2.0 * numDups * dupKey)
+#endif
+		index.aggregateRange(&dupLow, GT, &dupKey, LTE, agg);
+		checkPassFail(agg.count, numDups)
+		index.aggregateRange(&dupKey, GT, &zero, LT, agg);
+		checkPassFail(agg.count, numInserts)
+#if BTREE_SUBTREE_AGGREGATES
+		checkPassFail(agg.includeSum, -1.0 * numInserts * (numInserts + 1))
+#endif
+
+		// a count reads a path per bound with subtree counts and the leaves of the range without, never the leaves left of it
+#if BTREE_STATS
+		int height = index.analyze().height;
+		index.stats(true);
+#endif
+		checkPassFail(intCount(&index, 10 * INTARRAYLEAFSIZE, GTE, 10 * INTARRAYLEAFSIZE + 10, LT), 10)
+#if BTREE_STATS
+		checkPassFail((index.stats().readPageCalls <= (std::uint64_t)(4 * height)), true)
+#endif
+
+		// a checkpoint leaves nothing for the close to write
+		index.checkpoint(-1);
+		closeWrites = bufMgr->getBufStats().diskwrites;
+	}
+	checkPassFail((int)(bufMgr->getBufStats().diskwrites - closeWrites), 0)
+	try
+	{
+		File::remove(insertIndexName);
+	}
+	catch (FileNotFoundException e)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// splitPolicyIntTests
+// -----------------------------------------------------------------------------
+
+void splitPolicyIntTests()
+{
+	std::cout << "Insert sorted keys into empty B+ Tree indexes with both split policies" << std::endl;
+	int numKeys = 10 * INTARRAYLEAFSIZE;
+	for (int adaptive = 0; adaptive < 2; adaptive++)
+	{
+		for (int backward = 0; backward < 2; backward++)
+		{
+			std::string splitIndexName;
+			{
+				BTreeIndex index("relSplit", splitIndexName, bufMgr, offsetof(tuple, i), INTEGER, -1, DOUBLE, OPEN_CREATE_EMPTY);
+				index.setSplitPolicy(adaptive ? SPLIT_ADAPTIVE : SPLIT_EVEN);
+				for (int i = 0; i < numKeys; i++)
+				{
+					RecordId rid = {1, 1};
+					int key = backward ? numKeys - 1 - i : i;
+					index.insertEntry(&key, rid);
+				}
+				checkPassFail(intScan(&index, 0, GTE, numKeys, LT), numKeys)
+				checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+
+				// runs fill the leaves they leave behind, halves leave them half empty
+				double leafFill = index.analyze().levels.back().fillFactor();
+				std::cout << (adaptive ? "adaptive" : "even") << " splits of " << (backward ? "descending" : "ascending")
+						  << " keys, leaf fill:" << leafFill << std::endl;
+				if (adaptive)
+				{
+					checkPassFail((leafFill > 0.95), true)
+				}
+				else
+				{
+					checkPassFail((leafFill < 0.6), true)
+				}
+#if BTREE_STATS
+				checkPassFail((index.stats().skewedSplits > 0), (adaptive == 1))
+#endif
+			}
+			try
+			{
+				File::remove(splitIndexName);
+			}
+			catch (FileNotFoundException e)
+			{
+			}
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// nodeBufferIntTests
+// -----------------------------------------------------------------------------
+
+void nodeBufferIntTests()
+{
+	std::cout << "Insert keys in scattered order into an empty B+ Tree index with many more nodes than are pinned at once" << std::endl;
+	// nodes of several pages are copied into buffers that are reused once their node is unpinned, so inserts that keep
+	// going back to leaves released long ago must find them written back into their pages
+	int numKeys = 200 * INTARRAYLEAFSIZE;
+	int stride = 7919;
+	std::string nodeIndexName;
+	{
+		BTreeIndex index("relNodes", nodeIndexName, bufMgr, offsetof(tuple, i), INTEGER, -1, DOUBLE, OPEN_CREATE_EMPTY);
+		for (int i = 0; i < numKeys; i++)
+		{
+			RecordId rid = {1, 1};
+			int key = (int)((long long)i * stride % numKeys);
+			index.insertEntry(&key, rid);
+		}
+		// far more leaves than node buffers ever in use
+		checkPassFail((index.analyze().levels.back().nodes > 2 * 64), true)
+		checkPassFail(intScan(&index, 0, GTE, numKeys, LT), numKeys)
+		checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+	}
+	{
+		// the index file holds every node once it is closed
+		BTreeIndex index("relNodes", nodeIndexName, bufMgr, offsetof(tuple, i), INTEGER, -1, DOUBLE, OPEN_CREATE_EMPTY);
+		checkPassFail(intScan(&index, 0, GTE, numKeys, LT), numKeys)
+		checkPassFail(intCount(&index, numKeys / 2, GTE, numKeys, LT), numKeys - numKeys / 2)
+	}
+	{
+		// a meta page of the baseline layout, which ends with the root page, opens as a plain single page index
+		BlobFile indexFile(nodeIndexName, false);
+		Page meta = indexFile.readPage(indexFile.getFirstPageNo());
+		IndexMetaInfo *metaInfo = (IndexMetaInfo *)&meta;
+		memset((char *)metaInfo + offsetof(IndexMetaInfo, checkpointLSN), 0,
+			   sizeof(IndexMetaInfo) - offsetof(IndexMetaInfo, checkpointLSN));
+		indexFile.writePage(indexFile.getFirstPageNo(), meta);
+	}
+	try
+	{
+		BTreeIndex index("relNodes", nodeIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		checkPassFail((INDEX_NODE_FORMAT == 0 && NODE_SIZE == Page::SIZE), true)
+		checkPassFail(intCount(&index, 0, GTE, numKeys, LT), numKeys)
+	}
+	catch (BadIndexInfoException *e)
+	{
+		// the meta page mismatch of BTreeIndex is thrown with new
+		delete e;
+		checkPassFail((INDEX_NODE_FORMAT == 0 && NODE_SIZE == Page::SIZE), false)
+	}
+	try
+	{
+		File::remove(nodeIndexName);
+	}
+	catch (FileNotFoundException e)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// parallelBuildIntTests
+// -----------------------------------------------------------------------------
+
+void parallelBuildIntTests()
+{
+	std::cout << "Create a B+ Tree index on the integer field with 4 threads" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, -1, DOUBLE, OPEN_READ_WRITE, 4);
+
+	checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
+	checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+	checkPassFail(intCount(&index, 300, GT, 400, LT), 99)
+	rankTests(&index);
+
+	// the bulk loaded leaves are full, inserting into them splits them
+	for (int key = 1; key < 2000; key += 2)
+	{
+		RecordId rid = {1, 1};
+		int newKey = -key;
+		index.insertEntry(&newKey, rid);
+	}
+	checkPassFail(intCount(&index, -2000, GTE, 0, LT), 1000)
+	checkPassFail(intCount(&index, -2000, GTE, relationSize, LT), relationSize + 1000)
+
+	// entries can also be added straight from a record
+	tuple record;
+	memset(&record, 0, sizeof(tuple));
+	record.i = -5000;
+	RecordId rid = {1, 1};
+	index.insertRecord(reinterpret_cast<const char *>(&record), rid);
+	checkPassFail(intCount(&index, -5000, GTE, -5000, LTE), 1)
+}
+
+// -----------------------------------------------------------------------------
+// multiBuildIntTests
+// -----------------------------------------------------------------------------
+
+void multiBuildIntTests()
+{
+	std::cout << "Create B+ Tree indexes with a single read of the relation" << std::endl;
+	IndexSpec spec = {offsetof(tuple, i), INTEGER, -1, DOUBLE};
+	std::vector<IndexSpec> specs(1, spec);
+	std::vector<BTreeIndex *> indexes;
+	std::vector<std::string> indexNames;
+	BTreeIndex::buildIndexes(relationName, bufMgr, specs, indexes, indexNames, 2);
+	checkPassFail(indexNames[0], intIndexName)
+	checkPassFail(intScan(indexes[0], 25, GT, 40, LT), 14)
+	checkPassFail(intScan(indexes[0], 3000, GTE, 4000, LT), 1000)
+	checkPassFail(intCount(indexes[0], 300, GT, 400, LT), 99)
+	delete indexes[0];
+
+	// an index that exists already is opened, not built again
+	BTreeIndex::buildIndexes(relationName, bufMgr, specs, indexes, indexNames, 2);
+	checkPassFail(intCount(indexes[0], 300, GT, 400, LT), 99)
+	delete indexes[0];
+}
+
+int intCount(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	std::cout << "Count for " << (lowOp == GT ? "(" : "[") << lowVal << "," << highVal << (highOp == LT ? ")" : "]") << std::endl;
+	return index->countRange(&lowVal, lowOp, &highVal, highOp);
+}
+
+// Scan with a key predicate and count the results, with scanNextBatch() if batchSize is not 0 and scanNext() otherwise
+int intFilterScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, const KeyPredicate &filter, int batchSize)
+{
+	std::cout << "Filter scan for " << (lowOp == GT ? "(" : "[") << lowVal << "," << highVal << (highOp == LT ? ")" : "]")
+			  << " in batches of " << batchSize << std::endl;
+	try
+	{
+		index->startScan(&lowVal, lowOp, &highVal, highOp, &filter);
+	}
+	catch (NoSuchKeyFoundException e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+	int numResults = 0;
+	std::vector<RecordId> rids(batchSize ? batchSize : 1);
+	while (1)
+	{
+		try
+		{
+			if (batchSize)
+			{
+				numResults += index->scanNextBatch(&rids[0], batchSize);
+			}
+			else
+			{
+				index->scanNext(rids[0]);
+				numResults++;
+			}
+		}
+		catch (IndexScanCompletedException e)
+		{
+			break;
+		}
+	}
+	index->endScan();
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// rankTests
+// -----------------------------------------------------------------------------
+
+void rankTests(BTreeIndex *index)
+{
+	// keys are 0 .. numKeys - 1, so the key at rank k is k
+	int numKeys = intCount(index, 0, GTE, 1 << 30, LTE);
+	int key;
+	RecordId keyRid;
+	index->keyAtRank(0, &key, keyRid);
+	checkPassFail(key, 0)
+	index->keyAtRank(numKeys / 2, &key, keyRid);
+	checkPassFail(key, numKeys / 2)
+	index->keyAtRank(numKeys - 1, &key, keyRid);
+	checkPassFail(key, numKeys - 1)
+
+	try
+	{
+		index->keyAtRank(numKeys, &key, keyRid);
+		std::cout << "keyAtRank past the last entry Test Failed." << std::endl;
+	}
+	catch (NoSuchKeyFoundException e)
+	{
+		std::cout << "keyAtRank past the last entry Test Passed." << std::endl;
+	}
 }
 
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
@@ -817,6 +1925,19 @@ void errorTests()
 		std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
 	}
 
+	std::cout << "Index with a string included column" << std::endl;
+	try
+	{
+		std::string includeIndexName;
+		BTreeIndex includeIndex("relInclude", includeIndexName, bufMgr, offsetof(tuple, i), INTEGER, offsetof(tuple, s),
+								STRING, OPEN_CREATE_EMPTY);
+		std::cout << "BadIndexInfoException Test 1 Failed." << std::endl;
+	}
+	catch (BadIndexInfoException e)
+	{
+		std::cout << "BadIndexInfoException Test 1 Passed." << std::endl;
+	}
+
 	deleteRelation();
 }
 